@@ -0,0 +1,661 @@
+#define _GNU_SOURCE
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/perf_event.h>
+
+// Benchmark harness for the labs: runs a command over a sweep of parameters
+// with warm-up runs and repetitions and measures every run from outside -
+// wall time, perf_event_open counters of the whole process tree (the sum
+// servers fork their clients, the sorts start threads: the counters are
+// inherited), peak RSS and context switches from wait4. Numbers the program
+// prints itself are picked up with --metric. Results go to a table on
+// stdout, a speedup / efficiency table over one sweep, CSV (one row per run,
+// appended) and JSON (one document per invocation).
+
+#define MAX_SWEEPS 8
+#define MAX_VALUES 64
+#define MAX_METRICS 8
+#define MAX_ARGS 256
+#define CAPTURE_MAX (1 << 20)
+
+typedef struct {
+    const char *name;
+    char *values[MAX_VALUES];
+    int count;
+} sweep_t;
+
+typedef struct {
+    const char *name;
+    const char *text; // the number follows this text in stdout
+} metric_t;
+
+// perf_event_open counters, in the order of the result fields
+enum { EV_CYCLES, EV_INSTRUCTIONS, EV_CACHE_MISSES, EV_CTX_SWITCHES, EV_TASK_CLOCK, EV_PAGE_FAULTS, EV_COUNT };
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} events[EV_COUNT] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"ctx_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+typedef struct {
+    double wall_ms;
+    double ev[EV_COUNT];   // NAN when the counter is not available
+    double max_rss_kb;
+    double metric[MAX_METRICS];
+    int status;            // exit code, 128 + signal when killed
+} run_t;
+
+typedef struct {
+    int idx[MAX_SWEEPS];   // value of every sweep
+    run_t *runs;
+    run_t median;
+    double work;           // units per run, NAN without --work
+} point_t;
+
+static sweep_t sweeps[MAX_SWEEPS];
+static int nsweeps;
+static metric_t metrics[MAX_METRICS];
+static int nmetrics;
+static int warmup = 1, repeat = 5, show = 0;
+static const char *stdin_tmpl, *cwd_tmpl, *work_tmpl, *unit = "bytes", *label, *speedup_by;
+static const char *json_path, *csv_path;
+static char **cmd;
+static int ncmd;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+}
+
+static void *xmalloc(size_t n) {
+    void *p = malloc(n);
+    if (!p) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+// tmpl with every {name} of a sweep replaced by its value at the point
+static char *expand(const char *tmpl, const int *idx) {
+    size_t cap = strlen(tmpl) + 1, len = 0;
+    for (int s = 0; s < nsweeps; s++)
+        for (int v = 0; v < sweeps[s].count; v++) cap += strlen(sweeps[s].values[v]) * 4;
+    char *out = xmalloc(cap + 64);
+    for (const char *p = tmpl; *p;) {
+        int hit = 0;
+        if (*p == '{') {
+            for (int s = 0; s < nsweeps; s++) {
+                size_t n = strlen(sweeps[s].name);
+                if (strncmp(p + 1, sweeps[s].name, n) == 0 && p[1 + n] == '}') {
+                    const char *val = sweeps[s].values[idx[s]];
+                    size_t m = strlen(val);
+                    if (len + m >= cap) break;
+                    memcpy(out + len, val, m);
+                    len += m;
+                    p += n + 2;
+                    hit = 1;
+                    break;
+                }
+            }
+        }
+        if (!hit && len + 1 < cap) out[len++] = *p++;
+        else if (!hit) p++;
+    }
+    out[len] = '\0';
+    return out;
+}
+
+// An argument that is exactly one {name} becomes as many arguments as its
+// value has words, none for an empty value: --sweep mode=,--ring,"-j 2"
+static int build_argv(const int *idx, char **argv) {
+    int n = 0;
+    for (int i = 0; i < ncmd && n < MAX_ARGS - 1; i++) {
+        const char *a = cmd[i];
+        size_t len = strlen(a);
+        int whole = 0;
+        for (int s = 0; s < nsweeps; s++)
+            if (len == strlen(sweeps[s].name) + 2 && a[0] == '{' && a[len - 1] == '}' &&
+                strncmp(a + 1, sweeps[s].name, len - 2) == 0)
+                whole = 1;
+        char *e = expand(a, idx);
+        if (!whole) {
+            argv[n++] = e;
+            continue;
+        }
+        for (char *w = strtok(e, " "); w && n < MAX_ARGS - 1; w = strtok(NULL, " ")) argv[n++] = strdup(w);
+        free(e);
+    }
+    argv[n] = NULL;
+    return n;
+}
+
+static int perf_open(int k, pid_t pid) {
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = events[k].type;
+    a.config = events[k].config;
+    a.disabled = 1;
+    a.enable_on_exec = 1;
+    a.inherit = 1;
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd = (int)syscall(SYS_perf_event_open, &a, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd == -1 && (errno == EACCES || errno == EPERM)) {
+        // kernel.perf_event_paranoid >= 2: user space only
+        a.exclude_kernel = 1;
+        fd = (int)syscall(SYS_perf_event_open, &a, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+    return fd;
+}
+
+// Count scaled up for the time the counter was multiplexed out
+static double perf_read(int fd) {
+    uint64_t v[3];
+    if (fd == -1 || read(fd, v, sizeof(v)) != (ssize_t)sizeof(v) || v[2] == 0) return NAN;
+    return (double)v[0] * ((double)v[1] / (double)v[2]);
+}
+
+static double find_metric(const char *out, const char *text) {
+    const char *p = strstr(out, text);
+    if (!p) return NAN;
+    char *end;
+    double v = strtod(p + strlen(text), &end);
+    return end == p + strlen(text) ? NAN : v;
+}
+
+// One run of the point: the child waits on a pipe until the counters are
+// attached, so they see exec and nothing before it
+static void run_once(const int *idx, run_t *r) {
+    char *argv[MAX_ARGS];
+    build_argv(idx, argv);
+    char *in = stdin_tmpl ? expand(stdin_tmpl, idx) : strdup("/dev/null");
+    char *dir = cwd_tmpl ? expand(cwd_tmpl, idx) : NULL;
+
+    int go[2], out[2];
+    if (pipe2(go, O_CLOEXEC) == -1 || pipe2(out, O_CLOEXEC) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        int fd = open(in, O_RDONLY);
+        if (fd == -1 || dup2(fd, STDIN_FILENO) == -1 || dup2(out[1], STDOUT_FILENO) == -1) {
+            perror(in);
+            _exit(127);
+        }
+        if (dir && chdir(dir) == -1) {
+            perror(dir);
+            _exit(127);
+        }
+        char c;
+        if (read(go[0], &c, 1) != 1) _exit(127);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    close(go[0]);
+    close(out[1]);
+
+    int fds[EV_COUNT];
+    for (int k = 0; k < EV_COUNT; k++) fds[k] = perf_open(k, pid);
+
+    static char *captured;
+    if (!captured) captured = xmalloc(CAPTURE_MAX + 1);
+    size_t got = 0;
+    double t0 = now_ms();
+    if (write(go[1], "g", 1) != 1) perror("write");
+    close(go[1]);
+    char buf[65536];
+    for (;;) {
+        ssize_t n = read(out[0], buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        if (show) fwrite(buf, 1, (size_t)n, stdout);
+        size_t keep = (size_t)n < CAPTURE_MAX - got ? (size_t)n : CAPTURE_MAX - got;
+        memcpy(captured + got, buf, keep);
+        got += keep;
+    }
+    close(out[0]);
+    captured[got] = '\0';
+
+    int status = 0;
+    struct rusage ru;
+    while (wait4(pid, &status, 0, &ru) == -1 && errno == EINTR) {}
+    r->wall_ms = now_ms() - t0;
+
+    for (int k = 0; k < EV_COUNT; k++) {
+        r->ev[k] = perf_read(fds[k]);
+        if (fds[k] != -1) close(fds[k]);
+    }
+    // without perf the switches of the waited-for tree still come from wait4
+    if (isnan(r->ev[EV_CTX_SWITCHES])) r->ev[EV_CTX_SWITCHES] = (double)(ru.ru_nvcsw + ru.ru_nivcsw);
+    r->max_rss_kb = (double)ru.ru_maxrss;
+    r->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    for (int m = 0; m < nmetrics; m++) r->metric[m] = find_metric(captured, metrics[m].text);
+
+    for (int i = 0; argv[i]; i++) free(argv[i]);
+    free(in);
+    free(dir);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Median of the runs' values, NaNs left out
+static double median(const run_t *runs, size_t off) {
+    double v[repeat];
+    int n = 0;
+    for (int i = 0; i < repeat; i++) {
+        double x = *(const double *)((const char *)&runs[i] + off);
+        if (!isnan(x)) v[n++] = x;
+    }
+    if (n == 0) return NAN;
+    qsort(v, (size_t)n, sizeof(double), cmp_double);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static void summarize(point_t *pt) {
+    run_t *m = &pt->median;
+    m->wall_ms = median(pt->runs, offsetof(run_t, wall_ms));
+    for (int k = 0; k < EV_COUNT; k++) m->ev[k] = median(pt->runs, offsetof(run_t, ev) + sizeof(double) * (size_t)k);
+    m->max_rss_kb = median(pt->runs, offsetof(run_t, max_rss_kb));
+    for (int j = 0; j < nmetrics; j++) m->metric[j] = median(pt->runs, offsetof(run_t, metric) + sizeof(double) * (size_t)j);
+    m->status = 0;
+    for (int i = 0; i < repeat; i++)
+        if (pt->runs[i].status) m->status = pt->runs[i].status;
+
+    pt->work = NAN;
+    if (work_tmpl) {
+        char *w = expand(work_tmpl, pt->idx);
+        pt->work = strtod(w, NULL);
+        free(w);
+    } else if (stdin_tmpl && strcmp(unit, "bytes") == 0) {
+        // the IPC labs: throughput of the input
+        char *in = expand(stdin_tmpl, pt->idx);
+        struct stat st;
+        if (stat(in, &st) == 0 && S_ISREG(st.st_mode)) pt->work = (double)st.st_size;
+        free(in);
+    }
+}
+
+static double throughput(const point_t *pt, double wall_ms) {
+    double per_s = pt->work / (wall_ms * 1e-3);
+    return strcmp(unit, "bytes") == 0 ? per_s / 1e6 : per_s;
+}
+
+// Unit of the throughput column: bytes are reported in MB/s
+static const char *rate_unit(void) {
+    static char buf[64];
+    if (strcmp(unit, "bytes") == 0) return "MB/s";
+    snprintf(buf, sizeof(buf), "%s/s", unit);
+    return buf;
+}
+
+static void print_num(FILE *f, double v, const char *fmt, const char *none) {
+    if (isnan(v)) fputs(none, f);
+    else fprintf(f, fmt, v);
+}
+
+static void params_text(const int *idx, char *buf, size_t cap) {
+    size_t n = 0;
+    buf[0] = '\0';
+    for (int s = 0; s < nsweeps && n < cap; s++)
+        n += (size_t)snprintf(buf + n, cap - n, "%s%s=%s", s ? " " : "", sweeps[s].name, sweeps[s].values[idx[s]]);
+}
+
+static void print_table(const point_t *pts, int npts) {
+    printf("%-28s %10s %10s %12s %10s %12s %10s %10s", "params", "wall_ms", "min_ms",
+           rate_unit(), "cpu_ms", "cache_miss", "ctx_sw", "rss_kb");
+    for (int m = 0; m < nmetrics; m++) printf(" %12s", metrics[m].name);
+    printf("\n");
+    for (int p = 0; p < npts; p++) {
+        const point_t *pt = &pts[p];
+        char par[256];
+        params_text(pt->idx, par, sizeof(par));
+        double min = pt->runs[0].wall_ms;
+        for (int i = 1; i < repeat; i++)
+            if (pt->runs[i].wall_ms < min) min = pt->runs[i].wall_ms;
+        printf("%-28s %10.3f %10.3f ", par[0] ? par : "-", pt->median.wall_ms, min);
+        print_num(stdout, throughput(pt, pt->median.wall_ms), "%12.2f", "           -");
+        print_num(stdout, pt->median.ev[EV_TASK_CLOCK] / 1e6, " %10.3f", "          -");
+        print_num(stdout, pt->median.ev[EV_CACHE_MISSES], " %12.0f", "            -");
+        print_num(stdout, pt->median.ev[EV_CTX_SWITCHES], " %10.0f", "          -");
+        print_num(stdout, pt->median.max_rss_kb, " %10.0f", "          -");
+        for (int m = 0; m < nmetrics; m++) print_num(stdout, pt->median.metric[m], " %12.3f", "            -");
+        if (pt->median.status) printf("  (exit %d)", pt->median.status);
+        printf("\n");
+    }
+}
+
+static int sweep_index(const char *name) {
+    for (int s = 0; s < nsweeps; s++)
+        if (strcmp(sweeps[s].name, name) == 0) return s;
+    return -1;
+}
+
+// Speedup of a point against the point that differs only in the --speedup
+// sweep, at its first value; efficiency divides by the ratio of the values
+// when they are numbers (threads, jobs)
+static int baseline_of(const point_t *pts, int npts, int p, int sp) {
+    for (int q = 0; q < npts; q++) {
+        if (pts[q].idx[sp] != 0) continue;
+        int same = 1;
+        for (int s = 0; s < nsweeps; s++)
+            if (s != sp && pts[q].idx[s] != pts[p].idx[s]) same = 0;
+        if (same) return q;
+    }
+    return -1;
+}
+
+static void speedup_of(const point_t *pts, int npts, int p, int sp, double *speedup, double *eff) {
+    *speedup = *eff = NAN;
+    int b = baseline_of(pts, npts, p, sp);
+    if (b < 0) return;
+    *speedup = pts[b].median.wall_ms / pts[p].median.wall_ms;
+    char *e1, *e2;
+    double v = strtod(sweeps[sp].values[pts[p].idx[sp]], &e1);
+    double v0 = strtod(sweeps[sp].values[0], &e2);
+    if (*e1 == '\0' && *e2 == '\0' && v0 > 0 && v > 0) *eff = *speedup / (v / v0);
+}
+
+static void print_speedup(const point_t *pts, int npts, int sp) {
+    printf("\nspeedup over %s (baseline %s=%s)\n", sweeps[sp].name, sweeps[sp].name, sweeps[sp].values[0]);
+    printf("%-28s %10s %10s %10s\n", "params", "wall_ms", "speedup", "efficiency");
+    for (int p = 0; p < npts; p++) {
+        char par[256];
+        params_text(pts[p].idx, par, sizeof(par));
+        double s, e;
+        speedup_of(pts, npts, p, sp, &s, &e);
+        printf("%-28s %10.3f ", par, pts[p].median.wall_ms);
+        print_num(stdout, s, "%10.3f", "         -");
+        print_num(stdout, e, " %10.3f", "          -");
+        printf("\n");
+    }
+}
+
+static void csv_field(FILE *f, const char *s) {
+    if (!strpbrk(s, ",\"\n")) {
+        fputs(s, f);
+        return;
+    }
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"') fputc('"', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+// One row per measured run, appended; the header goes into an empty file
+// only, as in lab4's driver --csv
+static void write_csv(const point_t *pts, int npts) {
+    FILE *f = fopen(csv_path, "a");
+    if (!f) {
+        perror(csv_path);
+        return;
+    }
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) <= 0) {
+        fprintf(f, "label,params,rep,wall_ms,work,throughput,unit,max_rss_kb,status");
+        for (int k = 0; k < EV_COUNT; k++) fprintf(f, ",%s", events[k].name);
+        fprintf(f, ",metrics\n");
+    }
+    for (int p = 0; p < npts; p++) {
+        char par[256];
+        params_text(pts[p].idx, par, sizeof(par));
+        for (int i = 0; i < repeat; i++) {
+            const run_t *r = &pts[p].runs[i];
+            csv_field(f, label);
+            fputc(',', f);
+            csv_field(f, par);
+            fprintf(f, ",%d,%.3f,", i, r->wall_ms);
+            print_num(f, pts[p].work, "%.0f", "");
+            fputc(',', f);
+            print_num(f, throughput(&pts[p], r->wall_ms), "%.3f", "");
+            fprintf(f, ",%s,%.0f,%d", rate_unit(), r->max_rss_kb, r->status);
+            for (int k = 0; k < EV_COUNT; k++) {
+                fputc(',', f);
+                print_num(f, r->ev[k], "%.0f", "");
+            }
+            fputc(',', f);
+            for (int m = 0; m < nmetrics; m++) {
+                fprintf(f, "%s%s=", m ? " " : "", metrics[m].name);
+                print_num(f, r->metric[m], "%g", "");
+            }
+            fputc('\n', f);
+        }
+    }
+    fclose(f);
+}
+
+static void json_str(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void json_num(FILE *f, double v) {
+    if (isnan(v)) fputs("null", f);
+    else fprintf(f, "%.10g", v);
+}
+
+static void json_run(FILE *f, const run_t *r) {
+    fprintf(f, "{\"wall_ms\": ");
+    json_num(f, r->wall_ms);
+    for (int k = 0; k < EV_COUNT; k++) {
+        fprintf(f, ", \"%s\": ", events[k].name);
+        json_num(f, r->ev[k]);
+    }
+    fprintf(f, ", \"max_rss_kb\": ");
+    json_num(f, r->max_rss_kb);
+    fprintf(f, ", \"status\": %d", r->status);
+    for (int m = 0; m < nmetrics; m++) {
+        fprintf(f, ", ");
+        json_str(f, metrics[m].name);
+        fprintf(f, ": ");
+        json_num(f, r->metric[m]);
+    }
+    fputc('}', f);
+}
+
+static void write_json(const point_t *pts, int npts) {
+    FILE *f = fopen(json_path, "w");
+    if (!f) {
+        perror(json_path);
+        return;
+    }
+    fprintf(f, "{\n  \"label\": ");
+    json_str(f, label);
+    fprintf(f, ",\n  \"command\": [");
+    for (int i = 0; i < ncmd; i++) {
+        if (i) fprintf(f, ", ");
+        json_str(f, cmd[i]);
+    }
+    fprintf(f, "],\n  \"warmup\": %d,\n  \"repeat\": %d,\n  \"unit\": ", warmup, repeat);
+    json_str(f, rate_unit());
+    fprintf(f, ",\n  \"points\": [\n");
+    int sp = speedup_by ? sweep_index(speedup_by) : -1;
+    for (int p = 0; p < npts; p++) {
+        const point_t *pt = &pts[p];
+        fprintf(f, "    {\"params\": {");
+        for (int s = 0; s < nsweeps; s++) {
+            if (s) fprintf(f, ", ");
+            json_str(f, sweeps[s].name);
+            fprintf(f, ": ");
+            json_str(f, sweeps[s].values[pt->idx[s]]);
+        }
+        fprintf(f, "},\n     \"work\": ");
+        json_num(f, pt->work);
+        fprintf(f, ", \"throughput\": ");
+        json_num(f, throughput(pt, pt->median.wall_ms));
+        if (sp >= 0) {
+            double s, e;
+            speedup_of(pts, npts, p, sp, &s, &e);
+            fprintf(f, ", \"speedup\": ");
+            json_num(f, s);
+            fprintf(f, ", \"efficiency\": ");
+            json_num(f, e);
+        }
+        fprintf(f, ",\n     \"median\": ");
+        json_run(f, &pt->median);
+        fprintf(f, ",\n     \"runs\": [");
+        for (int i = 0; i < repeat; i++) {
+            fprintf(f, i ? ",\n              " : "");
+            json_run(f, &pt->runs[i]);
+        }
+        fprintf(f, "]}%s\n", p + 1 < npts ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] -- command [args...]\n"
+            "  --sweep NAME=V1,V2,..  values of {NAME} in the command, --stdin, --cwd and --work;\n"
+            "                         several sweeps run as a cartesian product\n"
+            "  --warmup N             unmeasured runs per point (default 1)\n"
+            "  --repeat N             measured runs per point, medians are reported (default 5)\n"
+            "  --stdin FILE           stdin of the runs (default /dev/null)\n"
+            "  --cwd DIR              directory to run in\n"
+            "  --work N               units of work per run for the throughput; default for\n"
+            "                         --unit bytes: the size of --stdin\n"
+            "  --unit NAME            unit of --work (default bytes, reported as MB/s)\n"
+            "  --metric NAME=TEXT     the number after TEXT in the program's stdout\n"
+            "  --speedup NAME         speedup and efficiency over the sweep NAME, its first value\n"
+            "                         is the baseline\n"
+            "  --csv FILE             append one row per run\n"
+            "  --json FILE            write all points and runs\n"
+            "  --label TEXT           name of the series (default: the command)\n"
+            "  --show                 pass the program's stdout through\n",
+            prog);
+}
+
+static char *split_pair(char *arg) {
+    char *eq = strchr(arg, '=');
+    if (!eq || eq == arg) return NULL;
+    *eq = '\0';
+    return eq + 1;
+}
+
+int main(int argc, char **argv) {
+    int i = 1;
+    for (; i < argc; i++) {
+        const char *a = argv[i];
+        int more = i + 1 < argc;
+        if (strcmp(a, "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(a, "--sweep") == 0 && more && nsweeps < MAX_SWEEPS) {
+            sweep_t *s = &sweeps[nsweeps];
+            char *vals = split_pair(argv[++i]);
+            if (!vals) break;
+            s->name = argv[i];
+            // strsep keeps empty values: "mode=,--ring"
+            for (char *v; (v = strsep(&vals, ",")) && s->count < MAX_VALUES;) s->values[s->count++] = v;
+            nsweeps++;
+        } else if (strcmp(a, "--metric") == 0 && more && nmetrics < MAX_METRICS) {
+            char *text = split_pair(argv[++i]);
+            if (!text) break;
+            metrics[nmetrics++] = (metric_t){argv[i], text};
+        } else if (strcmp(a, "--warmup") == 0 && more) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(a, "--repeat") == 0 && more) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(a, "--stdin") == 0 && more) {
+            stdin_tmpl = argv[++i];
+        } else if (strcmp(a, "--cwd") == 0 && more) {
+            cwd_tmpl = argv[++i];
+        } else if (strcmp(a, "--work") == 0 && more) {
+            work_tmpl = argv[++i];
+        } else if (strcmp(a, "--unit") == 0 && more) {
+            unit = argv[++i];
+        } else if (strcmp(a, "--speedup") == 0 && more) {
+            speedup_by = argv[++i];
+        } else if (strcmp(a, "--csv") == 0 && more) {
+            csv_path = argv[++i];
+        } else if (strcmp(a, "--json") == 0 && more) {
+            json_path = argv[++i];
+        } else if (strcmp(a, "--label") == 0 && more) {
+            label = argv[++i];
+        } else if (strcmp(a, "--show") == 0) {
+            show = 1;
+        } else if (strcmp(a, "--help") == 0 || strcmp(a, "-h") == 0) {
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else {
+            break;
+        }
+    }
+    if (i >= argc || strcmp(argv[i - 1], "--") != 0 || warmup < 0 || repeat < 1 ||
+        (speedup_by && sweep_index(speedup_by) < 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    cmd = argv + i;
+    ncmd = argc - i;
+    if (!label) label = cmd[0];
+
+    int npts = 1;
+    for (int s = 0; s < nsweeps; s++) npts *= sweeps[s].count;
+    point_t *pts = xmalloc(sizeof(point_t) * (size_t)npts);
+    int idx[MAX_SWEEPS] = {0};
+    for (int p = 0; p < npts; p++) {
+        point_t *pt = &pts[p];
+        memcpy(pt->idx, idx, sizeof(idx));
+        pt->runs = xmalloc(sizeof(run_t) * (size_t)repeat);
+        run_t scratch;
+        for (int w = 0; w < warmup; w++) run_once(idx, &scratch);
+        for (int r = 0; r < repeat; r++) run_once(idx, &pt->runs[r]);
+        summarize(pt);
+        // odometer: the last sweep changes fastest
+        for (int s = nsweeps - 1; s >= 0; s--) {
+            if (++idx[s] < sweeps[s].count) break;
+            idx[s] = 0;
+        }
+    }
+
+    print_table(pts, npts);
+    if (speedup_by) print_speedup(pts, npts, sweep_index(speedup_by));
+    if (csv_path) write_csv(pts, npts);
+    if (json_path) write_json(pts, npts);
+
+    int failed = 0;
+    for (int p = 0; p < npts; p++) failed |= pts[p].median.status != 0;
+    if (failed) fprintf(stderr, "warning: some runs exited with an error\n");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
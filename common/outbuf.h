@@ -0,0 +1,174 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+// Output file of the sum clients (lab1, lab3): sums are gathered in a user
+// buffer and written when it fills, at the end, or once the oldest unwritten
+// sum is OUTBUF_LATENCY_MS old, so a write() covers many lines. The client
+// asks ob_ms_left() before it waits for input and waits no longer than that,
+// flushing on the timeout: interactive input still sees its sums promptly.
+//
+// SUM_OUT=mmap in the environment writes the file through a shared mapping
+// instead (grown by ftruncate OUTBUF_MMAP_STEP at a time, trimmed to size at
+// the end): no write() at all, and the sums are in the page cache, visible
+// to readers of the file, as soon as they are stored; until ob_close() the
+// file ends in zeros up to the window end. SUM_FLUSH_MS overrides
+// the latency bound. Both are read from the environment so that they reach
+// clients started by the servers without new arguments.
+
+#ifndef OUTBUF_SIZE
+#define OUTBUF_SIZE (64 * 1024)
+#endif
+#ifndef OUTBUF_LATENCY_MS
+#define OUTBUF_LATENCY_MS 20
+#endif
+#ifndef OUTBUF_MMAP_STEP
+#define OUTBUF_MMAP_STEP (16u << 20)
+#endif
+// Longest single ob_space() request
+#define OUTBUF_MAX_ITEM 64
+
+typedef struct {
+    int fd;
+    int mapped;          // SUM_OUT=mmap
+    int latency_ms;
+    char *buf;           // write mode: the buffer; mmap mode: the window
+    size_t len;          // bytes used in buf
+    size_t cap;
+    int64_t pending_ns;  // write mode: when buf became non-empty, 0 if empty
+    off_t win_off;       // mmap mode: file offset of the window
+} outbuf_t;
+
+static inline int64_t ob_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline int ob_write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += (size_t)w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+// Maps the window that holds file offset pos; mmap offsets are page aligned,
+// so the window may start a little before pos
+static inline int ob_map_window(outbuf_t *ob, off_t pos) {
+    off_t off = pos & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+    if (ftruncate(ob->fd, off + (off_t)OUTBUF_MMAP_STEP) == -1) return -1;
+    void *p = mmap(NULL, OUTBUF_MMAP_STEP, PROT_READ | PROT_WRITE, MAP_SHARED, ob->fd, off);
+    if (p == MAP_FAILED) return -1;
+    ob->buf = p;
+    ob->cap = OUTBUF_MMAP_STEP;
+    ob->len = (size_t)(pos - off);
+    ob->win_off = off;
+    return 0;
+}
+
+static inline void ob_env(outbuf_t *ob) {
+    memset(ob, 0, sizeof(*ob));
+    const char *env = getenv("SUM_FLUSH_MS");
+    ob->latency_ms = env ? atoi(env) : OUTBUF_LATENCY_MS;
+    if (ob->latency_ms < 0) ob->latency_ms = 0;
+    env = getenv("SUM_OUT");
+    ob->mapped = env && strcmp(env, "mmap") == 0;
+}
+
+static inline int ob_setup(outbuf_t *ob, int fd) {
+    ob->fd = fd;
+    if (ob->mapped) {
+        if (ob_map_window(ob, 0) == 0) return 0;
+    } else {
+        ob->buf = malloc(OUTBUF_SIZE);
+        ob->cap = OUTBUF_SIZE;
+        if (ob->buf) return 0;
+    }
+    close(ob->fd);
+    return -1;
+}
+
+// Creates or truncates the output file (0600) in the mode from the
+// environment; -1 with errno set on failure
+static inline int ob_open(outbuf_t *ob, const char *path) {
+    ob_env(ob);
+    // a shared writable mapping needs the file open for reading as well
+    int fd = open(path, (ob->mapped ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) return -1;
+    return ob_setup(ob, fd);
+}
+
+// Same over a file someone else opened (empty, O_RDWR so that both modes
+// work); takes fd over, it is closed on failure as well
+static inline int ob_attach(outbuf_t *ob, int fd) {
+    ob_env(ob);
+    return ob_setup(ob, fd);
+}
+
+static inline int ob_flush(outbuf_t *ob) {
+    if (ob->mapped || ob->len == 0) return 0;
+    int rc = ob_write_all(ob->fd, ob->buf, ob->len);
+    ob->len = 0;
+    ob->pending_ns = 0;
+    return rc;
+}
+
+// Room for n <= OUTBUF_MAX_ITEM bytes; hand the end back to ob_commit().
+// NULL on a write or mapping error, or with EINVAL for a larger n.
+static inline char *ob_space(outbuf_t *ob, size_t n) {
+    if (n > OUTBUF_MAX_ITEM) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (ob->cap - ob->len < n) {
+        if (ob->mapped) {
+            munmap(ob->buf, ob->cap);
+            if (ob_map_window(ob, ob->win_off + (off_t)ob->len) == -1) return NULL;
+        } else if (ob_flush(ob) == -1) {
+            return NULL;
+        }
+    }
+    if (ob->len == 0 && !ob->mapped) ob->pending_ns = ob_now_ns();
+    return ob->buf + ob->len;
+}
+
+static inline void ob_commit(outbuf_t *ob, const char *end) {
+    ob->len = (size_t)(end - ob->buf);
+}
+
+// How long the client may wait for input before the buffered sums are due:
+// -1 when nothing is buffered (wait as long as needed), else 0..latency
+static inline int ob_ms_left(const outbuf_t *ob) {
+    if (ob->mapped || ob->len == 0) return -1;
+    int64_t age_ms = (ob_now_ns() - ob->pending_ns) / 1000000;
+    return age_ms >= ob->latency_ms ? 0 : (int)(ob->latency_ms - age_ms);
+}
+
+// Writes out the rest (in mmap mode trims the file to what was written) and
+// closes the file
+static inline int ob_close(outbuf_t *ob) {
+    int rc = 0;
+    if (ob->mapped) {
+        munmap(ob->buf, ob->cap);
+        rc = ftruncate(ob->fd, ob->win_off + (off_t)ob->len);
+    } else {
+        rc = ob_flush(ob);
+        free(ob->buf);
+    }
+    ob->buf = NULL;
+    if (close(ob->fd) == -1) rc = -1;
+    return rc;
+}
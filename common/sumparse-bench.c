@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include <getopt.h>
+#include "sumparse.h"
+
+// Microbenchmark of sumparse.h against the isspace + strtol loop of the old
+// clients: both sum every line of a generated corpus, the line sums are
+// compared, the best of --repeat runs is reported in GB/s.
+
+typedef struct {
+    unsigned long long total; // wrapped sum of the line sums
+    unsigned long long hash;  // order-sensitive mix of the line sums
+    long lines;
+    long clamped;
+} result_t;
+
+static void mix(result_t *r, long long sum) {
+    r->total += (unsigned long long)sum;
+    r->hash = (r->hash ^ (unsigned long long)sum) * 0x100000001b3ull;
+    r->lines++;
+}
+
+static long long strtol_line_sum(const char *p, const char *end, long *clamped) {
+    long long sum = 0;
+    while (p < end) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p >= end) break;
+        errno = 0;
+        char *q = NULL;
+        long val = strtol(p, &q, 10);
+        if (q == p) {
+            p++;
+            continue;
+        }
+        if (errno == ERANGE) (*clamped)++;
+        sum = (long long)((unsigned long long)sum + (unsigned long long)val);
+        p = q;
+    }
+    return sum;
+}
+
+static void run_strtol(const char *buf, size_t len, result_t *r) {
+    const char *end = buf + len;
+    for (const char *p = buf; p < end;) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        if (!nl) nl = end;
+        mix(r, strtol_line_sum(p, nl, &r->clamped));
+        p = nl + 1;
+    }
+}
+
+static void run_sumparse(const char *buf, size_t len, result_t *r) {
+    const char *end = buf + len;
+    for (const char *p = buf; p < end;) {
+        const char *nl = sp_find_newline(p, end);
+        int clamped = 0;
+        mix(r, sp_line_sum(p, nl, &clamped));
+        r->clamped += clamped;
+        p = nl + 1;
+    }
+}
+
+static unsigned long long rng_state = 88172645463325252ull;
+
+static unsigned long long rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// Lines of 1..max_nums integers of up to `digits` digits. With --noise some
+// tokens are out of range, signed with '+' or glued to garbage.
+static char *make_corpus(size_t size, int max_nums, int digits, int noise, size_t *len) {
+    char *buf = malloc(size + 256);
+    if (!buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t n = 0;
+    while (n < size) {
+        int nums = 1 + (int)(rng() % (unsigned)max_nums);
+        for (int i = 0; i < nums && n < size; i++) {
+            if (i) buf[n++] = (rng() % 8 == 0) ? '\t' : ' ';
+            int kind = noise ? (int)(rng() % 16) : 15;
+            if (kind == 0) {
+                n += (size_t)sprintf(buf + n, "%s99999999999999999999", rng() % 2 ? "-" : "");
+                continue;
+            }
+            if (kind == 1) buf[n++] = 'x';
+            if (rng() % 2) buf[n++] = kind == 2 ? '+' : '-';
+            int d = 1 + (int)(rng() % (unsigned)digits);
+            for (int k = 0; k < d; k++) buf[n++] = (char)('0' + rng() % 10);
+            if (kind == 3) buf[n++] = '?';
+        }
+        buf[n++] = '\n';
+    }
+    *len = n;
+    return buf;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static double bench(void (*fn)(const char *, size_t, result_t *), const char *buf, size_t len,
+                    int repeat, result_t *r) {
+    double best = 1e30;
+    for (int i = 0; i < repeat; i++) {
+        memset(r, 0, sizeof(*r));
+        double t0 = now_sec();
+        fn(buf, len, r);
+        double t = now_sec() - t0;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --size MB      corpus size (default 64)\n"
+            "  --nums N       up to N integers per line (default 12)\n"
+            "  --digits D     up to D digits per integer (default 7)\n"
+            "  --noise        add out-of-range, signed and invalid tokens\n"
+            "  --repeat N     runs per parser, the best one counts (default 5)\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    size_t size_mb = 64;
+    int max_nums = 12, digits = 7, noise = 0, repeat = 5;
+    static const struct option opts[] = {
+        {"size", required_argument, 0, 's'},
+        {"nums", required_argument, 0, 'n'},
+        {"digits", required_argument, 0, 'd'},
+        {"noise", no_argument, 0, 'z'},
+        {"repeat", required_argument, 0, 'r'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "s:n:d:zr:h", opts, NULL)) != -1) {
+        switch (c) {
+        case 's': size_mb = strtoul(optarg, NULL, 10); break;
+        case 'n': max_nums = atoi(optarg); break;
+        case 'd': digits = atoi(optarg); break;
+        case 'z': noise = 1; break;
+        case 'r': repeat = atoi(optarg); break;
+        case 'h': usage(argv[0]); return EXIT_SUCCESS;
+        default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (size_mb == 0 || max_nums < 1 || digits < 1 || digits > 40 || repeat < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t len;
+    char *buf = make_corpus(size_mb << 20, max_nums, digits, noise, &len);
+    printf("Corpus: %.1f MB, up to %d numbers of up to %d digits per line%s\n",
+           (double)len / (1 << 20), max_nums, digits, noise ? ", noisy" : "");
+
+    result_t ref, got;
+    double t_ref = bench(run_strtol, buf, len, repeat, &ref);
+    double t_sp = bench(run_sumparse, buf, len, repeat, &got);
+    printf("Lines: %ld, clamped: %ld\n", ref.lines, ref.clamped);
+    printf("strtol:         %.3f GB/s\n", (double)len / t_ref * 1e-9);
+    printf("sumparse %-6s %.3f GB/s (x%.2f)\n", SP_ISA ":", (double)len / t_sp * 1e-9, t_ref / t_sp);
+
+    int ok = ref.total == got.total && ref.hash == got.hash && ref.lines == got.lines &&
+             ref.clamped == got.clamped;
+    if (!ok) fprintf(stderr, "error: sumparse results differ from strtol\n");
+    free(buf);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Integer line parser shared by the sum clients (lab1, lab3). The rules are
+// those of the isspace + strtol loop it replaces, in the C locale: tokens
+// are split by ' ', \t, \v, \f, \r; a token is [+-]digits; any other byte
+// is skipped on its own; values outside long are clamped to LONG_MIN /
+// LONG_MAX and counted. Newlines, spaces and digit runs are found 32 (AVX2)
+// or 16 (SSE2) bytes at a time, digits are converted 8 at a time (SWAR), and
+// values of up to 19 digits need a single overflow check.
+
+#if defined(__AVX2__)
+#define SP_VEC 32
+#define SP_FULL 0xFFFFFFFFu
+#define SP_ISA "avx2"
+typedef __m256i sp_vec_t;
+#define sp_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define sp_movemask(m) ((uint32_t)_mm256_movemask_epi8(m))
+#define sp_set1 _mm256_set1_epi8
+#define sp_cmpeq _mm256_cmpeq_epi8
+#define sp_sub _mm256_sub_epi8
+#define sp_min _mm256_min_epu8
+#elif defined(__SSE2__)
+#define SP_VEC 16
+#define SP_FULL 0xFFFFu
+#define SP_ISA "sse2"
+typedef __m128i sp_vec_t;
+#define sp_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define sp_movemask(m) ((uint32_t)_mm_movemask_epi8(m))
+#define sp_set1 _mm_set1_epi8
+#define sp_cmpeq _mm_cmpeq_epi8
+#define sp_sub _mm_sub_epi8
+#define sp_min _mm_min_epu8
+#else
+#define SP_VEC 0
+#define SP_ISA "scalar"
+#endif
+
+static inline int sp_is_space(unsigned char c) { return c == ' ' || (unsigned)(c - '\t') <= '\r' - '\t'; }
+static inline int sp_is_digit(unsigned char c) { return (unsigned)(c - '0') <= 9; }
+
+#if SP_VEC
+// Bit i is set when p[i] is the byte c / a digit / a space (\n included)
+static inline uint32_t sp_mask_eq(const char *p, char c) {
+    return sp_movemask(sp_cmpeq(sp_load(p), sp_set1(c)));
+}
+
+// x <= k unsigned per byte, as min(x, k) == x
+static inline uint32_t sp_mask_le(sp_vec_t x, char k) {
+    return sp_movemask(sp_cmpeq(sp_min(x, sp_set1(k)), x));
+}
+
+static inline uint32_t sp_mask_digit(const char *p) {
+    return sp_mask_le(sp_sub(sp_load(p), sp_set1('0')), 9);
+}
+
+static inline uint32_t sp_mask_space(const char *p) {
+    sp_vec_t v = sp_load(p);
+    return sp_mask_le(sp_sub(v, sp_set1('\t')), '\r' - '\t') | sp_movemask(sp_cmpeq(v, sp_set1(' ')));
+}
+#endif
+
+// First '\n' in [p, end), or end
+static inline const char *sp_find_newline(const char *p, const char *end) {
+#if SP_VEC
+    for (; end - p >= SP_VEC; p += SP_VEC) {
+        uint32_t m = sp_mask_eq(p, '\n');
+        if (m) return p + __builtin_ctz(m);
+    }
+#endif
+    for (; p < end; p++)
+        if (*p == '\n') return p;
+    return end;
+}
+
+static inline const char *sp_skip_spaces(const char *p, const char *end) {
+#if SP_VEC
+    for (; end - p >= SP_VEC; p += SP_VEC) {
+        uint32_t m = ~sp_mask_space(p) & SP_FULL;
+        if (m) return p + __builtin_ctz(m);
+    }
+#endif
+    while (p < end && sp_is_space((unsigned char)*p)) p++;
+    return p;
+}
+
+// Length of the digit run starting at p
+static inline size_t sp_digit_run(const char *p, const char *end) {
+    const char *s = p;
+#if SP_VEC
+    for (; end - p >= SP_VEC; p += SP_VEC) {
+        uint32_t m = ~sp_mask_digit(p) & SP_FULL;
+        if (m) return (size_t)(p - s) + __builtin_ctz(m);
+    }
+#endif
+    while (p < end && sp_is_digit((unsigned char)*p)) p++;
+    return (size_t)(p - s);
+}
+
+// Eight ASCII digits, most significant first, to their value
+static inline uint32_t sp_swar8(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    v -= 0x3030303030303030ull;
+    v = (v * 10 + (v >> 8)) & 0x00FF00FF00FF00FFull;
+    v = (v * 100 + (v >> 16)) & 0x0000FFFF0000FFFFull;
+    v = (v * 10000 + (v >> 32)) & 0xFFFFFFFFull;
+    return (uint32_t)v;
+}
+
+// Value of the n digits at p with sign neg, clamped like strtol
+static inline long sp_digits_value(const char *p, size_t n, int neg, int *clamped) {
+    while (n > 19 && *p == '0') p++, n--;
+    if (n <= 19) {
+        // below 10^19, so the accumulator cannot wrap
+        uint64_t v = 0;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) v = v * 100000000u + sp_swar8(p + i);
+        for (; i < n; i++) v = v * 10 + (unsigned)(p[i] - '0');
+        if (!neg && v <= (uint64_t)LONG_MAX) return (long)v;
+        if (neg && v <= (uint64_t)LONG_MAX) return -(long)v;
+        if (neg && v == (uint64_t)LONG_MAX + 1) return LONG_MIN;
+    }
+    (*clamped)++;
+    return neg ? LONG_MIN : LONG_MAX;
+}
+
+// Sum of the integers in the line [p, end), which holds no '\n'. The sum
+// wraps like the long long addition of the old loop did in practice.
+static inline long long sp_line_sum(const char *p, const char *end, int *clamped) {
+    unsigned long long sum = 0;
+    while (p < end) {
+        unsigned char c = (unsigned char)*p;
+        if (sp_is_space(c)) {
+            // mostly a single separator, the vector skip is for the rest
+            if (++p < end && sp_is_space((unsigned char)*p)) p = sp_skip_spaces(p, end);
+            continue;
+        }
+        const char *d = p + (c == '-' || c == '+');
+        if (d < end && sp_is_digit((unsigned char)*d)) {
+            size_t n = sp_digit_run(d, end);
+            sum += (unsigned long long)sp_digits_value(d, n, c == '-', clamped);
+            p = d + n;
+        } else {
+            p++;
+        }
+    }
+    return (long long)sum;
+}
@@ -0,0 +1,393 @@
+#pragma once
+
+// Compile-time optional tracing of the hot paths: barrier waits of lab2,
+// semaphore and ring waits of lab3, free-list walks of lab4. Build with
+// -DLAB_TRACE (make TRACE=-DLAB_TRACE); without it every macro below expands
+// to nothing and the header includes nothing.
+//
+//   TRACE_BEGIN(t0);                  uint64_t t0 = clock ticks
+//   TRACE_END("barrier_wait", t0);    a span from t0 until now
+//   TRACE_VALUE("fl_walk_depth", d);  a sample: spins, list depth, bytes
+//   TRACE_DUMP();                     the dump now, before an _exit()
+//
+// A probe is a static at the call site, numbered on first use. Every thread
+// has its own block of counters (count, sum, max and a log2 histogram per
+// probe) and a buffer of the first TRACE_EVENTS events; only the owner
+// writes them, so recording is a few relaxed stores, no locks and no
+// atomic read-modify-write. Blocks are pushed on a lock-free list and never
+// freed, so the counters of finished threads are still there at the end.
+//
+// The dump goes out at exit and on SIGUSR2 (if the program leaves that
+// signal alone): a table on stderr, and with LAB_TRACE_FILE=prefix a Chrome
+// trace prefix.<pid>.json (spans as "X" events, samples as "C" counters)
+// that chrome://tracing and ui.perfetto.dev open. Everything in the dump is
+// formatted by hand and written with write(), so it is safe in the handler.
+// Span durations are clock ticks (TSC on x86, the virtual counter on arm64,
+// ns elsewhere); the trace converts them to time.
+
+#ifdef LAB_TRACE
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define TRACE_MAX_PROBES 32
+#define TRACE_BUCKETS 65  // bucket k: values in [2^(k-1), 2^k), bucket 0: zero
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS (1 << 15)
+#endif
+
+typedef struct {
+    const char *name;
+    atomic_int id;        // 0 until first use, then index + 1
+    int span;
+} trace_probe_t;
+
+typedef struct {
+    atomic_uint_least64_t count, sum, max;
+    atomic_uint_least64_t hist[TRACE_BUCKETS];
+} trace_stat_t;
+
+typedef struct {
+    uint64_t ts;          // ticks
+    uint64_t value;       // span: duration in ticks, sample: the value
+    uint32_t probe;
+} trace_event_t;
+
+typedef struct trace_thread {
+    struct trace_thread *next;
+    long tid;
+    atomic_uint nevents;
+    atomic_uint_least64_t dropped;
+    trace_stat_t stat[TRACE_MAX_PROBES];
+    trace_event_t events[TRACE_EVENTS];
+} trace_thread_t;
+
+static trace_probe_t *_Atomic trace_probes[TRACE_MAX_PROBES];
+static atomic_int trace_nprobes;
+static trace_thread_t *_Atomic trace_threads;
+static atomic_int trace_started;
+static uint64_t trace_tick0, trace_ns0;
+static char trace_file[256];
+static _Thread_local trace_thread_t *trace_me;
+
+static inline uint64_t trace_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t trace_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return trace_ns();
+#endif
+}
+
+// Owner-only update: a plain load and store, atomic only so the dump may
+// read the counters of running threads
+static inline void trace_add(atomic_uint_least64_t *c, uint64_t v) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+// ---- dump: a write() buffer with its own number formatting ----
+
+typedef struct {
+    int fd;
+    size_t len;
+    char buf[4096];
+} trace_out_t;
+
+static void trace_flush(trace_out_t *o) {
+    size_t off = 0;
+    while (off < o->len) {
+        ssize_t n = write(o->fd, o->buf + off, o->len - off);
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    o->len = 0;
+}
+
+static void trace_puts(trace_out_t *o, const char *s) {
+    for (; *s; s++) {
+        if (o->len == sizeof(o->buf)) trace_flush(o);
+        o->buf[o->len++] = *s;
+    }
+}
+
+// v in decimal into dst (room for 21 bytes), NUL-terminated
+static char *trace_utoa(uint64_t v, char *dst) {
+    char tmp[20];
+    int i = 0;
+    do { tmp[i++] = (char)('0' + v % 10); v /= 10; } while (v);
+    char *p = dst;
+    while (i--) *p++ = tmp[i];
+    *p = '\0';
+    return dst;
+}
+
+static void trace_putu(trace_out_t *o, uint64_t v) {
+    char s[21];
+    trace_puts(o, trace_utoa(v, s));
+}
+
+// Right-aligned in width columns
+static void trace_putu_w(trace_out_t *o, uint64_t v, int width) {
+    int digits = 1;
+    for (uint64_t x = v; x >= 10; x /= 10) digits++;
+    while (width-- > digits) trace_puts(o, " ");
+    trace_putu(o, v);
+}
+
+static void trace_puts_w(trace_out_t *o, const char *s, int width) {
+    trace_puts(o, s);
+    for (int n = (int)strlen(s); n < width; n++) trace_puts(o, " ");
+}
+
+// ns as microseconds with three decimals, the unit of Chrome trace times
+static void trace_put_us(trace_out_t *o, uint64_t ns) {
+    trace_putu(o, ns / 1000);
+    char frac[5] = {'.', (char)('0' + ns / 100 % 10), (char)('0' + ns / 10 % 10), (char)('0' + ns % 10), '\0'};
+    trace_puts(o, frac);
+}
+
+// Upper bound of the histogram bucket holding the q-quantile, at most max
+static uint64_t trace_quantile(const trace_stat_t *s, uint64_t count, double q) {
+    uint64_t want = (uint64_t)((double)count * q), seen = 0;
+    uint64_t max = atomic_load_explicit(&s->max, memory_order_relaxed);
+    for (int k = 0; k < TRACE_BUCKETS; k++) {
+        seen += atomic_load_explicit(&s->hist[k], memory_order_relaxed);
+        if (seen > want) {
+            if (k == 0) return 0;
+            if (k == TRACE_BUCKETS - 1) return max; // [2^63, 2^64): no 1 << 64
+            return (1ull << k) - 1 < max ? (1ull << k) - 1 : max;
+        }
+    }
+    return max;
+}
+
+static void trace_stat_line(trace_out_t *o, const char *who, const trace_probe_t *p, const trace_stat_t *s) {
+    uint64_t n = atomic_load_explicit(&s->count, memory_order_relaxed);
+    uint64_t sum = atomic_load_explicit(&s->sum, memory_order_relaxed);
+    trace_puts_w(o, p->name, 20);
+    trace_puts_w(o, p->span ? "ticks" : "value", 6);
+    trace_puts_w(o, who, 8);
+    trace_putu_w(o, n, 10);
+    trace_putu_w(o, sum, 16);
+    trace_putu_w(o, n ? sum / n : 0, 12);
+    trace_putu_w(o, trace_quantile(s, n, 0.5), 12);
+    trace_putu_w(o, trace_quantile(s, n, 0.99), 12);
+    trace_putu_w(o, atomic_load_explicit(&s->max, memory_order_relaxed), 14);
+    trace_puts(o, "\n");
+}
+
+static void trace_summary(void) {
+    trace_out_t o = { .fd = STDERR_FILENO };
+    int np = atomic_load(&trace_nprobes);
+    trace_puts(&o, "trace: pid ");
+    trace_putu(&o, (uint64_t)getpid());
+    trace_puts(&o, "\nprobe               unit  thread       count              sum        mean"
+                   "         p50         p99           max\n");
+    for (int i = 0; i < np && i < TRACE_MAX_PROBES; i++) {
+        const trace_probe_t *p = atomic_load(&trace_probes[i]);
+        if (!p) continue;
+        trace_stat_t all;
+        memset(&all, 0, sizeof(all));
+        int threads = 0;
+        for (trace_thread_t *t = atomic_load(&trace_threads); t; t = t->next) {
+            const trace_stat_t *s = &t->stat[i];
+            uint64_t n = atomic_load_explicit(&s->count, memory_order_relaxed);
+            if (!n) continue;
+            char who[22] = "t";
+            trace_utoa((uint64_t)t->tid, who + 1);
+            trace_stat_line(&o, who, p, s);
+            trace_add(&all.count, n);
+            trace_add(&all.sum, atomic_load_explicit(&s->sum, memory_order_relaxed));
+            uint64_t m = atomic_load_explicit(&s->max, memory_order_relaxed);
+            if (m > atomic_load_explicit(&all.max, memory_order_relaxed))
+                atomic_store_explicit(&all.max, m, memory_order_relaxed);
+            for (int k = 0; k < TRACE_BUCKETS; k++)
+                trace_add(&all.hist[k], atomic_load_explicit(&s->hist[k], memory_order_relaxed));
+            threads++;
+        }
+        if (threads > 1) trace_stat_line(&o, "all", p, &all);
+    }
+    for (trace_thread_t *t = atomic_load(&trace_threads); t; t = t->next) {
+        uint64_t d = atomic_load_explicit(&t->dropped, memory_order_relaxed);
+        if (!d) continue;
+        trace_puts(&o, "trace: thread ");
+        trace_putu(&o, (uint64_t)t->tid);
+        trace_puts(&o, " dropped ");
+        trace_putu(&o, d);
+        trace_puts(&o, " events past TRACE_EVENTS\n");
+    }
+    trace_flush(&o);
+}
+
+static void trace_chrome(void) {
+    if (!trace_file[0]) return;
+    char path[sizeof(trace_file) + 32], pid_s[21];
+    size_t n = strlen(trace_file);
+    memcpy(path, trace_file, n);
+    path[n++] = '.';
+    trace_utoa((uint64_t)getpid(), pid_s);
+    memcpy(path + n, pid_s, strlen(pid_s));
+    n += strlen(pid_s);
+    memcpy(path + n, ".json", 6);
+
+    trace_out_t o = { .fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+    if (o.fd < 0) return;
+    // ticks to ns over the whole run so far
+    uint64_t dt = trace_ticks() - trace_tick0, dns = trace_ns() - trace_ns0;
+    double ns_per_tick = dt ? (double)dns / (double)dt : 1.0;
+    uint64_t pid = (uint64_t)getpid();
+    int first = 1;
+    trace_puts(&o, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    for (trace_thread_t *t = atomic_load(&trace_threads); t; t = t->next) {
+        unsigned n = atomic_load_explicit(&t->nevents, memory_order_acquire);
+        for (unsigned i = 0; i < n && i < TRACE_EVENTS; i++) {
+            const trace_event_t *e = &t->events[i];
+            const trace_probe_t *p = atomic_load(&trace_probes[e->probe]);
+            if (!p) continue;
+            trace_puts(&o, first ? "{\"name\": \"" : ",\n{\"name\": \"");
+            first = 0;
+            trace_puts(&o, p->name);
+            trace_puts(&o, "\", \"pid\": ");
+            trace_putu(&o, pid);
+            trace_puts(&o, ", \"tid\": ");
+            trace_putu(&o, (uint64_t)t->tid);
+            trace_puts(&o, ", \"ts\": ");
+            trace_put_us(&o, (uint64_t)((double)(e->ts - trace_tick0) * ns_per_tick));
+            if (p->span) {
+                trace_puts(&o, ", \"ph\": \"X\", \"dur\": ");
+                trace_put_us(&o, (uint64_t)((double)e->value * ns_per_tick));
+                trace_puts(&o, ", \"args\": {\"ticks\": ");
+            } else {
+                trace_puts(&o, ", \"ph\": \"C\", \"args\": {\"value\": ");
+            }
+            trace_putu(&o, e->value);
+            trace_puts(&o, "}}");
+        }
+    }
+    trace_puts(&o, "\n]}\n");
+    trace_flush(&o);
+    close(o.fd);
+}
+
+static void trace_dump(void) {
+    trace_summary();
+    trace_chrome();
+}
+
+static void trace_on_signal(int sig) {
+    (void)sig;
+    int saved = errno;
+    trace_dump();
+    errno = saved;
+}
+
+// First probe hit of the process: the clock origin, the exit hook and the
+// signal, unless the program has its own SIGUSR2 handler
+static void trace_start(void) {
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&trace_started, &expected, 1)) return;
+    trace_tick0 = trace_ticks();
+    trace_ns0 = trace_ns();
+    const char *f = getenv("LAB_TRACE_FILE");
+    if (f && strlen(f) < sizeof(trace_file)) strcpy(trace_file, f);
+    atexit(trace_dump);
+    struct sigaction sa, old;
+    if (sigaction(SIGUSR2, NULL, &old) == 0 && old.sa_handler == SIG_DFL) {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = trace_on_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR2, &sa, NULL);
+    }
+}
+
+static trace_thread_t *trace_thread_new(void) {
+    trace_start();
+    trace_thread_t *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->tid = (long)syscall(SYS_gettid);
+    t->next = atomic_load(&trace_threads);
+    while (!atomic_compare_exchange_weak(&trace_threads, &t->next, t)) {}
+    return t;
+}
+
+static inline int trace_probe_id(trace_probe_t *p) {
+    int id = atomic_load_explicit(&p->id, memory_order_acquire);
+    if (id) return id - 1;
+    int slot = atomic_fetch_add(&trace_nprobes, 1);
+    if (slot >= TRACE_MAX_PROBES) {
+        atomic_fetch_sub(&trace_nprobes, 1);
+        return -1;
+    }
+    int zero = 0;
+    if (!atomic_compare_exchange_strong(&p->id, &zero, slot + 1)) {
+        // another thread numbered it first: leave our slot empty
+        return zero - 1;
+    }
+    atomic_store(&trace_probes[slot], p);
+    return slot;
+}
+
+static inline void trace_record(trace_probe_t *p, uint64_t ts, uint64_t v) {
+    trace_thread_t *t = trace_me;
+    if (!t && !(t = trace_me = trace_thread_new())) return;
+    int id = trace_probe_id(p);
+    if (id < 0) return;
+    trace_stat_t *s = &t->stat[id];
+    trace_add(&s->count, 1);
+    trace_add(&s->sum, v);
+    if (v > atomic_load_explicit(&s->max, memory_order_relaxed))
+        atomic_store_explicit(&s->max, v, memory_order_relaxed);
+    trace_add(&s->hist[v ? 64 - __builtin_clzll(v) : 0], 1);
+    unsigned n = atomic_load_explicit(&t->nevents, memory_order_relaxed);
+    if (n < TRACE_EVENTS) {
+        t->events[n] = (trace_event_t){ ts, v, (uint32_t)id };
+        atomic_store_explicit(&t->nevents, n + 1, memory_order_release);
+    } else {
+        trace_add(&t->dropped, 1);
+    }
+}
+
+#define TRACE_BEGIN(t0) uint64_t t0 = trace_ticks()
+#define TRACE_END(name, t0)                                                  \
+    do {                                                                     \
+        static trace_probe_t trace_probe_ = { name, 0, 1 };                  \
+        uint64_t trace_now_ = trace_ticks();                                 \
+        trace_record(&trace_probe_, (t0), trace_now_ - (t0));                \
+    } while (0)
+#define TRACE_VALUE(name, v)                                                 \
+    do {                                                                     \
+        static trace_probe_t trace_probe_ = { name, 0, 0 };                  \
+        trace_record(&trace_probe_, trace_ticks(), (uint64_t)(v));           \
+    } while (0)
+// _exit() skips the atexit hook; nothing to dump before the first probe
+#define TRACE_DUMP()                                                         \
+    do {                                                                     \
+        if (atomic_load(&trace_started)) trace_dump();                       \
+    } while (0)
+
+#else
+
+#define TRACE_BEGIN(t0) do {} while (0)
+#define TRACE_END(name, t0) do {} while (0)
+#define TRACE_VALUE(name, v) do { (void)sizeof(v); } while (0)
+#define TRACE_DUMP() do {} while (0)
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Frames of the -j mode between sum-server and its `sum-client --worker`
+// processes: a chunk_hdr_t, then len bytes. An input frame carries whole
+// lines, numbered by seq; the answer carries the sums of those lines under
+// the same seq.
+
+// A sum is never longer than the line it comes from (sign and digits fit in
+// the text of the numbers), so the answer to a chunk fits in CHUNK_SIZE too.
+#define CHUNK_SIZE 65536
+// Longest line, its newline included; longer lines are skipped whole with a
+// warning, with or without -j
+#define LINE_MAX_BYTES 8192
+#define MAX_JOBS 64
+
+typedef struct {
+    uint64_t seq;
+    uint32_t len;
+    uint32_t pad;
+} chunk_hdr_t;
+
+// Reads exactly len bytes: 1 when done, 0 on EOF before the first byte,
+// -1 on an error or EOF in the middle
+static inline int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t r = read(fd, p + got, len - got);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) return got ? -1 : 0;
+        got += (size_t)r;
+    }
+    return 1;
+}
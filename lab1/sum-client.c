@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -5,7 +6,10 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
-#include <ctype.h>
+#include <poll.h>
+#include "sumparse.h"
+#include "outbuf.h"
+#include "sum-chunk.h"
 
 static void write_all(int fd, const char *buf, size_t len) {
     while (len > 0) {
@@ -31,32 +35,104 @@ static char *i64_to_str(long long v, char *dst) {
     return dst;
 }
 
+static void die_output(void) {
+    const char msg[] = "error: failed to write output file\n";
+    write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+    _exit(EXIT_FAILURE);
+}
+
+static void flush_or_die(outbuf_t *out) {
+    if (ob_flush(out) == -1) die_output();
+}
+
+static void close_or_die(outbuf_t *out) {
+    if (ob_close(out) == -1) die_output();
+}
+
+static void warn_long_line(void) {
+    const char msg[] = "warning: input line too long, skipped\n";
+    write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+}
+
+// Sums of the lines of chunk[0..len) into dst, which holds at least len
+// bytes (see CHUNK_SIZE); returns the bytes written
+static size_t sum_chunk(const char *chunk, size_t len, char *dst) {
+    const char *p = chunk;
+    const char *end = chunk + len;
+    char *w = dst;
+    while (p < end) {
+        const char *nl = sp_find_newline(p, end);
+        if ((size_t)(nl - p) + 1 > LINE_MAX_BYTES) {
+            warn_long_line();
+            p = nl + 1;
+            continue;
+        }
+        int clamped = 0;
+        long long sum = sp_line_sum(p, nl, &clamped);
+        while (clamped--) {
+            const char msg[] = "warning: integer out of range, clamped\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        }
+        w = i64_to_str(sum, w);
+        *w++ = '\n';
+        p = nl + 1;
+    }
+    return (size_t)(w - dst);
+}
+
+// --worker (sum-server -j N): chunk frames on stdin, the frames with their
+// sums on stdout. The server has already cut the input at the empty line.
+static int run_worker(void) {
+    static char in[CHUNK_SIZE], out[CHUNK_SIZE];
+    for (;;) {
+        chunk_hdr_t h;
+        int rc = read_full(STDIN_FILENO, &h, sizeof(h));
+        if (rc == 0) return EXIT_SUCCESS;
+        if (rc < 0 || h.len > sizeof(in) || read_full(STDIN_FILENO, in, h.len) < 0) {
+            const char msg[] = "error: bad chunk from server\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            return EXIT_FAILURE;
+        }
+        h.len = (uint32_t)sum_chunk(in, h.len, out);
+        write_all(STDOUT_FILENO, (const char *)&h, sizeof(h));
+        write_all(STDOUT_FILENO, out, h.len);
+    }
+}
+
 int main(int argc, char **argv) {
     if (argc < 2) {
-        const char msg[] = "usage: sum-client <output_file>\n";
+        const char msg[] = "usage: sum-client <output_file> | --worker\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
         _exit(EXIT_FAILURE);
     }
+    if (strcmp(argv[1], "--worker") == 0) return run_worker();
 
-    int out = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0600);
-    if (out == -1) {
+    outbuf_t out;
+    if (ob_open(&out, argv[1]) == -1) {
         const char msg[] = "error: failed to open output file\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
         _exit(EXIT_FAILURE);
     }
 
-    char inbuf[8192];
+    char inbuf[LINE_MAX_BYTES];
     size_t in_len = 0;
+    int skip = 0; // inside an over-long line: drop input up to its newline
 
     for (;;) {
         // Fill buffer
         if (in_len < sizeof(inbuf)) {
+            // Buffered sums wait for more input only up to the latency bound
+            int wait_ms = ob_ms_left(&out);
+            if (wait_ms >= 0) {
+                struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+                if (wait_ms == 0 || poll(&pfd, 1, wait_ms) == 0) flush_or_die(&out);
+            }
             ssize_t r = read(STDIN_FILENO, inbuf + in_len, sizeof(inbuf) - in_len);
             if (r < 0) {
                 if (errno == EINTR) continue;
                 const char msg[] = "error: failed to read from stdin\n";
                 write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-                close(out);
+                ob_close(&out);
                 _exit(EXIT_FAILURE);
             }
             if (r == 0) {
@@ -65,60 +141,57 @@ int main(int argc, char **argv) {
             in_len += (size_t)r;
         }
 
-        size_t start = 0;
-        for (size_t i = 0; i < in_len; ++i) {
-            if (inbuf[i] == '\n') {
-                size_t linelen = i - start; // not including \n
-                if (linelen == 0) {
-                    close(out);
-                    _exit(EXIT_SUCCESS);
-                }
-
-                long long sum = 0;
-                char *p = inbuf + start;
-                char *end = inbuf + i;
-                while (p < end) {
-                    while (p < end && isspace((unsigned char)*p)) p++;
-                    if (p >= end) break;
-                    errno = 0;
-                    char *q = NULL;
-                    long val = strtol(p, &q, 10);
-                    if (q == p) {
-                        p++;
-                        continue;
-                    }
-                    if (errno == ERANGE) {
-                        const char msg[] = "warning: integer out of range, clamped\n";
-                        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-                    }
-                    sum += (long long)val;
-                    p = q;
-                }
-
-                char outbuf[64];
-                char *w = outbuf;
-                w = i64_to_str(sum, w);
-                *w++ = '\n';
-                write_all(out, outbuf, (size_t)(w - outbuf));
-
-                // Move to next line
-                start = i + 1;
+        if (skip) {
+            const char *nl = memchr(inbuf, '\n', in_len);
+            if (!nl) {
+                in_len = 0;
+                continue;
             }
+            in_len -= (size_t)(nl - inbuf) + 1;
+            memmove(inbuf, nl + 1, in_len);
+            skip = 0;
         }
 
-        if (start > 0) {
+        const char *start = inbuf;
+        const char *end = inbuf + in_len;
+        for (;;) {
+            const char *nl = sp_find_newline(start, end);
+            if (nl == end) break;
+            if (nl == start) { // empty line ends the input
+                close_or_die(&out);
+                _exit(EXIT_SUCCESS);
+            }
+
+            int clamped = 0;
+            long long sum = sp_line_sum(start, nl, &clamped);
+            while (clamped--) {
+                const char msg[] = "warning: integer out of range, clamped\n";
+                write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            }
+
+            char *w = ob_space(&out, 32);
+            if (!w) die_output();
+            w = i64_to_str(sum, w);
+            *w++ = '\n';
+            ob_commit(&out, w);
+
+            // Move to next line
+            start = nl + 1;
+        }
+
+        if (start > inbuf) {
             // Move leftover to beginning
-            size_t rem = in_len - start;
-            memmove(inbuf, inbuf + start, rem);
+            size_t rem = (size_t)(end - start);
+            memmove(inbuf, start, rem);
             in_len = rem;
         } else if (in_len == sizeof(inbuf)) {
-            // Line too long without newline; drop buffer (or could error)
-            const char msg[] = "warning: input line too long, truncating\n";
-            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            // Longer than LINE_MAX_BYTES with its newline: skip it whole
+            warn_long_line();
             in_len = 0;
+            skip = 1;
         }
     }
 
-    close(out);
+    close_or_die(&out);
     return EXIT_SUCCESS;
 }
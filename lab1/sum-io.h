@@ -0,0 +1,465 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// Event-driven copying for sum-server: stdin -> client and client stdout ->
+// stdout run at the same time instead of one after the other, so a client
+// that writes to its stdout while it still reads its input never waits on a
+// full pipe nobody drains. Each stream has IO_NBUF buffers with one read and
+// one write in flight, so reading the next buffer overlaps writing the last.
+//
+// Backends: io_uring, where every read and write that can start is queued
+// and the whole batch goes in with the wait for completions in a single
+// io_uring_enter, over buffers registered with the ring (READ_FIXED,
+// WRITE_FIXED); epoll when io_uring is not there (ENOSYS, EPERM under
+// kernel.io_uring_disabled or seccomp, kernels before 5.7). Under epoll a
+// stream from a pipe into a pipe is spliced (SPLICE_F_NONBLOCK) rather than
+// copied through the buffers; io_uring copies: its IORING_OP_SPLICE of a
+// pipe goes through an io-wq thread and was half as fast. The client
+// end of the input stream is watched for POLLERR all the time, so a client
+// that leaves at the empty line is noticed at once, not at the next write.
+
+#define IO_BUF_SIZE 65536
+#define IO_NBUF 4
+#define IO_MAX_STREAMS 2
+
+enum { IO_SYNC, IO_URING, IO_EPOLL };
+
+typedef struct {
+    int src, dst;
+    int close_dst;        // close dst when done: the client sees EOF
+    int splice;           // pipe to pipe: splice, the buffers only hold a prefix
+    const char *rerr;     // messages on errors (EPIPE on dst is not one)
+    const char *werr;
+    char *buf;            // IO_NBUF buffers of IO_BUF_SIZE
+    uint32_t len[IO_NBUF];
+    unsigned head, tail;  // buffers filled / written, free-running
+    uint32_t woff;        // bytes of buffer tail already written
+    int reading, writing; // an operation is in flight
+    int eof;              // src is done
+    int dead;             // dst is gone or failed, the rest is dropped
+    int failed;
+    int closed;
+    int cancel;           // io_uring: the in-flight read is being cancelled
+    int watching;         // io_uring: POLL_ADD on dst for POLLERR in flight
+    int watch_cancel;
+    int wait_dst;         // epoll: a splice found dst full
+} io_stream_t;
+
+static inline void io_say(const char *msg) {
+    ssize_t r = write(STDERR_FILENO, msg, strlen(msg));
+    (void)r;
+}
+
+static inline int io_is_fifo(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+// may_splice: splice when both ends are pipes. -1 without memory.
+static inline int io_stream_init(io_stream_t *s, int src, int dst, int close_dst, int may_splice,
+                                 const char *rerr, const char *werr) {
+    memset(s, 0, sizeof(*s));
+    s->src = src;
+    s->dst = dst;
+    s->close_dst = close_dst;
+    s->splice = may_splice && io_is_fifo(src) && io_is_fifo(dst);
+    s->rerr = rerr;
+    s->werr = werr;
+    s->buf = aligned_alloc(4096, (size_t)IO_NBUF * IO_BUF_SIZE);
+    return s->buf ? 0 : -1;
+}
+
+// Bytes to send before anything read from src (n <= IO_BUF_SIZE)
+static inline void io_stream_prefix(io_stream_t *s, const char *p, size_t n) {
+    if (n == 0) return;
+    memcpy(s->buf, p, n);
+    s->len[0] = (uint32_t)n;
+    s->head = 1;
+}
+
+static inline int io_can_read(const io_stream_t *s) {
+    if (s->eof || s->dead || s->reading) return 0;
+    return s->splice ? s->head == s->tail && !s->writing : s->head - s->tail < IO_NBUF;
+}
+
+static inline int io_can_write(const io_stream_t *s) {
+    return !s->dead && !s->writing && s->head != s->tail;
+}
+
+static inline char *io_rbuf(io_stream_t *s) { return s->buf + (size_t)(s->head % IO_NBUF) * IO_BUF_SIZE; }
+static inline char *io_wbuf(io_stream_t *s) { return s->buf + (size_t)(s->tail % IO_NBUF) * IO_BUF_SIZE + s->woff; }
+static inline uint32_t io_wlen(const io_stream_t *s) { return s->len[s->tail % IO_NBUF] - s->woff; }
+
+static inline int io_finished(const io_stream_t *s) {
+    return s->dead || (s->eof && s->head == s->tail);
+}
+
+// Closes dst once the stream is finished and has nothing left in flight;
+// 1 while it runs
+static inline int io_active(io_stream_t *s) {
+    if (s->closed) return 0;
+    if (s->reading || s->writing || s->watching || !io_finished(s)) return 1;
+    s->closed = 1;
+    if (s->close_dst) close(s->dst);
+    return 0;
+}
+
+static inline void io_fail_dst(io_stream_t *s, long res) {
+    s->dead = 1;
+    if (res != -EPIPE) {
+        s->failed = 1;
+        io_say(s->werr);
+    }
+}
+
+// Result of a read or splice: bytes, 0 at EOF or -errno
+static inline void io_read_done(io_stream_t *s, long res) {
+    s->reading = 0;
+    if (res > 0) {
+        if (!s->splice) s->len[s->head++ % IO_NBUF] = (uint32_t)res;
+        return;
+    }
+    if (res == 0) {
+        s->eof = 1;
+        return;
+    }
+    if (res == -EINTR || res == -EAGAIN || res == -ECANCELED) return;
+    if (s->splice && res == -EPIPE) {
+        s->dead = 1;
+        return;
+    }
+    s->eof = 1;
+    s->failed = 1;
+    io_say(s->rerr);
+}
+
+static inline void io_write_done(io_stream_t *s, long res) {
+    s->writing = 0;
+    if (res > 0) {
+        s->woff += (uint32_t)res;
+        if (io_wlen(s) == 0) {
+            s->tail++;
+            s->woff = 0;
+        }
+        return;
+    }
+    if (res == 0 || res == -EINTR || res == -EAGAIN) return;
+    io_fail_dst(s, res);
+}
+
+// --- io_uring, without liburing ---
+
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_len, cq_len, sqe_len;
+    unsigned queued; // sqes filled in but not yet visible to the kernel
+} iou_t;
+
+static inline void iou_close(iou_t *u) {
+    if (u->sqes) munmap(u->sqes, u->sqe_len);
+    if (u->cq_map && u->cq_map != u->sq_map) munmap(u->cq_map, u->cq_len);
+    if (u->sq_map) munmap(u->sq_map, u->sq_len);
+    close(u->fd);
+}
+
+// -1 when io_uring is missing, disabled, or without reads at the current
+// file position and poll-driven pipe reads (5.7)
+static inline int iou_open(iou_t *u, unsigned entries) {
+    memset(u, 0, sizeof(*u));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    u->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (u->fd < 0) return -1;
+    unsigned need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_RW_CUR_POS | IORING_FEAT_FAST_POLL;
+    if ((p.features & need) != need) {
+        close(u->fd);
+        return -1;
+    }
+    u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (u->cq_len > u->sq_len) u->sq_len = u->cq_len;
+    u->cq_len = u->sq_len;
+    u->sqe_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    char *sq = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        close(u->fd);
+        return -1;
+    }
+    u->sq_map = u->cq_map = sq;
+    void *sqes = mmap(NULL, u->sqe_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        iou_close(u);
+        return -1;
+    }
+    u->sqes = sqes;
+    u->sq_head = (unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->cq_head = (unsigned *)(sq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(sq + p.cq_off.tail);
+    u->cq_mask = (unsigned *)(sq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(sq + p.cq_off.cqes);
+    return 0;
+}
+
+// Never more in flight than the ring has entries: per stream a read, a
+// write, a cancel, the watch and its removal
+static inline struct io_uring_sqe *iou_sqe(iou_t *u, uint64_t user_data) {
+    unsigned idx = (*u->sq_tail + u->queued) & *u->sq_mask;
+    struct io_uring_sqe *e = &u->sqes[idx];
+    memset(e, 0, sizeof(*e));
+    e->user_data = user_data;
+    u->sq_array[idx] = idx;
+    u->queued++;
+    return e;
+}
+
+// Submits the queued batch and waits for at least one completion
+static inline int iou_submit_wait(iou_t *u) {
+    __atomic_store_n(u->sq_tail, *u->sq_tail + u->queued, __ATOMIC_RELEASE);
+    u->queued = 0;
+    for (;;) {
+        unsigned pending = *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        long r = syscall(__NR_io_uring_enter, u->fd, pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (r >= 0) return 0;
+        if (errno != EINTR) return -1;
+    }
+}
+
+// user_data: stream << 2 | op
+enum { IOU_READ, IOU_WRITE, IOU_CANCEL, IOU_WATCH };
+
+static inline int io_pump_uring(io_stream_t *st, int n) {
+    iou_t u;
+    if (iou_open(&u, 16) == -1) return -2;
+    for (int k = 0; k < n; k++) st[k].splice = 0;
+
+    // fixed buffers need locked memory; without it the plain READ and
+    // WRITE opcodes do the same
+    struct iovec iov[IO_MAX_STREAMS * IO_NBUF];
+    for (int k = 0; k < n; k++)
+        for (int i = 0; i < IO_NBUF; i++)
+            iov[k * IO_NBUF + i] = (struct iovec){ st[k].buf + (size_t)i * IO_BUF_SIZE, IO_BUF_SIZE };
+    int fixed = syscall(__NR_io_uring_register, u.fd, IORING_REGISTER_BUFFERS, iov, (unsigned)(n * IO_NBUF)) == 0;
+
+    int rc = 0;
+    for (;;) {
+        int active = 0;
+        for (int k = 0; k < n; k++) {
+            io_stream_t *s = &st[k];
+            if (!io_active(s)) continue;
+            active = 1;
+            if (io_can_write(s)) {
+                struct io_uring_sqe *e = iou_sqe(&u, (uint64_t)k << 2 | IOU_WRITE);
+                e->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                e->fd = s->dst;
+                e->addr = (uint64_t)(uintptr_t)io_wbuf(s);
+                e->len = io_wlen(s);
+                e->off = (uint64_t)-1;
+                e->buf_index = (uint16_t)(k * IO_NBUF + s->tail % IO_NBUF);
+                s->writing = 1;
+            }
+            if (io_can_read(s)) {
+                struct io_uring_sqe *e = iou_sqe(&u, (uint64_t)k << 2 | IOU_READ);
+                e->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+                e->fd = s->src;
+                e->addr = (uint64_t)(uintptr_t)io_rbuf(s);
+                e->len = IO_BUF_SIZE;
+                e->off = (uint64_t)-1;
+                e->buf_index = (uint16_t)(k * IO_NBUF + s->head % IO_NBUF);
+                s->reading = 1;
+            }
+            // nobody takes the data any more: a read of a terminal would
+            // otherwise wait for the next line
+            if (s->dead && s->reading && !s->cancel) {
+                struct io_uring_sqe *e = iou_sqe(&u, (uint64_t)k << 2 | IOU_CANCEL);
+                e->opcode = IORING_OP_ASYNC_CANCEL;
+                e->addr = (uint64_t)k << 2 | IOU_READ;
+                s->cancel = 1;
+            }
+            // POLLERR and POLLHUP are always reported, the mask stays 0; the
+            // poll holds a reference to dst, so it goes before dst is closed
+            if (s->close_dst && !s->watching && !s->watch_cancel && !io_finished(s)) {
+                struct io_uring_sqe *e = iou_sqe(&u, (uint64_t)k << 2 | IOU_WATCH);
+                e->opcode = IORING_OP_POLL_ADD;
+                e->fd = s->dst;
+                s->watching = 1;
+            }
+            if (s->watching && !s->watch_cancel && io_finished(s)) {
+                struct io_uring_sqe *e = iou_sqe(&u, (uint64_t)k << 2 | IOU_CANCEL);
+                e->opcode = IORING_OP_POLL_REMOVE;
+                e->addr = (uint64_t)k << 2 | IOU_WATCH;
+                s->watch_cancel = 1;
+            }
+        }
+        if (!active) break;
+        if (iou_submit_wait(&u) == -1) {
+            io_say("error: io_uring_enter failed\n");
+            rc = -1;
+            break;
+        }
+
+        unsigned head = *u.cq_head;
+        unsigned tail = __atomic_load_n(u.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *c = &u.cqes[head & *u.cq_mask];
+            io_stream_t *s = &st[c->user_data >> 2];
+            switch (c->user_data & 3) {
+            case IOU_READ: io_read_done(s, c->res); break;
+            case IOU_WRITE: io_write_done(s, c->res); break;
+            case IOU_WATCH:
+                s->watching = 0;
+                if (c->res > 0 && (c->res & (POLLERR | POLLHUP))) s->dead = 1;
+                break;
+            default: break;
+            }
+        }
+        __atomic_store_n(u.cq_head, head, __ATOMIC_RELEASE);
+    }
+    iou_close(&u);
+    return rc;
+}
+
+// --- epoll ---
+
+// Registration of one fd: the events asked for, -1 when not in the set, or
+// always ready (a regular file, which epoll refuses with EPERM); ready holds
+// the events that came
+typedef struct {
+    int fd;
+    int events;
+    int nopoll;
+    int ready;
+} io_watch_t;
+
+// keep: stay in the set with an empty mask to hear EPOLLERR
+static inline void io_watch(int ep, io_watch_t *w, int want, int keep, uint32_t tag) {
+    if (w->nopoll) {
+        w->ready = want;
+        return;
+    }
+    if (want == w->events || (want == 0 && !keep && w->events == -1)) return;
+    // an fd nobody waits on leaves the set, so that its EPOLLHUP, which is
+    // reported regardless of the mask, does not spin the loop
+    if (want == 0 && !keep) {
+        epoll_ctl(ep, EPOLL_CTL_DEL, w->fd, NULL);
+        w->events = -1;
+        return;
+    }
+    struct epoll_event ev = { .events = (uint32_t)want, .data.u32 = tag };
+    int op = w->events == -1 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(ep, op, w->fd, &ev) == 0) {
+        w->events = want;
+    } else if (errno == EPERM) {
+        w->nopoll = 1;
+        w->ready = want;
+    }
+}
+
+// Our own pipe ends are non-blocking; stdin and stdout are shared with
+// whoever started the server and stay blocking, they are only touched when
+// epoll calls them ready, and a read then returns what is there.
+static inline int io_pump_epoll(io_stream_t *st, int n) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep == -1) {
+        io_say("error: epoll_create1 failed\n");
+        return -1;
+    }
+    io_watch_t w[IO_MAX_STREAMS][2];
+    for (int k = 0; k < n; k++) {
+        w[k][0] = (io_watch_t){ st[k].src, -1, 0, 0 };
+        w[k][1] = (io_watch_t){ st[k].dst, -1, 0, 0 };
+    }
+
+    int rc = 0;
+    for (;;) {
+        int active = 0, now = 0;
+        for (int k = 0; k < n; k++) {
+            io_stream_t *s = &st[k];
+            if (io_finished(s)) {
+                // out of the set before io_active closes dst
+                io_watch(ep, &w[k][0], 0, 0, 0);
+                io_watch(ep, &w[k][1], 0, 0, 0);
+            }
+            if (!io_active(s)) continue;
+            active = 1;
+            int rd = io_can_read(s) && !s->wait_dst;
+            int wr = io_can_write(s) || (io_can_read(s) && s->wait_dst);
+            io_watch(ep, &w[k][0], rd ? EPOLLIN : 0, 0, (uint32_t)k << 1);
+            io_watch(ep, &w[k][1], wr ? EPOLLOUT : 0, s->close_dst, (uint32_t)k << 1 | 1);
+            now |= w[k][0].ready | w[k][1].ready;
+        }
+        if (!active) break;
+
+        struct epoll_event evs[2 * IO_MAX_STREAMS];
+        int ne = epoll_wait(ep, evs, 2 * IO_MAX_STREAMS, now ? 0 : -1);
+        if (ne < 0) {
+            if (errno == EINTR) continue;
+            io_say("error: epoll_wait failed\n");
+            rc = -1;
+            break;
+        }
+        for (int i = 0; i < ne; i++) w[evs[i].data.u32 >> 1][evs[i].data.u32 & 1].ready = (int)evs[i].events;
+
+        for (int k = 0; k < n; k++) {
+            io_stream_t *s = &st[k];
+            // the client closed its end: nothing to wait for in stdin
+            if (s->close_dst && !s->writing && (w[k][1].ready & EPOLLERR)) s->dead = 1;
+            if (io_can_write(s) && w[k][1].ready) {
+                ssize_t r = write(s->dst, io_wbuf(s), io_wlen(s));
+                s->writing = 1;
+                io_write_done(s, r < 0 ? -errno : r);
+            }
+            if (s->splice && s->wait_dst && w[k][1].ready) s->wait_dst = 0;
+            if (io_can_read(s) && !s->wait_dst && w[k][0].ready) {
+                ssize_t r;
+                if (s->splice) {
+                    r = splice(s->src, NULL, s->dst, NULL, IO_BUF_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                    // src was readable, so dst is full
+                    if (r < 0 && errno == EAGAIN) s->wait_dst = 1;
+                } else {
+                    r = read(s->src, io_rbuf(s), IO_BUF_SIZE);
+                }
+                s->reading = 1;
+                io_read_done(s, r < 0 ? -errno : r);
+            }
+            for (int d = 0; d < 2; d++)
+                if (!w[k][d].nopoll) w[k][d].ready = 0;
+        }
+    }
+    close(ep);
+    return rc;
+}
+
+// Runs the streams to the end with the backend asked for; IO_URING falls
+// back to epoll. Returns -1 if a stream failed.
+static inline int io_pump(io_stream_t *st, int n, int backend) {
+    int rc = -2;
+    if (backend == IO_URING) rc = io_pump_uring(st, n);
+    if (rc == -2) rc = io_pump_epoll(st, n);
+    for (int k = 0; k < n; k++) {
+        if (st[k].failed) rc = -1;
+        free(st[k].buf);
+        st[k].buf = NULL;
+    }
+    return rc;
+}
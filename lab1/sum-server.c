@@ -1,11 +1,16 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#include "sum-chunk.h"
+#include "sum-io.h"
 
 // --- Вспомогательные функции ---
 
@@ -36,54 +41,373 @@ static void write_all(int fd, const char *buf, size_t len) {
 }
 
 /**
- * @brief Читает одну строку из файлового дескриптора.
- * 
- * Функция читает данные по одному байту до тех пор, пока не встретит символ
- * новой строки ('\n') или пока не будет достигнут конец файла (EOF).
- * В конец строки добавляется нулевой символ для корректной работы со строковыми функциями.
- * 
+ * @brief Читает первую строку (имя выходного файла) блоками, а не по байту.
+ *
+ * Блочный read() почти всегда захватывает и начало данных за строкой: они
+ * остаются в head[*line_len..*fill) и должны уйти клиенту первыми. Строка
+ * длиннее name_cap - 1 байт обрезается, остаток считается данными — как у
+ * прежнего побайтного чтения.
+ *
  * @param fd Файловый дескриптор для чтения.
- * @param buf Буфер для сохранения строки.
- * @param cap Максимальная вместимость буфера.
- * @return Количество прочитанных байт, 0 при EOF, -1 при ошибке.
+ * @param head Буфер для начала ввода (больше name_cap).
+ * @param cap Вместимость head.
+ * @param name_cap Вместимость буфера имени файла вместе с '\0'.
+ * @param fill Сколько байт прочитано в head.
+ * @param line_len Длина первой строки вместе с '\n'.
+ * @return 1 — строка прочитана, 0 — EOF до перевода строки, -1 — ошибка чтения.
  */
-static int read_line(int fd, char *buf, size_t cap) {
-    size_t n = 0;
-    // Читаем побайтно, пока есть место в буфере (оставляя место для '\0').
-    while (n + 1 < cap) {
-        char c;
-        ssize_t r = read(fd, &c, 1);
+static int read_first_line(int fd, char *head, size_t cap, size_t name_cap, size_t *fill, size_t *line_len) {
+    *fill = 0;
+    for (;;) {
+        char *nl = memchr(head, '\n', *fill);
+        if (nl && (size_t)(nl - head) + 1 < name_cap) {
+            *line_len = (size_t)(nl - head) + 1;
+            return 1;
+        }
+        if (*fill >= name_cap - 1) {
+            *line_len = name_cap - 1;
+            return 1;
+        }
+        ssize_t r = read(fd, head + *fill, cap - *fill);
         if (r < 0) {
-            // Если чтение было прервано сигналом, повторяем.
             if (errno == EINTR) continue;
-            return -1; // Ошибка чтения.
+            return -1;
         }
-        if (r == 0) return 0; // Достигнут конец файла (EOF).
-        
-        buf[n++] = c;
-        // Если прочитали символ новой строки, строка закончилась.
-        if (c == '\n') break;
+        if (r == 0) return 0; // EOF без перевода строки
+        *fill += (size_t)r;
     }
-    // Завершаем строку нулевым символом.
-    buf[n] = '\0';
-    return (int)n;
+}
+
+/**
+ * @brief Как write_all, но возвращает -1 вместо завершения процесса.
+ *
+ * EPIPE — не ошибка: клиент встретил пустую строку и вышел, дальше ввод
+ * пересылать некому.
+ */
+static int send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EPIPE) {
+                const char msg[] = "error: failed to write to client\n";
+                write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            }
+            return -1;
+        }
+        buf += (size_t)n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Пересылает stdin в канал клиента через splice(2), без копии в сервер.
+ *
+ * Страницы канала (или файла, сокета) переходят в канал клиента внутри ядра.
+ *
+ * @return 0 — ввод кончился или клиент ушёл, -1 — stdin нельзя splice'ить;
+ * тогда из него ещё ничего не прочитано.
+ */
+static int splice_input(int out) {
+    int first = 1;
+    for (;;) {
+        ssize_t n = splice(STDIN_FILENO, NULL, out, NULL, 1 << 16, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n > 0) {
+            first = 0;
+            continue;
+        }
+        if (n == 0) return 0;
+        if (errno == EINTR) continue;
+        if (first && errno == EINVAL) return -1;
+        if (errno != EPIPE) {
+            const char msg[] = "error: splice to client failed\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        }
+        return 0;
+    }
+}
+
+/**
+ * @brief Пересылает клиенту прочитанный вместе с именем файла хвост и весь
+ * остальной stdin: из канала — splice, из остального (терминал, сокет) или
+ * с --proxy — копированием через буфер сервера. Терминал splice'ить можно,
+ * но ядро тогда отдаёт строки клиенту с задержкой.
+ */
+static void forward_input(int out, const char *extra, size_t extra_len, int proxy) {
+    if (send_all(out, extra, extra_len) == -1) return;
+    struct stat st;
+    if (!proxy && fstat(STDIN_FILENO, &st) == 0 && S_ISFIFO(st.st_mode) && splice_input(out) == 0) return;
+
+    static char buf[1 << 16];
+    for (;;) {
+        ssize_t r = read(STDIN_FILENO, buf, sizeof(buf));
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            const char msg[] = "error: failed to read from stdin\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            return;
+        }
+        // Если достигнут конец ввода, выходим из цикла.
+        if (r == 0) return;
+        // Записываем прочитанные данные в канал, ведущий к дочернему процессу.
+        if (send_all(out, buf, (size_t)r) == -1) return;
+    }
+}
+
+// --- Режим -j N ---
+
+/**
+ * @brief Закрывает оба конца всех каналов режима -j.
+ */
+static void close_pipes(int (*to_w)[2], int (*from_w)[2], int jobs) {
+    for (int k = 0; k < jobs; k++) {
+        close(to_w[k][0]); close(to_w[k][1]);
+        close(from_w[k][0]); close(from_w[k][1]);
+    }
+}
+
+/**
+ * @brief Процесс-сборщик: пишет ответы клиентов в файл в порядке seq.
+ *
+ * Кусок seq обрабатывал клиент seq % jobs, а каждый клиент отвечает на свои
+ * куски по порядку, поэтому ответы читаются по кругу и переупорядочивать
+ * их не нужно; seq в заголовке только проверяется.
+ *
+ * @return EXIT_SUCCESS, когда клиент с очередным seq закрыл свой канал.
+ */
+static int merge_output(const char *filename, int (*from_w)[2], int jobs) {
+    int out = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (out == -1) {
+        const char msg[] = "error: failed to open output file\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return EXIT_FAILURE;
+    }
+    static char buf[CHUNK_SIZE];
+    for (uint64_t seq = 0;; seq++) {
+        int fd = from_w[seq % (uint64_t)jobs][0];
+        chunk_hdr_t h;
+        int rc = read_full(fd, &h, sizeof(h));
+        if (rc == 0) break; // входные куски кончились
+        if (rc < 0 || h.seq != seq || h.len > sizeof(buf) || read_full(fd, buf, h.len) < 0) {
+            const char msg[] = "error: bad chunk from worker\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            close(out);
+            return EXIT_FAILURE;
+        }
+        write_all(out, buf, h.len);
+    }
+    close(out);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Режет stdin на куски по целым строкам и раздаёт их клиентам по кругу.
+ *
+ * Кусок — до CHUNK_SIZE байт, заканчивается переводом строки. Пустая строка
+ * завершает ввод, как и в обычном режиме: всё до неё отправляется, остальное
+ * не читается. Незаконченная последняя строка отбрасывается (клиент тоже не
+ * считает её без '\n'). Незаконченная строка, уже дошедшая до LINE_MAX_BYTES,
+ * отбрасывается здесь до своего '\n' с предупреждением, а целые строки
+ * длиннее LINE_MAX_BYTES внутри куска пропускает клиент: вывод тот же, что
+ * без -j.
+ */
+static void dispatch_chunks(int (*to_w)[2], int jobs, const char *extra, size_t extra_len) {
+    static char chunk[CHUNK_SIZE];
+    // Хвост, прочитанный вместе с именем файла, — начало первого куска
+    memcpy(chunk, extra, extra_len);
+    size_t fill = extra_len;
+    uint64_t seq = 0;
+    int skip = 0; // Внутри слишком длинной строки: отбрасываем её до '\n'
+    for (;;) {
+        char *last = fill ? memrchr(chunk, '\n', fill) : NULL;
+        if (!last) {
+            // Без '\n' в куске лежит только начало одной строки
+            if (fill >= LINE_MAX_BYTES) {
+                const char msg[] = "warning: input line too long, skipped\n";
+                write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+                fill = 0;
+                skip = 1;
+            }
+            ssize_t r = read(STDIN_FILENO, chunk + fill, sizeof(chunk) - fill);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                const char msg[] = "error: failed to read from stdin\n";
+                write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+                break;
+            }
+            if (r == 0) break;
+            fill += (size_t)r;
+            if (skip) {
+                char *nl = memchr(chunk, '\n', fill);
+                if (!nl) {
+                    fill = 0;
+                    continue;
+                }
+                fill -= (size_t)(nl - chunk) + 1;
+                memmove(chunk, nl + 1, fill);
+                skip = 0;
+            }
+            continue;
+        }
+        size_t len = (size_t)(last - chunk) + 1;
+
+        // Кусок начинается с начала строки, так что пустая строка — это
+        // '\n' в начале куска или "\n\n" внутри
+        char *empty = chunk[0] == '\n' ? chunk : memmem(chunk, len, "\n\n", 2);
+        if (empty) len = empty == chunk ? 0 : (size_t)(empty - chunk) + 1;
+
+        if (len > 0) {
+            chunk_hdr_t h = { .seq = seq, .len = (uint32_t)len, .pad = 0 };
+            int fd = to_w[seq % (uint64_t)jobs][1];
+            if (send_all(fd, (const char *)&h, sizeof(h)) == -1 || send_all(fd, chunk, len) == -1) break;
+            seq++;
+        }
+        if (empty) break;
+
+        size_t rest = fill - (size_t)(last - chunk) - 1;
+        memmove(chunk, last + 1, rest);
+        fill = rest;
+    }
+}
+
+/**
+ * @brief Режим -j N: N клиентов суммируют куски ввода параллельно.
+ *
+ * Каждый клиент (`sum-client --worker`) получает свои куски через свой канал
+ * на stdin и отвечает суммами в канал на stdout. Сервер только режет ввод,
+ * ответы собирает отдельный процесс (merge_output): иначе сервер мог бы
+ * заблокироваться на записи клиенту, который сам ждёт, пока прочитают его
+ * ответ.
+ */
+static int serve_jobs(const char *filename, int jobs, const char *extra, size_t extra_len) {
+    int to_w[MAX_JOBS][2], from_w[MAX_JOBS][2];
+    for (int k = 0; k < jobs; k++) {
+        if (pipe(to_w[k]) == -1 || pipe(from_w[k]) == -1) {
+            const char msg[] = "error: failed to create pipes\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Клиенты и сборщик; pids[jobs] — сборщик
+    pid_t pids[MAX_JOBS + 1];
+    for (int k = 0; k <= jobs; k++) {
+        pids[k] = fork();
+        if (pids[k] < 0) {
+            const char msg[] = "error: failed to fork\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            _exit(EXIT_FAILURE);
+        }
+        if (pids[k] > 0) continue;
+
+        if (k == jobs) {
+            // Сборщику нужны только концы для чтения ответов: лишний открытый
+            // конец для записи не дал бы клиентам увидеть EOF
+            for (int j = 0; j < jobs; j++) {
+                close(to_w[j][0]); close(to_w[j][1]);
+                close(from_w[j][1]);
+            }
+            _exit(merge_output(filename, from_w, jobs));
+        }
+
+        if (dup2(to_w[k][0], STDIN_FILENO) == -1) _exit(EXIT_FAILURE);
+        if (dup2(from_w[k][1], STDOUT_FILENO) == -1) _exit(EXIT_FAILURE);
+        close_pipes(to_w, from_w, jobs);
+        char *const args[] = { (char*)"sum-client", (char*)"--worker", NULL };
+        execv("./bin/sum-client", args);
+        const char msg[] = "error: failed to exec sum-client\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        _exit(EXIT_FAILURE);
+    }
+
+    // Серверу остаются только концы для записи кусков
+    for (int k = 0; k < jobs; k++) {
+        close(to_w[k][0]);
+        close(from_w[k][0]); close(from_w[k][1]);
+    }
+    dispatch_chunks(to_w, jobs, extra, extra_len);
+    for (int k = 0; k < jobs; k++) close(to_w[k][1]);
+
+    int failed = 0;
+    for (int k = 0; k <= jobs; k++) {
+        int status = 0;
+        if (waitpid(pids[k], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = 1;
+    }
+    if (failed) {
+        const char msg[] = "error: child exited with error\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
 
 // --- Основная логика программы ---
 
 int main(int argc, char **argv) {
+    // --- Этап 0: Разбор аргументов ---
+    // -j N: N клиентов вместо одного (см. serve_jobs).
+    // --proxy: всегда пересылать ввод через буфер сервера (для сравнения).
+    // --io: uring (по умолчанию, без io_uring — epoll), epoll или sync —
+    // прежняя пересылка в два этапа (см. sum-io.h).
+    int jobs = 1;
+    int proxy = 0;
+    int io = IO_URING;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--proxy") == 0) {
+            proxy = 1;
+        } else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (strcmp(m, "uring") == 0) io = IO_URING;
+            else if (strcmp(m, "epoll") == 0) io = IO_EPOLL;
+            else if (strcmp(m, "sync") == 0) io = IO_SYNC;
+            else {
+                jobs = 0;
+                break;
+            }
+        } else {
+            jobs = 0;
+            break;
+        }
+    }
+    if (jobs < 1 || jobs > MAX_JOBS) {
+        const char msg[] = "usage: sum-server [-j N] [--proxy] [--io uring|epoll|sync], N in 1..64\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return EXIT_FAILURE;
+    }
+    // Если клиент ушёл, запись в его канал вернёт EPIPE, а не убьёт сервер
+    signal(SIGPIPE, SIG_IGN);
+
     // --- Этап 1: Чтение имени файла для вывода ---
     // Сервер ожидает, что первая строка, полученная из стандартного ввода,
     // будет содержать имя файла, в который клиент запишет результат.
     char filename[1024];
-    int rl = read_line(STDIN_FILENO, filename, sizeof(filename));
-    if (rl <= 0) {
+    char head[4096];
+    size_t fill = 0, line_len = 0;
+    if (read_first_line(STDIN_FILENO, head, sizeof(head), sizeof(filename), &fill, &line_len) <= 0) {
         const char msg[] = "error: expected output filename on first line\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
         return EXIT_FAILURE;
     }
+    memcpy(filename, head, line_len);
+    filename[line_len] = '\0';
     // Убираем символ новой строки ('\n') с конца имени файла.
-    if (filename[rl-1] == '\n') filename[rl-1] = '\0';
+    if (filename[line_len-1] == '\n') filename[line_len-1] = '\0';
+    const char *extra = head + line_len;
+    size_t extra_len = fill - line_len;
+
+    // Обычный файл: прочитанное сверх первой строки возвращается lseek'ом,
+    // и клиент читает файл сам через унаследованный stdin — без канала
+    // и без сервера на пути данных.
+    struct stat st;
+    int handoff = !proxy && fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) &&
+                  lseek(STDIN_FILENO, -(off_t)extra_len, SEEK_CUR) != -1;
+    if (handoff) extra_len = 0;
+
+    if (jobs > 1) return serve_jobs(filename, jobs, extra, extra_len);
 
     // --- Этап 2: Создание каналов для межпроцессного взаимодействия ---
     // p2c: parent-to-child (родитель -> ребенок)
@@ -107,8 +431,9 @@ int main(int argc, char **argv) {
     // --- Логика дочернего процесса ---
     if (child == 0) {
         // --- Этап 3.1: Перенаправление стандартных потоков ввода/вывода ---
-        // Стандартный ввод дочернего процесса (stdin) перенаправляем на чтение из канала p2c.
-        if (dup2(p2c[0], STDIN_FILENO) == -1) _exit(EXIT_FAILURE);
+        // Стандартный ввод дочернего процесса (stdin) перенаправляем на чтение из канала p2c,
+        // если только он не читает файл сам.
+        if (!handoff && dup2(p2c[0], STDIN_FILENO) == -1) _exit(EXIT_FAILURE);
         // Стандартный вывод (stdout) перенаправляем на запись в канал c2p.
         if (dup2(c2p[1], STDOUT_FILENO) == -1) _exit(EXIT_FAILURE);
         
@@ -139,34 +464,50 @@ int main(int argc, char **argv) {
     // Родитель читает из c2p, поэтому закрывает конец для записи.
     close(c2p[1]);
 
-    // --- Этап 4.2: Пересылка данных из stdin в дочерний процесс ---
-    char buf[4096];
-    for (;;) {
-        ssize_t r = read(STDIN_FILENO, buf, sizeof(buf));
-        if (r < 0) {
-            if (errno == EINTR) continue;
-            const char msg[] = "error: failed to read from stdin\n";
-            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-            break;
-        }
-        // Если достигнут конец ввода, выходим из цикла.
-        if (r == 0) break;
-        // Записываем прочитанные данные в канал, ведущий к дочернему процессу.
-        write_all(p2c[1], buf, (size_t)r);
+    // --- Этап 4.2: Пересылка stdin клиенту и его stdout на наш stdout ---
+    // Оба потока идут одновременно (sum-io.h): клиент, пишущий в stdout,
+    // не ждёт на полном канале, пока сервер досылает ему ввод.
+    io_stream_t streams[IO_MAX_STREAMS];
+    int n = 0;
+    if (io != IO_SYNC) {
+        // При передаче файла клиенту пересылать нечего.
+        if (!handoff)
+            io_stream_init(&streams[n++], STDIN_FILENO, p2c[1], 1, !proxy, "error: failed to read from stdin\n",
+                           "error: failed to write to client\n");
+        io_stream_init(&streams[n++], c2p[0], STDOUT_FILENO, 0, !proxy, "error: failed to read from client\n",
+                       "error: failed to write to stdout\n");
+        // без памяти под буферы — по-старому
+        for (int k = 0; k < n; k++)
+            if (!streams[k].buf) io = IO_SYNC;
+        if (io == IO_SYNC)
+            for (int k = 0; k < n; k++) free(streams[k].buf);
     }
-    // Закрываем конец для записи в канал p2c. Это пошлет сигнал EOF дочернему процессу.
-    close(p2c[1]);
+    if (io != IO_SYNC) {
+        if (!handoff) {
+            io_stream_prefix(&streams[0], extra, extra_len);
+            fcntl(p2c[1], F_SETFL, O_NONBLOCK);
+        } else {
+            close(p2c[1]);
+        }
+        fcntl(c2p[0], F_SETFL, O_NONBLOCK);
+        io_pump(streams, n, io);
+    } else {
+        if (!handoff) forward_input(p2c[1], extra, extra_len, proxy);
+        // Закрываем конец для записи в канал p2c. Это пошлет сигнал EOF дочернему процессу.
+        close(p2c[1]);
 
-    // --- Этап 4.3: Чтение результата от дочернего процесса и вывод в stdout ---
-    for (;;) {
-        ssize_t r = read(c2p[0], buf, sizeof(buf));
-        if (r < 0) {
-            if (errno == EINTR) continue;
-            break;
+        // Чтение результата от дочернего процесса и вывод в stdout
+        char buf[4096];
+        for (;;) {
+            ssize_t r = read(c2p[0], buf, sizeof(buf));
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (r == 0) break; // Дочерний процесс закрыл свой конец канала.
+            // Выводим полученные данные на стандартный вывод.
+            write_all(STDOUT_FILENO, buf, (size_t)r);
         }
-        if (r == 0) break; // Дочерний процесс закрыл свой конец канала.
-        // Выводим полученные данные на стандартный вывод.
-        write_all(STDOUT_FILENO, buf, (size_t)r);
     }
     // Закрываем конец для чтения из канала c2p.
     close(c2p[0]);
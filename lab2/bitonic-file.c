@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bitonic.h"
+
+// Sorts a binary file of keys in place through a shared mapping, or writes
+// one with --gen. Records of --record S bytes are sorted by the uint32 at
+// their start with the generic bitonic_sort.
+
+enum { T_I32, T_U32, T_U64, T_FLOAT, T_KV, T_RECORD };
+static const char *const type_names[] = { "i32", "u32", "u64", "float", "kv", "record" };
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t splitmix(uint64_t *s) {
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uint32_t record_key(const void *elem) {
+    uint32_t k;
+    memcpy(&k, elem, sizeof(k));
+    return k;
+}
+
+static int is_sorted(const void *p, size_t n, int type, size_t esize) {
+    for (size_t i = 1; i < n; i++) {
+        int bad;
+        switch (type) {
+        case T_I32: bad = ((const int32_t *)p)[i - 1] > ((const int32_t *)p)[i]; break;
+        case T_U32: bad = ((const uint32_t *)p)[i - 1] > ((const uint32_t *)p)[i]; break;
+        case T_FLOAT: bad = ((const float *)p)[i - 1] > ((const float *)p)[i]; break;
+        case T_RECORD:
+            bad = record_key((const char *)p + (i - 1) * esize) > record_key((const char *)p + i * esize);
+            break;
+        default: bad = ((const uint64_t *)p)[i - 1] > ((const uint64_t *)p)[i]; break;
+        }
+        if (bad) return 0;
+    }
+    return 1;
+}
+
+// Writes n random elements; floats are finite, kv pairs get their index
+static int generate(const char *path, size_t n, int type, size_t esize, uint64_t seed) {
+    FILE *f = fopen(path, "wb");
+    if (!f) { perror(path); return -1; }
+    unsigned char buf[256];
+    for (size_t i = 0; i < n; i++) {
+        uint64_t r = splitmix(&seed);
+        if (type == T_FLOAT) {
+            float v = (float)((double)(int64_t)r / 1e9);
+            memcpy(buf, &v, sizeof(v));
+        } else if (type == T_KV) {
+            r = bitonic_kv_pack((uint32_t)(r >> 32), (uint32_t)i);
+            memcpy(buf, &r, sizeof(r));
+        } else if (type == T_RECORD) {
+            // key, then the index and filler as the payload
+            memset(buf, (int)(i & 0xFF), esize);
+            memcpy(buf, &r, sizeof(uint32_t));
+            if (esize >= 8) { uint32_t idx = (uint32_t)i; memcpy(buf + 4, &idx, sizeof(idx)); }
+        } else {
+            memcpy(buf, &r, esize);
+        }
+        if (fwrite(buf, esize, 1, f) != 1) { perror("fwrite"); fclose(f); return -1; }
+    }
+    if (fclose(f)) { perror("fclose"); return -1; }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s <file> [-t threads] [--type T] [--record S] [-c] [--kernel K] [--pin P]\n"
+        "       %s <file> --gen N [--type T] [--record S] [--seed N]\n"
+        "  --type T          i32 (default), u32, u64, float, kv (packed key << 32 | index)\n"
+        "  --record S        records of S bytes (4..256) sorted by their leading uint32\n"
+        "  --gen N           write N random elements instead of sorting\n"
+        "  -c                verify the result\n"
+        "  --kernel K        compare-exchange kernel: auto, scalar, avx2, avx512, neon\n"
+        "  --pin P           pin workers: none, compact, scatter\n",
+        prog, prog);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    int nthreads = 1, type = T_I32, verify = 0;
+    size_t esize = 4, gen = 0;
+    uint64_t seed = (uint64_t)time(NULL);
+    const char *kernel_name = NULL, *pin = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            nthreads = (int)strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--type") && i + 1 < argc) {
+            const char *t = argv[++i];
+            type = -1;
+            for (int k = 0; k < T_RECORD; k++) if (!strcmp(t, type_names[k])) type = k;
+            if (type < 0) { fprintf(stderr, "Unknown type: %s\n", t); return 1; }
+            esize = (type == T_U64 || type == T_KV) ? 8 : 4;
+        } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            type = T_RECORD;
+            esize = strtoull(argv[++i], NULL, 10);
+            if (esize < 4 || esize > 256) { fprintf(stderr, "Record size must be 4..256\n"); return 1; }
+        } else if (!strcmp(argv[i], "--gen") && i + 1 < argc) {
+            gen = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-c")) {
+            verify = 1;
+        } else if (!strcmp(argv[i], "--kernel") && i + 1 < argc) {
+            kernel_name = argv[++i];
+        } else if (!strcmp(argv[i], "--pin") && i + 1 < argc) {
+            pin = argv[++i];
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            usage(argv[0]);
+            return 0;
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "Unknown arg: %s\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path || nthreads < 1) { usage(argv[0]); return 1; }
+    if (gen) return generate(path, gen, type, esize, seed) ? 1 : 0;
+
+    if (kernel_name && bitonic_set_kernel(kernel_name)) {
+        fprintf(stderr, "Kernel %s is not available on this CPU\n", kernel_name);
+        return 1;
+    }
+    if (pin && bitonic_set_pin(pin)) { fprintf(stderr, "Bad pin policy: %s\n", pin); return 1; }
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0) { perror(path); return 1; }
+    struct stat st;
+    if (fstat(fd, &st)) { perror("fstat"); return 1; }
+    if ((size_t)st.st_size % esize) {
+        fprintf(stderr, "%s: size %lld is not a multiple of %zu\n", path, (long long)st.st_size, esize);
+        return 1;
+    }
+    size_t n = (size_t)st.st_size / esize;
+    if (n == 0) { printf("Empty file\n"); close(fd); return 0; }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) { perror("mmap"); return 1; }
+    close(fd);
+
+    uint64_t t0 = now_ns();
+    int rc;
+    switch (type) {
+    case T_I32: rc = bitonic_sort_i32((int32_t *)p, n, nthreads); break;
+    case T_U32: rc = bitonic_sort_u32((uint32_t *)p, n, nthreads); break;
+    case T_U64: rc = bitonic_sort_u64((uint64_t *)p, n, nthreads); break;
+    case T_FLOAT: rc = bitonic_sort_float((float *)p, n, nthreads); break;
+    case T_KV: rc = bitonic_sort_kv((uint64_t *)p, n, nthreads); break;
+    default: rc = bitonic_sort(p, n, esize, record_key, nthreads); break;
+    }
+    uint64_t t1 = now_ns();
+    if (rc) { perror("bitonic_sort"); return 1; }
+    if (msync(p, (size_t)st.st_size, MS_SYNC)) perror("msync");
+    uint64_t t2 = now_ns();
+
+    printf("Sorted: %s, n=%zu, type=%s, threads=%d, sort %.3f ms, msync %.3f ms\n", path, n,
+           type_names[type], nthreads, (double)(t1 - t0) / 1e6, (double)(t2 - t1) / 1e6);
+    if (verify) printf("Verify: %s\n", is_sorted(p, n, type, esize) ? "OK" : "FAIL");
+    munmap(p, (size_t)st.st_size);
+    return 0;
+}
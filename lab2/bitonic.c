@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
@@ -8,15 +9,21 @@
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include "bitonic.h"
+#include "trace.h"
 #ifdef MODE_ATOMIC
 #include <stdatomic.h>
-#include <sched.h>
 #endif
-
-#ifndef MODE_SYNC
-#ifndef MODE_ATOMIC
-#error "Define MODE_SYNC or MODE_ATOMIC via compiler flags"
+#ifdef MODE_SPIN
+#include <stdatomic.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #endif
+
+#if !defined(MODE_SYNC) && !defined(MODE_ATOMIC) && !defined(MODE_SPIN)
+#error "Define MODE_SYNC, MODE_ATOMIC or MODE_SPIN via compiler flags"
 #endif
 
 // -------------------- Utils --------------------
@@ -33,21 +40,6 @@ static size_t next_pow2(size_t n) {
     return n + 1;
 }
 
-static void print_thread_count() {
-    FILE *f = fopen("/proc/self/status", "r");
-    if (!f) { perror("fopen /proc/self/status"); return; }
-    char *line = NULL;
-    size_t cap = 0;
-    while (getline(&line, &cap, f) != -1) {
-        if (strncmp(line, "Threads:", 8) == 0) {
-            fputs(line, stdout);
-            break;
-        }
-    }
-    free(line);
-    fclose(f);
-}
-
 // -------------------- Barriers --------------------
 #ifdef MODE_SYNC
 
@@ -81,13 +73,19 @@ static void barrier_wait(barrier_t *b) {
         pthread_mutex_unlock(&b->m);
         return;
     }
+    int sleeps = 0;
     while (trip == b->trip) {
         pthread_cond_wait(&b->cv, &b->m);
+        sleeps++;
     }
     pthread_mutex_unlock(&b->m);
+    TRACE_VALUE("barrier_cond_waits", sleeps);
 }
 
-#else // MODE_ATOMIC
+static int select_barrier(const char *name) { return strcmp(name, "mutex") ? -1 : 0; }
+static inline const char *barrier_name(void) { return "mutex"; }
+
+#elif defined(MODE_ATOMIC)
 
 typedef struct {
     atomic_int count;
@@ -102,104 +100,1336 @@ static int barrier_init(barrier_t *b, int n) {
     return 0;
 }
 
+static void barrier_destroy(barrier_t *b) { (void)b; }
+
 static void barrier_wait_local(barrier_t *b, int *local_sense) {
     int ls = *local_sense;
     if (atomic_fetch_add_explicit(&b->count, 1, memory_order_acq_rel) == b->n - 1) {
         atomic_store_explicit(&b->count, 0, memory_order_release);
         atomic_store_explicit(&b->sense, !ls, memory_order_release);
     } else {
+        int yields = 0;
         while (atomic_load_explicit(&b->sense, memory_order_acquire) == ls) {
             sched_yield();
+            yields++;
         }
+        TRACE_VALUE("barrier_yields", yields);
     }
     *local_sense = !ls;
 }
 
+static int select_barrier(const char *name) { return strcmp(name, "atomic") ? -1 : 0; }
+static inline const char *barrier_name(void) { return "atomic"; }
+
+#else // MODE_SPIN
+
+// Bounded spin with a pause instruction, then a futex wait. Every word a
+// thread waits on holds an epoch that only grows and sits on its own cache
+// line next to the number of sleepers on it, so a release makes a syscall
+// only when somebody actually went to sleep. With more threads than CPUs the
+// thread we wait for cannot run while we spin, so then we park right away.
+#ifndef SPIN_LIMIT
+#define SPIN_LIMIT 4000
+#endif
+static int spin_limit = SPIN_LIMIT;
+#define CACHE_LINE 64
+#define TREE_FANIN 4
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_int epoch;
+    atomic_int sleepers;
+} flag_t;
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Waits until the flag reaches epoch, spinning up to spins times first
+static void flag_wait_spins(flag_t *f, int epoch, int spins) {
+    for (int i = 0; i < spins; i++) {
+        if (atomic_load_explicit(&f->epoch, memory_order_acquire) >= epoch) {
+            TRACE_VALUE("flag_spins", i);
+            return;
+        }
+        cpu_relax();
+    }
+    TRACE_VALUE("flag_spins", spins);
+    atomic_fetch_add(&f->sleepers, 1);
+    int v, sleeps = 0;
+    while ((v = atomic_load(&f->epoch)) < epoch) {
+        syscall(SYS_futex, &f->epoch, FUTEX_WAIT_PRIVATE, v, NULL, NULL, 0);
+        sleeps++;
+    }
+    atomic_fetch_sub(&f->sleepers, 1);
+    TRACE_VALUE("flag_futex_waits", sleeps);
+}
+
+static inline void flag_wait(flag_t *f, int epoch) { flag_wait_spins(f, epoch, spin_limit); }
+
+static void flag_set(flag_t *f, int epoch) {
+    // seq_cst store and load pair with the ones in flag_wait: either the
+    // sleeper sees the new epoch or we see the sleeper
+    atomic_store(&f->epoch, epoch);
+    if (atomic_load(&f->sleepers))
+        syscall(SYS_futex, &f->epoch, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+enum { BARRIER_CENTRAL, BARRIER_TREE, BARRIER_DISSEMINATION };
+static const char *const barrier_names[] = { "central", "tree", "dissemination" };
+static int barrier_kind = BARRIER_CENTRAL;
+
+typedef struct {
+    int n;
+    int kind;
+    int rounds;                             // dissemination: ceil(log2 n)
+    _Alignas(CACHE_LINE) atomic_int count;  // central: arrivals
+    flag_t release;                         // central: last released epoch
+    flag_t *arrive;                         // tree: subtree of thread t arrived
+    flag_t *wakeup;                         // tree: thread t released by its parent
+    flag_t *round;                          // dissemination: n * rounds signals
+} barrier_t;
+
+static flag_t *flags_alloc(size_t count) {
+    flag_t *f = (flag_t *)aligned_alloc(CACHE_LINE, (count ? count : 1) * sizeof(flag_t));
+    if (!f) return NULL;
+    for (size_t i = 0; i < count; i++) {
+        atomic_init(&f[i].epoch, 0);
+        atomic_init(&f[i].sleepers, 0);
+    }
+    return f;
+}
+
+static int barrier_init(barrier_t *b, int n) {
+    b->n = n;
+    b->kind = barrier_kind;
+    spin_limit = n > sysconf(_SC_NPROCESSORS_ONLN) ? 0 : SPIN_LIMIT;
+    b->rounds = 0;
+    while ((1 << b->rounds) < n) b->rounds++;
+    atomic_init(&b->count, 0);
+    atomic_init(&b->release.epoch, 0);
+    atomic_init(&b->release.sleepers, 0);
+    b->arrive = b->wakeup = b->round = NULL;
+    if (b->kind == BARRIER_TREE) {
+        b->arrive = flags_alloc((size_t)n);
+        b->wakeup = flags_alloc((size_t)n);
+        if (!b->arrive || !b->wakeup) return -1;
+    } else if (b->kind == BARRIER_DISSEMINATION) {
+        b->round = flags_alloc((size_t)n * (size_t)b->rounds);
+        if (!b->round) return -1;
+    }
+    return 0;
+}
+
+static void barrier_destroy(barrier_t *b) {
+    free(b->arrive);
+    free(b->wakeup);
+    free(b->round);
+}
+
+// local_epoch counts the barriers this thread has passed
+static void barrier_wait_spin(barrier_t *b, int tid, int *local_epoch) {
+    int e = ++*local_epoch;
+    if (b->kind == BARRIER_CENTRAL) {
+        if (atomic_fetch_add_explicit(&b->count, 1, memory_order_acq_rel) == b->n - 1) {
+            atomic_store_explicit(&b->count, 0, memory_order_relaxed);
+            flag_set(&b->release, e);
+        } else {
+            flag_wait(&b->release, e);
+        }
+    } else if (b->kind == BARRIER_TREE) {
+        // combining tree: children of t are TREE_FANIN * t + 1 .. + TREE_FANIN
+        int c0 = tid * TREE_FANIN + 1;
+        int c1 = c0 + TREE_FANIN < b->n ? c0 + TREE_FANIN : b->n;
+        for (int c = c0; c < c1; c++) flag_wait(&b->arrive[c], e);
+        if (tid) {
+            flag_set(&b->arrive[tid], e);
+            flag_wait(&b->wakeup[tid], e);
+        }
+        for (int c = c0; c < c1; c++) flag_set(&b->wakeup[c], e);
+    } else {
+        // round r: signal t + 2^r, wait for t - 2^r
+        for (int r = 0, d = 1; r < b->rounds; r++, d <<= 1) {
+            flag_set(&b->round[(size_t)((tid + d) % b->n) * (size_t)b->rounds + (size_t)r], e);
+            flag_wait(&b->round[(size_t)tid * (size_t)b->rounds + (size_t)r], e);
+        }
+    }
+}
+
+static int select_barrier(const char *name) {
+    for (int i = 0; i < (int)(sizeof(barrier_names) / sizeof(barrier_names[0])); i++)
+        if (!strcmp(name, barrier_names[i])) { barrier_kind = i; return 0; }
+    return -1;
+}
+static inline const char *barrier_name(void) { return barrier_names[barrier_kind]; }
+
+#endif
+
+// -------------------- Input and placement --------------------
+// Key i of the input: splitmix64 of seed and i, so every worker generates
+// (and first-touches) its own part of the array in parallel
+static inline int input_key(uint64_t seed, size_t i) {
+    uint64_t z = seed + (uint64_t)(i + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (int)(uint32_t)(z ^ (z >> 31));
+}
+
+enum { PIN_NONE, PIN_COMPACT, PIN_SCATTER };
+
+typedef struct {
+    int cpu;
+    int key[3];  // placement order, compared lexicographically
+} cpu_slot_t;
+
+static int read_topology(int cpu, const char *name) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int v = 0;
+    if (fscanf(f, "%d", &v) != 1) v = 0;
+    fclose(f);
+    return v;
+}
+
+static int slot_cmp(const void *x, const void *y) {
+    const cpu_slot_t *p = (const cpu_slot_t *)x, *q = (const cpu_slot_t *)y;
+    for (int i = 0; i < 3; i++)
+        if (p->key[i] != q->key[i]) return p->key[i] < q->key[i] ? -1 : 1;
+    return p->cpu - q->cpu;
+}
+
+// Fills cpus with the CPUs the process may run on, in the order threads are
+// placed on them: compact fills a socket core by core (SMT siblings next to
+// each other), scatter goes round the sockets and takes a second thread of
+// a core only when every core has one. Returns their number or -1.
+static int pin_order(int policy, int *cpus, int max) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set)) return -1;
+    cpu_slot_t *s = (cpu_slot_t *)calloc(CPU_SETSIZE, sizeof(cpu_slot_t));
+    if (!s) return -1;
+    int m = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &set)) continue;
+        int pkg = read_topology(cpu, "physical_package_id");
+        int core = read_topology(cpu, "core_id");
+        int smt = 0; // siblings of the same core seen so far
+        for (int i = 0; i < m; i++) {
+            int k = policy == PIN_COMPACT ? 0 : 2;
+            if (s[i].key[k] == pkg && s[i].key[1] == core) smt++;
+        }
+        s[m].cpu = cpu;
+        s[m].key[1] = core;
+        if (policy == PIN_COMPACT) { s[m].key[0] = pkg; s[m].key[2] = smt; }
+        else { s[m].key[0] = smt; s[m].key[2] = pkg; }
+        m++;
+    }
+    qsort(s, (size_t)m, sizeof(cpu_slot_t), slot_cmp);
+    if (m > max) m = max;
+    for (int i = 0; i < m; i++) cpus[i] = s[i].cpu;
+    free(s);
+    return m;
+}
+
+// -------------------- Compare-exchange kernels --------------------
+// The network is the one without directions: merge step k starts with a flip
+// sub-stage (i paired with its mirror i ^ (k - 1) in the block of k) and goes
+// on with half-cleaners (i paired with i + j). Every comparator puts the
+// smaller key at the lower index, so for n that is not a power of two the
+// missing keys behave like +inf at the end and comparators that reach n or
+// beyond are skipped.
+//
+// cmpx compares lo[t] with hi[t], cmpx_rev lo[t] with hi[-t] (the flip), for
+// t < len. net runs sub-stages jhi..jlo (all below the vector width) of step k
+// on the whole vectors of [b0, b1) in registers; b0 and b1 are multiples of
+// the width. There is a set of kernels for int32 keys and one for uint64
+// words; both are picked at start-up from the CPU features.
+typedef struct {
+    const char *name;
+    size_t esize;   // bytes per key
+    size_t width;   // lanes per vector; net is unused when 1
+    void (*cmpx)(void *lo, void *hi, size_t len);
+    void (*cmpx_rev)(void *lo, void *hi, size_t len);
+    void (*net)(void *a, size_t b0, size_t b1, size_t k, size_t jhi, size_t jlo);
+} kernel_t;
+
+static inline void compare_swap(int *x, int *y) {
+    int ai = *x;
+    int al = *y;
+    if (ai > al) {
+        *x = al;
+        *y = ai;
+    }
+}
+
+static void cmpx_scalar(void *lo_, void *hi_, size_t len) {
+    int *lo = (int *)lo_, *hi = (int *)hi_;
+    for (size_t t = 0; t < len; t++) compare_swap(&lo[t], &hi[t]);
+}
+
+static void cmpx_rev_scalar(void *lo_, void *hi_, size_t len) {
+    int *lo = (int *)lo_, *hi = (int *)hi_;
+    for (size_t t = 0; t < len; t++) compare_swap(&lo[t], hi - t);
+}
+
+static const kernel_t kernel_scalar = { "scalar", sizeof(int), 1, cmpx_scalar, cmpx_rev_scalar, NULL };
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static void cmpx_avx2(void *lo_, void *hi_, size_t len) {
+    int *lo = (int *)lo_, *hi = (int *)hi_;
+    size_t t = 0;
+    for (; t + 8 <= len; t += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(lo + t));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(hi + t));
+        _mm256_storeu_si256((__m256i *)(lo + t), _mm256_min_epi32(x, y));
+        _mm256_storeu_si256((__m256i *)(hi + t), _mm256_max_epi32(x, y));
+    }
+    cmpx_scalar(lo + t, hi + t, len - t);
+}
+
+__attribute__((target("avx2")))
+static void cmpx_rev_avx2(void *lo_, void *hi_, size_t len) {
+    int *lo = (int *)lo_, *hi = (int *)hi_;
+    const __m256i rev = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    size_t t = 0;
+    for (; t + 8 <= len; t += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(lo + t));
+        __m256i y = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(hi - t - 7)), rev);
+        _mm256_storeu_si256((__m256i *)(lo + t), _mm256_min_epi32(x, y));
+        _mm256_storeu_si256((__m256i *)(hi - t - 7), _mm256_permutevar8x32_epi32(_mm256_max_epi32(x, y), rev));
+    }
+    cmpx_rev_scalar(lo + t, hi - t, len - t);
+}
+
+// p holds the partner of every lane, the blend mask marks the lanes that keep the max
+#define AVX2_STEP(v, p, mask) do {                                       \
+        __m256i p_ = (p);                                                \
+        v = _mm256_blend_epi32(_mm256_min_epi32(v, p_), _mm256_max_epi32(v, p_), mask); \
+    } while (0)
+
+__attribute__((target("avx2")))
+static void net_avx2(void *a_, size_t b0, size_t b1, size_t k, size_t jhi, size_t jlo) {
+    int *a = (int *)a_;
+    const __m256i rev = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    for (size_t b = b0; b < b1; b += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(a + b));
+        if (jhi >= 4 && jlo <= 4)
+            AVX2_STEP(v, k == 8 ? _mm256_permutevar8x32_epi32(v, rev) : _mm256_permute2x128_si256(v, v, 1), 0xF0);
+        if (jhi >= 2 && jlo <= 2)
+            AVX2_STEP(v, k == 4 ? _mm256_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3))
+                                : _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)), 0xCC);
+        if (jlo <= 1) AVX2_STEP(v, _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)), 0xAA);
+        _mm256_storeu_si256((__m256i *)(a + b), v);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void cmpx_avx512(void *lo_, void *hi_, size_t len) {
+    int *lo = (int *)lo_, *hi = (int *)hi_;
+    size_t t = 0;
+    for (; t + 16 <= len; t += 16) {
+        __m512i x = _mm512_loadu_si512(lo + t);
+        __m512i y = _mm512_loadu_si512(hi + t);
+        _mm512_storeu_si512(lo + t, _mm512_min_epi32(x, y));
+        _mm512_storeu_si512(hi + t, _mm512_max_epi32(x, y));
+    }
+    cmpx_scalar(lo + t, hi + t, len - t);
+}
+
+__attribute__((target("avx512f")))
+static void cmpx_rev_avx512(void *lo_, void *hi_, size_t len) {
+    int *lo = (int *)lo_, *hi = (int *)hi_;
+    const __m512i rev = _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    size_t t = 0;
+    for (; t + 16 <= len; t += 16) {
+        __m512i x = _mm512_loadu_si512(lo + t);
+        __m512i y = _mm512_permutexvar_epi32(rev, _mm512_loadu_si512(hi - t - 15));
+        _mm512_storeu_si512(lo + t, _mm512_min_epi32(x, y));
+        _mm512_storeu_si512(hi - t - 15, _mm512_permutexvar_epi32(rev, _mm512_max_epi32(x, y)));
+    }
+    cmpx_rev_scalar(lo + t, hi - t, len - t);
+}
+
+#define AVX512_STEP(v, p, mask) do {                                     \
+        __m512i p_ = (p);                                                \
+        v = _mm512_mask_blend_epi32(mask, _mm512_min_epi32(v, p_), _mm512_max_epi32(v, p_)); \
+    } while (0)
+
+__attribute__((target("avx512f")))
+static void net_avx512(void *a_, size_t b0, size_t b1, size_t k, size_t jhi, size_t jlo) {
+    int *a = (int *)a_;
+    const __m512i rev16 = _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m512i rev8 = _mm512_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    for (size_t b = b0; b < b1; b += 16) {
+        __m512i v = _mm512_loadu_si512(a + b);
+        if (jhi >= 8 && jlo <= 8)
+            AVX512_STEP(v, k == 16 ? _mm512_permutexvar_epi32(rev16, v)
+                                   : _mm512_shuffle_i32x4(v, v, _MM_SHUFFLE(1, 0, 3, 2)), 0xFF00);
+        if (jhi >= 4 && jlo <= 4)
+            AVX512_STEP(v, k == 8 ? _mm512_permutexvar_epi32(rev8, v)
+                                  : _mm512_shuffle_i32x4(v, v, _MM_SHUFFLE(2, 3, 0, 1)), 0xF0F0);
+        if (jhi >= 2 && jlo <= 2)
+            AVX512_STEP(v, k == 4 ? _mm512_shuffle_epi32(v, _MM_PERM_ABCD)
+                                  : _mm512_shuffle_epi32(v, _MM_PERM_BADC), 0xCCCC);
+        if (jlo <= 1) AVX512_STEP(v, _mm512_shuffle_epi32(v, _MM_PERM_CDAB), 0xAAAA);
+        _mm512_storeu_si512(a + b, v);
+    }
+}
+
+static const kernel_t kernel_avx2 = { "avx2", sizeof(int), 8, cmpx_avx2, cmpx_rev_avx2, net_avx2 };
+static const kernel_t kernel_avx512 = { "avx512", sizeof(int), 16, cmpx_avx512, cmpx_rev_avx512, net_avx512 };
+#endif
+
+#ifdef __aarch64__
+#include <arm_neon.h>
+
+static inline int32x4_t neon_reverse(int32x4_t v) {
+    v = vrev64q_s32(v);
+    return vextq_s32(v, v, 2);
+}
+
+static void cmpx_neon(void *lo_, void *hi_, size_t len) {
+    int *lo = (int *)lo_, *hi = (int *)hi_;
+    size_t t = 0;
+    for (; t + 4 <= len; t += 4) {
+        int32x4_t x = vld1q_s32(lo + t), y = vld1q_s32(hi + t);
+        vst1q_s32(lo + t, vminq_s32(x, y));
+        vst1q_s32(hi + t, vmaxq_s32(x, y));
+    }
+    cmpx_scalar(lo + t, hi + t, len - t);
+}
+
+static void cmpx_rev_neon(void *lo_, void *hi_, size_t len) {
+    int *lo = (int *)lo_, *hi = (int *)hi_;
+    size_t t = 0;
+    for (; t + 4 <= len; t += 4) {
+        int32x4_t x = vld1q_s32(lo + t), y = neon_reverse(vld1q_s32(hi - t - 3));
+        vst1q_s32(lo + t, vminq_s32(x, y));
+        vst1q_s32(hi - t - 3, neon_reverse(vmaxq_s32(x, y)));
+    }
+    cmpx_rev_scalar(lo + t, hi - t, len - t);
+}
+
+static void net_neon(void *a_, size_t b0, size_t b1, size_t k, size_t jhi, size_t jlo) {
+    int *a = (int *)a_;
+    for (size_t b = b0; b < b1; b += 4) {
+        int32x4_t v = vld1q_s32(a + b);
+        if (jhi >= 2) {
+            int32x4_t p = k == 4 ? neon_reverse(v) : vextq_s32(v, v, 2);
+            v = vcombine_s32(vget_low_s32(vminq_s32(v, p)), vget_high_s32(vmaxq_s32(v, p)));
+        }
+        if (jlo <= 1) {
+            int32x4_t p = vrev64q_s32(v);
+            v = vtrn1q_s32(vminq_s32(v, p), vmaxq_s32(v, p));
+        }
+        vst1q_s32(a + b, v);
+    }
+}
+
+static const kernel_t kernel_neon = { "neon", sizeof(int), 4, cmpx_neon, cmpx_rev_neon, net_neon };
 #endif
 
+// 64-bit words (uint64, and the packed key/index pairs of the library)
+static inline void compare_swap64(uint64_t *x, uint64_t *y) {
+    uint64_t ai = *x;
+    uint64_t al = *y;
+    if (ai > al) {
+        *x = al;
+        *y = ai;
+    }
+}
+
+static void cmpx_scalar64(void *lo_, void *hi_, size_t len) {
+    uint64_t *lo = (uint64_t *)lo_, *hi = (uint64_t *)hi_;
+    for (size_t t = 0; t < len; t++) compare_swap64(&lo[t], &hi[t]);
+}
+
+static void cmpx_rev_scalar64(void *lo_, void *hi_, size_t len) {
+    uint64_t *lo = (uint64_t *)lo_, *hi = (uint64_t *)hi_;
+    for (size_t t = 0; t < len; t++) compare_swap64(&lo[t], hi - t);
+}
+
+static const kernel_t kernel_scalar64 = { "scalar", sizeof(uint64_t), 1, cmpx_scalar64, cmpx_rev_scalar64, NULL };
+
+#if defined(__x86_64__) || defined(__i386__)
+// AVX2 has no unsigned 64-bit min/max: compare with the sign bit flipped
+__attribute__((target("avx2")))
+static inline __m256i gt_epu64_avx2(__m256i x, __m256i y) {
+    const __m256i bias = _mm256_set1_epi64x((long long)0x8000000000000000ull);
+    return _mm256_cmpgt_epi64(_mm256_xor_si256(x, bias), _mm256_xor_si256(y, bias));
+}
+
+__attribute__((target("avx2")))
+static void cmpx_avx2_64(void *lo_, void *hi_, size_t len) {
+    uint64_t *lo = (uint64_t *)lo_, *hi = (uint64_t *)hi_;
+    size_t t = 0;
+    for (; t + 4 <= len; t += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(lo + t));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(hi + t));
+        __m256i gt = gt_epu64_avx2(x, y);
+        _mm256_storeu_si256((__m256i *)(lo + t), _mm256_blendv_epi8(x, y, gt));
+        _mm256_storeu_si256((__m256i *)(hi + t), _mm256_blendv_epi8(y, x, gt));
+    }
+    cmpx_scalar64(lo + t, hi + t, len - t);
+}
+
+__attribute__((target("avx2")))
+static void cmpx_rev_avx2_64(void *lo_, void *hi_, size_t len) {
+    uint64_t *lo = (uint64_t *)lo_, *hi = (uint64_t *)hi_;
+    size_t t = 0;
+    for (; t + 4 <= len; t += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(lo + t));
+        __m256i y = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(hi - t - 3)), _MM_SHUFFLE(0, 1, 2, 3));
+        __m256i gt = gt_epu64_avx2(x, y);
+        _mm256_storeu_si256((__m256i *)(lo + t), _mm256_blendv_epi8(x, y, gt));
+        _mm256_storeu_si256((__m256i *)(hi - t - 3),
+                            _mm256_permute4x64_epi64(_mm256_blendv_epi8(y, x, gt), _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+    cmpx_rev_scalar64(lo + t, hi - t, len - t);
+}
+
+// the 32-bit blend mask marks both halves of the lanes that keep the max
+#define AVX2_STEP64(v, p, mask) do {                                     \
+        __m256i p_ = (p), gt_ = gt_epu64_avx2(v, p_);                    \
+        v = _mm256_blend_epi32(_mm256_blendv_epi8(v, p_, gt_), _mm256_blendv_epi8(p_, v, gt_), mask); \
+    } while (0)
+
+__attribute__((target("avx2")))
+static void net_avx2_64(void *a_, size_t b0, size_t b1, size_t k, size_t jhi, size_t jlo) {
+    uint64_t *a = (uint64_t *)a_;
+    for (size_t b = b0; b < b1; b += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(a + b));
+        if (jhi >= 2)
+            AVX2_STEP64(v, k == 4 ? _mm256_permute4x64_epi64(v, _MM_SHUFFLE(0, 1, 2, 3))
+                                  : _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2)), 0xF0);
+        if (jlo <= 1) AVX2_STEP64(v, _mm256_permute4x64_epi64(v, _MM_SHUFFLE(2, 3, 0, 1)), 0xCC);
+        _mm256_storeu_si256((__m256i *)(a + b), v);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void cmpx_avx512_64(void *lo_, void *hi_, size_t len) {
+    uint64_t *lo = (uint64_t *)lo_, *hi = (uint64_t *)hi_;
+    size_t t = 0;
+    for (; t + 8 <= len; t += 8) {
+        __m512i x = _mm512_loadu_si512(lo + t);
+        __m512i y = _mm512_loadu_si512(hi + t);
+        _mm512_storeu_si512(lo + t, _mm512_min_epu64(x, y));
+        _mm512_storeu_si512(hi + t, _mm512_max_epu64(x, y));
+    }
+    cmpx_scalar64(lo + t, hi + t, len - t);
+}
+
+__attribute__((target("avx512f")))
+static void cmpx_rev_avx512_64(void *lo_, void *hi_, size_t len) {
+    uint64_t *lo = (uint64_t *)lo_, *hi = (uint64_t *)hi_;
+    const __m512i rev = _mm512_setr_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    size_t t = 0;
+    for (; t + 8 <= len; t += 8) {
+        __m512i x = _mm512_loadu_si512(lo + t);
+        __m512i y = _mm512_permutexvar_epi64(rev, _mm512_loadu_si512(hi - t - 7));
+        _mm512_storeu_si512(lo + t, _mm512_min_epu64(x, y));
+        _mm512_storeu_si512(hi - t - 7, _mm512_permutexvar_epi64(rev, _mm512_max_epu64(x, y)));
+    }
+    cmpx_rev_scalar64(lo + t, hi - t, len - t);
+}
+
+#define AVX512_STEP64(v, p, mask) do {                                   \
+        __m512i p_ = (p);                                                \
+        v = _mm512_mask_blend_epi64(mask, _mm512_min_epu64(v, p_), _mm512_max_epu64(v, p_)); \
+    } while (0)
+
+__attribute__((target("avx512f")))
+static void net_avx512_64(void *a_, size_t b0, size_t b1, size_t k, size_t jhi, size_t jlo) {
+    uint64_t *a = (uint64_t *)a_;
+    const __m512i rev8 = _mm512_setr_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m512i rev4 = _mm512_setr_epi64(3, 2, 1, 0, 7, 6, 5, 4);
+    for (size_t b = b0; b < b1; b += 8) {
+        __m512i v = _mm512_loadu_si512(a + b);
+        if (jhi >= 4 && jlo <= 4)
+            AVX512_STEP64(v, k == 8 ? _mm512_permutexvar_epi64(rev8, v)
+                                    : _mm512_shuffle_i64x2(v, v, _MM_SHUFFLE(1, 0, 3, 2)), 0xF0);
+        if (jhi >= 2 && jlo <= 2)
+            AVX512_STEP64(v, k == 4 ? _mm512_permutexvar_epi64(rev4, v)
+                                    : _mm512_permutex_epi64(v, _MM_SHUFFLE(1, 0, 3, 2)), 0xCC);
+        if (jlo <= 1) AVX512_STEP64(v, _mm512_permutex_epi64(v, _MM_SHUFFLE(2, 3, 0, 1)), 0xAA);
+        _mm512_storeu_si512(a + b, v);
+    }
+}
+
+static const kernel_t kernel_avx2_64 = { "avx2", sizeof(uint64_t), 4, cmpx_avx2_64, cmpx_rev_avx2_64, net_avx2_64 };
+static const kernel_t kernel_avx512_64 = { "avx512", sizeof(uint64_t), 8, cmpx_avx512_64, cmpx_rev_avx512_64, net_avx512_64 };
+#endif
+
+#ifdef __aarch64__
+static void cmpx_neon64(void *lo_, void *hi_, size_t len) {
+    uint64_t *lo = (uint64_t *)lo_, *hi = (uint64_t *)hi_;
+    size_t t = 0;
+    for (; t + 2 <= len; t += 2) {
+        uint64x2_t x = vld1q_u64(lo + t), y = vld1q_u64(hi + t);
+        uint64x2_t gt = vcgtq_u64(x, y);
+        vst1q_u64(lo + t, vbslq_u64(gt, y, x));
+        vst1q_u64(hi + t, vbslq_u64(gt, x, y));
+    }
+    cmpx_scalar64(lo + t, hi + t, len - t);
+}
+
+static void cmpx_rev_neon64(void *lo_, void *hi_, size_t len) {
+    uint64_t *lo = (uint64_t *)lo_, *hi = (uint64_t *)hi_;
+    size_t t = 0;
+    for (; t + 2 <= len; t += 2) {
+        uint64x2_t x = vld1q_u64(lo + t), y = vld1q_u64(hi - t - 1);
+        y = vextq_u64(y, y, 1);
+        uint64x2_t gt = vcgtq_u64(x, y);
+        uint64x2_t mx = vbslq_u64(gt, x, y);
+        vst1q_u64(lo + t, vbslq_u64(gt, y, x));
+        vst1q_u64(hi - t - 1, vextq_u64(mx, mx, 1));
+    }
+    cmpx_rev_scalar64(lo + t, hi - t, len - t);
+}
+
+// two lanes only: the small strides stay scalar
+static const kernel_t kernel_neon64 = { "neon", sizeof(uint64_t), 1, cmpx_neon64, cmpx_rev_neon64, NULL };
+#endif
+
+static const kernel_t *kernel = &kernel_scalar;
+static const kernel_t *kernel64 = &kernel_scalar64;
+
+// name is "auto" or one of the kernels; returns -1 if it is not usable here
+static int select_kernel(const char *name) {
+    int any = !strcmp(name, "auto");
+    if (!strcmp(name, "scalar")) { kernel = &kernel_scalar; kernel64 = &kernel_scalar64; return 0; }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if ((any || !strcmp(name, "avx512")) && __builtin_cpu_supports("avx512f")) {
+        kernel = &kernel_avx512;
+        kernel64 = &kernel_avx512_64;
+        return 0;
+    }
+    if ((any || !strcmp(name, "avx2")) && __builtin_cpu_supports("avx2")) {
+        kernel = &kernel_avx2;
+        kernel64 = &kernel_avx2_64;
+        return 0;
+    }
+#endif
+#ifdef __aarch64__
+    if (any || !strcmp(name, "neon")) { kernel = &kernel_neon; kernel64 = &kernel_neon64; return 0; }
+#endif
+    if (any) { kernel = &kernel_scalar; kernel64 = &kernel_scalar64; return 0; }
+    return -1;
+}
+
 // -------------------- Sort context --------------------
+// One sort job; the same fields are copied into the worker contexts
+typedef struct {
+    size_t n, np2;
+    int nthreads;     // workers that take part, at most the pool size
+    size_t tile;
+    int hybrid;
+    int *tmp;
+    uint64_t seed;
+    const kernel_t *kern;
+    int keymap;
+} sort_opts_t;
+
+struct pool;
+
 typedef struct {
-    int *a;
-    size_t n;         // original size
-    size_t np2;       // padded size (power of two)
+    void *a;
+    const kernel_t *kern; // int32 or uint64 keys
+    size_t n;         // number of keys, any
+    size_t np2;       // n rounded up to a power of two, bounds the merge steps
     int tid;
     int nthreads;
-#ifdef MODE_ATOMIC
-    barrier_t *stage_barrier;
-    // atomic start flag for starting work
-    _Atomic bool *start_flag;
-#else
-    barrier_t *start_barrier;
+    size_t tile;      // blocked mode tile (power of two), 0 = off
+    int hybrid;       // local radix sort + bitonic merge of chunks
+    int *tmp;         // n ints of scratch space for the hybrid mode
+    int keymap;       // KEYMAP_* applied to the keys before and after the sort
+    uint64_t seed;    // input_key seed
+    size_t barriers;  // stage barriers passed by this thread
+    uint64_t wait_ns; // time spent in them
     barrier_t *stage_barrier;
-#endif
+    int sense;        // barrier sense or epoch, kept from job to job
+    struct pool *pool;
 } worker_ctx_t;
 
 // -------------------- Bitonic worker --------------------
-static inline void compare_swap(int *a, size_t i, size_t l, int ascend) {
-    int ai = a[i];
-    int al = a[l];
-    if ((ai > al) == ascend) {
-        a[i] = al;
-        a[l] = ai;
+// Sub-stage j of merge step k over [start, end) of a[0..n): every i with
+// bit j clear is the lower end of a comparator. Such i come in runs of up
+// to j indices; a run is cut where the partner reaches n. Keys are kn->esize
+// bytes each.
+static void stage_runs(const kernel_t *kn, void *a, size_t n, size_t start, size_t end, size_t k, size_t j) {
+    char *base = (char *)a;
+    size_t es = kn->esize;
+    int flip = (j == k >> 1);
+    for (size_t i = start; i < end; ) {
+        size_t run_end = (i | (j - 1)) + 1; // next multiple of j
+        if (run_end > end) run_end = end;
+        if (!(i & j)) {
+            if (flip) {
+                // partners i ^ (k - 1) go down by one per step
+                size_t first = i, l = i ^ (k - 1);
+                if (l >= n) first += l - (n - 1);
+                if (first < run_end)
+                    kn->cmpx_rev(base + first * es, base + (first ^ (k - 1)) * es, run_end - first);
+            } else {
+                size_t last = n > j ? n - j : 0; // i + j < n
+                if (last > run_end) last = run_end;
+                if (i < last) kn->cmpx(base + i * es, base + (i + j) * es, last - i);
+            }
+        }
+        i = run_end;
     }
 }
 
-static void *worker_fn(void *arg) {
-    worker_ctx_t *w = (worker_ctx_t *)arg;
-#ifdef MODE_ATOMIC
-    int local_sense = 0;
-    // wait for start
-    while (!atomic_load_explicit(w->start_flag, memory_order_acquire)) {
-        sched_yield();
+static void stage_range(const kernel_t *kn, void *a, size_t n, size_t start, size_t end, size_t k, size_t j) {
+    size_t W = kn->width;
+    if (j < W) {
+        // in-register network on the whole vectors of the range
+        size_t b0 = (start + W - 1) & ~(W - 1), b1 = end & ~(W - 1);
+        if (b0 < b1) {
+            stage_runs(kn, a, n, start, b0, k, j);
+            kn->net(a, b0, b1, k, j, j);
+            stage_runs(kn, a, n, b1, end, k, j);
+            return;
+        }
+    }
+    stage_runs(kn, a, n, start, end, k, j);
+}
+
+// Sub-stages j, j/2, ..., 1 of merge step k on [lo, lo + len); lo is a
+// multiple of 2j and len too unless the range ends at n, so comparators never
+// leave the range
+static void local_stages(const kernel_t *kn, void *a, size_t n, size_t lo, size_t len, size_t k, size_t j) {
+    size_t W = kn->width;
+    for (; j > 0; j >>= 1) {
+        if (j < W && !(lo % W)) {
+            // all the small strides at once, one load and store per vector;
+            // a partial vector at n goes stage by stage
+            size_t vend = lo + (len & ~(W - 1));
+            if (lo < vend) kn->net(a, lo, vend, k, j, 1);
+            for (; j > 0; j >>= 1) stage_runs(kn, a, n, vend, lo + len, k, j);
+            return;
+        }
+        stage_runs(kn, a, n, lo, lo + len, k, j);
     }
+}
+
+// One sub-stage over the thread's index range
+static void global_stage(worker_ctx_t *w, size_t start, size_t end, size_t k, size_t j) {
+    stage_range(w->kern, w->a, w->n, start, end, k, j);
+}
+
+static void stage_wait(worker_ctx_t *w, int *local_sense) {
+    uint64_t t0 = now_ns();
+    TRACE_BEGIN(trace_t0);
+#if defined(MODE_ATOMIC)
+    barrier_wait_local(w->stage_barrier, local_sense);
+#elif defined(MODE_SPIN)
+    barrier_wait_spin(w->stage_barrier, w->tid, local_sense);
 #else
-    // sync start with main for optional pause/demo
-    barrier_wait(w->start_barrier);
+    (void)local_sense;
+    barrier_wait(w->stage_barrier);
 #endif
+    TRACE_END("barrier_wait", trace_t0);
+    w->wait_ns += now_ns() - t0;
+    w->barriers++;
+}
 
-    size_t np2 = w->np2;
-    size_t chunk = np2 / (size_t)w->nthreads;
-    size_t start = (size_t)w->tid * chunk;
-    size_t end = (w->tid == w->nthreads - 1) ? np2 : start + chunk;
-    if (end > np2) end = np2;
+// Blocked mode: the array is cut into tiles, each thread owns a contiguous
+// run of them. Sub-stages with 2j <= tile stay inside a tile, so the thread
+// runs all of them on one tile before moving to the next one, with no
+// barrier in between. Only the sub-stages with larger strides sweep the
+// array and need a barrier each.
+static void blocked_sort(worker_ctx_t *w, size_t start, size_t end, int *local_sense) {
+    size_t n = w->n, np2 = w->np2;
+    size_t tile = w->tile < np2 ? w->tile : np2;
+    size_t ntiles = (n + tile - 1) / tile; // the last one may be short
+    size_t t0 = ntiles * (size_t)w->tid / (size_t)w->nthreads;
+    size_t t1 = ntiles * (size_t)(w->tid + 1) / (size_t)w->nthreads;
+
+    // merge steps up to the tile size never leave a tile
+    for (size_t t = t0; t < t1; t++) {
+        size_t len = n - t * tile < tile ? n - t * tile : tile;
+        for (size_t k = 2; k <= tile; k <<= 1)
+            local_stages(w->kern, w->a, n, t * tile, len, k, k >> 1);
+    }
+    stage_wait(w, local_sense);
+
+    for (size_t k = tile << 1; k <= np2; k <<= 1) {
+        for (size_t j = k >> 1; j >= tile; j >>= 1) {
+            global_stage(w, start, end, k, j);
+            stage_wait(w, local_sense);
+        }
+        for (size_t t = t0; t < t1; t++) {
+            size_t len = n - t * tile < tile ? n - t * tile : tile;
+            local_stages(w->kern, w->a, n, t * tile, len, k, tile >> 1);
+        }
+        stage_wait(w, local_sense);
+    }
+}
+
+// -------------------- Hybrid mode --------------------
+// LSD radix sort of a[0..m), 8 bits per pass; four passes leave the result
+// back in a. The sign bit is flipped so negative keys sort first.
+static void radix_sort(int *a, int *tmp, size_t m) {
+    uint32_t *src = (uint32_t *)a, *dst = (uint32_t *)tmp;
+    for (int shift = 0; shift < 32; shift += 8) {
+        size_t count[256] = {0};
+        for (size_t i = 0; i < m; i++) count[((src[i] ^ 0x80000000u) >> shift) & 0xFF]++;
+        size_t sum = 0;
+        for (int d = 0; d < 256; d++) { size_t c = count[d]; count[d] = sum; sum += c; }
+        for (size_t i = 0; i < m; i++) dst[count[((src[i] ^ 0x80000000u) >> shift) & 0xFF]++] = src[i];
+        uint32_t *t = src; src = dst; dst = t;
+    }
+}
+
+// The m smallest (merge_low) or largest (merge_high) elements of two sorted
+// runs x[0..mx) and y[0..my), in ascending order; m <= mx + my
+static void merge_low(const int *x, size_t mx, const int *y, size_t my, int *out, size_t m) {
+    size_t i = 0, j = 0;
+    for (size_t o = 0; o < m; o++)
+        out[o] = (j >= my || (i < mx && x[i] <= y[j])) ? x[i++] : y[j++];
+}
+
+static void merge_high(const int *x, size_t mx, const int *y, size_t my, int *out, size_t m) {
+    ptrdiff_t i = (ptrdiff_t)mx - 1, j = (ptrdiff_t)my - 1;
+    for (ptrdiff_t o = (ptrdiff_t)m - 1; o >= 0; o--)
+        out[o] = (j < 0 || (i >= 0 && x[i] >= y[j])) ? x[i--] : y[j--];
+}
+
+// Each thread sorts its chunk, then the same network runs over whole chunks
+// (nthreads is a power of two here): at every step chunk c meets its partner
+// and the lower of the two keeps the lower part of their merge, the upper
+// one the upper part, so the chunks stay sorted and only
+// log2(nthreads) * (log2(nthreads) + 1) / 2 merge steps need a barrier.
+// Chunks are ceil(n / nthreads) long, the last ones may be short or empty
+// (their missing keys act as +inf). Results alternate between a and tmp.
+static void hybrid_sort(worker_ctx_t *w, int *local_sense) {
+    size_t P = (size_t)w->nthreads, n = w->n;
+    size_t chunk = (n + P - 1) / P;
+    size_t c = (size_t)w->tid;
+    int *src = (int *)w->a, *dst = w->tmp;
+#define CHUNK_LEN(x) ((x) * chunk >= n ? 0 : (n - (x) * chunk < chunk ? n - (x) * chunk : chunk))
+    size_t mc = CHUNK_LEN(c);
 
-    for (size_t k = 2; k <= np2; k <<= 1) {
+    radix_sort(src + c * chunk, dst + c * chunk, mc);
+    stage_wait(w, local_sense);
+
+    for (size_t k = 2; k <= P; k <<= 1) {
         for (size_t j = k >> 1; j > 0; j >>= 1) {
-            // process range
-            for (size_t i = start; i < end; i++) {
-                size_t l = i ^ j;
-                if (l > i) {
-                    int ascend = ((i & k) == 0);
-                    compare_swap(w->a, i, l, ascend);
-                }
+            size_t p = (j == k >> 1) ? c ^ (k - 1) : c ^ j;
+            size_t mp = CHUNK_LEN(p);
+            if (c < p && mp == 0) memcpy(dst + c * chunk, src + c * chunk, mc * sizeof(int));
+            else if (c < p) merge_low(src + c * chunk, mc, src + p * chunk, mp, dst + c * chunk, mc);
+            else merge_high(src + c * chunk, mc, src + p * chunk, mp, dst + c * chunk, mc);
+            int *t = src; src = dst; dst = t;
+            stage_wait(w, local_sense);
+        }
+    }
+#undef CHUNK_LEN
+    if (src != w->a) memcpy((int *)w->a + c * chunk, src + c * chunk, mc * sizeof(int));
+}
+
+static inline size_t min_size(size_t x, size_t y) { return x < y ? x : y; }
+
+// uint32 and float keys are sorted as int32 after an order-preserving map;
+// both maps are their own inverse
+enum { KEYMAP_NONE, KEYMAP_U32, KEYMAP_FLOAT };
+
+static void map_keys(int *a, size_t lo, size_t hi, int keymap) {
+    if (keymap == KEYMAP_U32) {
+        for (size_t i = lo; i < hi; i++) a[i] ^= INT32_MIN;
+    } else if (keymap == KEYMAP_FLOAT) {
+        // negative floats order backwards in their low 31 bits
+        for (size_t i = lo; i < hi; i++) a[i] ^= (a[i] >> 31) & INT32_MAX;
+    }
+}
+
+// The part of the array the thread mostly works on: its chunk in the hybrid
+// mode, its tiles in the blocked mode, its index range otherwise
+static void own_range(const worker_ctx_t *w, size_t *lo, size_t *hi) {
+    size_t n = w->n, P = (size_t)w->nthreads, t = (size_t)w->tid;
+    if (w->hybrid) {
+        size_t chunk = (n + P - 1) / P;
+        *lo = min_size(t * chunk, n);
+        *hi = min_size(*lo + chunk, n);
+    } else if (w->tile) {
+        size_t tile = min_size(w->tile, w->np2);
+        size_t ntiles = (n + tile - 1) / tile;
+        *lo = min_size(ntiles * t / P * tile, n);
+        *hi = min_size(ntiles * (t + 1) / P * tile, n);
+    } else {
+        size_t chunk = n / P;
+        *lo = t * chunk;
+        *hi = (t == P - 1) ? n : *lo + chunk;
+    }
+}
+
+// JOB_FILL writes input_key into the int32 array, JOB_SORT sorts it
+enum { JOB_FILL, JOB_SORT, JOB_QUIT };
+
+// Runs the worker's part of a job. JOB_FILL generates this thread's part of
+// the input ahead of the timed sort: its pages get first touched, and
+// placed, by the thread that sorts them.
+static void run_job(worker_ctx_t *w, void *a, const sort_opts_t *o, int kind) {
+    w->a = a;
+    w->kern = o->kern;
+    w->n = o->n;
+    w->np2 = o->np2;
+    w->nthreads = o->nthreads;
+    w->tile = o->tile;
+    w->hybrid = o->hybrid;
+    w->tmp = o->tmp;
+    w->keymap = o->keymap;
+    w->seed = o->seed;
+    w->barriers = 0;
+    w->wait_ns = 0;
+
+    size_t lo, hi;
+    own_range(w, &lo, &hi);
+    if (kind == JOB_FILL) {
+        int *ia = (int *)a;
+        for (size_t i = lo; i < hi; i++) ia[i] = input_key(w->seed, i);
+        if (w->hybrid) memset(w->tmp + lo, 0, (hi - lo) * sizeof(int));
+        return;
+    }
+    if (w->keymap != KEYMAP_NONE) {
+        map_keys((int *)a, lo, hi, w->keymap);
+        stage_wait(w, &w->sense);
+    }
+
+    size_t n = w->n, np2 = w->np2;
+    size_t chunk = n / (size_t)w->nthreads;
+    size_t start = (size_t)w->tid * chunk;
+    size_t end = (w->tid == w->nthreads - 1) ? n : start + chunk;
+
+    if (w->hybrid) {
+        hybrid_sort(w, &w->sense);
+    } else if (w->tile) {
+        blocked_sort(w, start, end, &w->sense);
+    } else {
+        for (size_t k = 2; k <= np2; k <<= 1) {
+            for (size_t j = k >> 1; j > 0; j >>= 1) {
+                global_stage(w, start, end, k, j);
+                // barrier between stages
+                stage_wait(w, &w->sense);
             }
-            // barrier between stages
-#ifdef MODE_ATOMIC
-            barrier_wait_local(w->stage_barrier, &local_sense);
+        }
+    }
+    // every mode ends with a barrier, the keys are final
+    map_keys((int *)a, lo, hi, w->keymap);
+}
+
+// -------------------- Worker pool --------------------
+// Workers are created once and park between jobs. pool_submit publishes a
+// job and bumps the job generation, every worker runs its part (the ones
+// past the job's nthreads only report back) and the last one to finish
+// wakes the submitter. Parking uses the primitives of the mode: a condition
+// variable, a sched_yield loop, or a spin-then-futex flag.
+typedef struct pool {
+    int size;
+    pthread_t *ths;
+    worker_ctx_t *ctxs;
+    void *a;              // current job
+    sort_opts_t job;
+    int kind;
+    barrier_t stage_barrier;
+    int barrier_n;        // threads the barrier is set up for
+    unsigned gen;         // jobs submitted
+#ifdef MODE_SYNC
+    pthread_mutex_t m;
+    pthread_cond_t go;
+    pthread_cond_t done_cv;
+    int done;
+#elif defined(MODE_ATOMIC)
+    atomic_uint go;       // last submitted generation
+    atomic_int done;
+#else
+    flag_t go;            // epoch = generation
+    flag_t done_flag;     // epoch = last finished generation
+    atomic_int done;
+    int spins;            // 0 when the workers and the submitter overcommit the CPUs
+#endif
+} pool_t;
+
+static void *pool_worker(void *arg) {
+    worker_ctx_t *w = (worker_ctx_t *)arg;
+    pool_t *p = w->pool;
+    unsigned seen = 0;
+    for (;;) {
+#ifdef MODE_SYNC
+        pthread_mutex_lock(&p->m);
+        while (p->gen == seen) pthread_cond_wait(&p->go, &p->m);
+        pthread_mutex_unlock(&p->m);
+#elif defined(MODE_ATOMIC)
+        while (atomic_load_explicit(&p->go, memory_order_acquire) == seen) sched_yield();
 #else
-            barrier_wait(w->stage_barrier);
+        flag_wait_spins(&p->go, (int)seen + 1, p->spins);
 #endif
+        seen++;
+        if (p->kind == JOB_QUIT) return NULL;
+        if (w->tid < p->job.nthreads) run_job(w, p->a, &p->job, p->kind);
+
+#ifdef MODE_SYNC
+        pthread_mutex_lock(&p->m);
+        if (++p->done == p->size) pthread_cond_signal(&p->done_cv);
+        pthread_mutex_unlock(&p->m);
+#elif defined(MODE_ATOMIC)
+        atomic_fetch_add_explicit(&p->done, 1, memory_order_release);
+#else
+        if (atomic_fetch_add_explicit(&p->done, 1, memory_order_acq_rel) == p->size - 1)
+            flag_set(&p->done_flag, (int)seen);
+#endif
+    }
+}
+
+// Called with the workers parked
+static void pool_submit(pool_t *p, void *a, const sort_opts_t *job, int kind) {
+    int nt = job ? job->nthreads : p->barrier_n;
+    if (nt != p->barrier_n) {
+        barrier_destroy(&p->stage_barrier);
+        if (barrier_init(&p->stage_barrier, nt)) { perror("barrier_init"); exit(1); }
+        p->barrier_n = nt;
+        for (int t = 0; t < p->size; t++) p->ctxs[t].sense = 0;
+    }
+    p->a = a;
+    if (job) p->job = *job;
+    p->kind = kind;
+#ifdef MODE_SYNC
+    pthread_mutex_lock(&p->m);
+    p->gen++;
+    p->done = 0;
+    pthread_cond_broadcast(&p->go);
+    pthread_mutex_unlock(&p->m);
+#elif defined(MODE_ATOMIC)
+    p->gen++;
+    atomic_store_explicit(&p->done, 0, memory_order_relaxed);
+    atomic_store_explicit(&p->go, p->gen, memory_order_release);
+#else
+    p->gen++;
+    atomic_store_explicit(&p->done, 0, memory_order_relaxed);
+    flag_set(&p->go, (int)p->gen);
+#endif
+}
+
+static void pool_wait(pool_t *p) {
+#ifdef MODE_SYNC
+    pthread_mutex_lock(&p->m);
+    while (p->done < p->size) pthread_cond_wait(&p->done_cv, &p->m);
+    pthread_mutex_unlock(&p->m);
+#elif defined(MODE_ATOMIC)
+    while (atomic_load_explicit(&p->done, memory_order_acquire) < p->size) sched_yield();
+#else
+    flag_wait_spins(&p->done_flag, (int)p->gen, p->spins);
+#endif
+}
+
+static void pool_run(pool_t *p, void *a, const sort_opts_t *job, int kind) {
+    pool_submit(p, a, job, kind);
+    pool_wait(p);
+}
+
+static void pool_destroy(pool_t *p) {
+    if (!p) return;
+    pool_submit(p, NULL, NULL, JOB_QUIT);
+    for (int t = 0; t < p->size; t++) pthread_join(p->ths[t], NULL);
+    barrier_destroy(&p->stage_barrier);
+#ifdef MODE_SYNC
+    pthread_mutex_destroy(&p->m);
+    pthread_cond_destroy(&p->go);
+    pthread_cond_destroy(&p->done_cv);
+#endif
+    free(p->ths);
+    free(p->ctxs);
+    free(p);
+}
+
+// Starts size workers, thread t pinned to cpus[t % ncpus] when ncpus > 0;
+// returns NULL on failure
+static pool_t *pool_create(int size, const int *cpus, int ncpus) {
+    pool_t *p = (pool_t *)aligned_alloc(_Alignof(pool_t), sizeof(pool_t));
+    if (!p) return NULL;
+    memset(p, 0, sizeof(*p));
+    p->ths = (pthread_t *)calloc((size_t)size, sizeof(pthread_t));
+    p->ctxs = (worker_ctx_t *)calloc((size_t)size, sizeof(worker_ctx_t));
+    if (!p->ths || !p->ctxs || barrier_init(&p->stage_barrier, size)) {
+        free(p->ths);
+        free(p->ctxs);
+        free(p);
+        return NULL;
+    }
+    p->barrier_n = size;
+#ifdef MODE_SYNC
+    pthread_mutex_init(&p->m, NULL);
+    pthread_cond_init(&p->go, NULL);
+    pthread_cond_init(&p->done_cv, NULL);
+#elif defined(MODE_ATOMIC)
+    atomic_init(&p->go, 0);
+    atomic_init(&p->done, 0);
+#else
+    atomic_init(&p->go.epoch, 0);
+    atomic_init(&p->go.sleepers, 0);
+    atomic_init(&p->done_flag.epoch, 0);
+    atomic_init(&p->done_flag.sleepers, 0);
+    atomic_init(&p->done, 0);
+    p->spins = size + 1 > sysconf(_SC_NPROCESSORS_ONLN) ? 0 : SPIN_LIMIT;
+#endif
+
+    for (int t = 0; t < size; ++t) {
+        p->ctxs[t].tid = t;
+        p->ctxs[t].pool = p;
+        p->ctxs[t].stage_barrier = &p->stage_barrier;
+        // set the affinity before the thread starts, so it first-touches its
+        // part of the array on its own node
+        pthread_attr_t attr, *pattr = NULL;
+        if (ncpus) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[t % ncpus], &set);
+            pthread_attr_init(&attr);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+            pattr = &attr;
+        }
+        int rc = pthread_create(&p->ths[t], pattr, pool_worker, &p->ctxs[t]);
+        if (pattr) pthread_attr_destroy(pattr);
+        if (rc) {
+            // the thread count drives the done count, stop the ones we have
+            p->size = t;
+            pool_destroy(p);
+            errno = rc;
+            return NULL;
+        }
+        p->size = t + 1;
+    }
+    return p;
+}
+
+// -------------------- Sort run --------------------
+// Sorts a on the pool; returns the time of the sort in ms, barriers and
+// wait_ms (if not NULL) get the barrier count and the barrier wait time of
+// every thread
+static double pool_sort(pool_t *p, void *a, const sort_opts_t *o, size_t *barriers, double *wait_ms) {
+    uint64_t t0 = now_ns();
+    pool_run(p, a, o, JOB_SORT);
+    uint64_t t1 = now_ns();
+    if (barriers) *barriers = p->ctxs[0].barriers;
+    if (wait_ms)
+        for (int t = 0; t < o->nthreads; ++t) wait_ms[t] = (double)p->ctxs[t].wait_ns / 1.0e6;
+    return (double)(t1 - t0) / 1.0e6;
+}
+
+// -------------------- Library API --------------------
+static pthread_once_t lib_once = PTHREAD_ONCE_INIT;
+static int lib_kernel_set;  // bitonic_set_kernel was called
+static int *lib_cpus, lib_ncpus;
+// Workers kept between calls; a call that finds the pool busy with another
+// one sorts on a pool of its own
+static pthread_mutex_t lib_lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_t *lib_pool;
+
+static void lib_init(void) {
+    if (!lib_kernel_set) select_kernel("auto");
+}
+
+// Sorts n int32 keys (wide = 0) or uint64 words (wide = 1) in the blocked
+// mode with 64 KiB tiles
+static int lib_sort(void *a, size_t n, int wide, int keymap, int nthreads) {
+    if (nthreads < 1 || (n && !a)) { errno = EINVAL; return -1; }
+    if (n < 2) return 0;
+    pthread_once(&lib_once, lib_init);
+    const kernel_t *kn = wide ? kernel64 : kernel;
+    if ((size_t)nthreads > n) nthreads = (int)n;
+    sort_opts_t o = { n, next_pow2(n), nthreads, 65536 / kn->esize, 0, NULL, 0, kn, keymap };
+
+    pool_t *p;
+    int shared = !pthread_mutex_trylock(&lib_lock);
+    if (shared) {
+        if (lib_pool && lib_pool->size < nthreads) {
+            pool_destroy(lib_pool);
+            lib_pool = NULL;
         }
+        if (!lib_pool) lib_pool = pool_create(nthreads, lib_cpus, lib_ncpus);
+        p = lib_pool;
+    } else {
+        p = pool_create(nthreads, lib_cpus, lib_ncpus);
+    }
+    if (!p) {
+        if (shared) pthread_mutex_unlock(&lib_lock);
+        return -1;
+    }
+    pool_sort(p, a, &o, NULL, NULL);
+    if (shared) pthread_mutex_unlock(&lib_lock);
+    else pool_destroy(p);
+    return 0;
+}
+
+// Drops the kept workers, the next sort starts new ones with the current
+// settings
+static void lib_reset(void) {
+    pthread_mutex_lock(&lib_lock);
+    pool_destroy(lib_pool);
+    lib_pool = NULL;
+    pthread_mutex_unlock(&lib_lock);
+}
+
+void bitonic_shutdown(void) { lib_reset(); }
+
+int bitonic_sort_i32(int32_t *a, size_t n, int nthreads) {
+    return lib_sort(a, n, 0, KEYMAP_NONE, nthreads);
+}
+
+int bitonic_sort_u32(uint32_t *a, size_t n, int nthreads) {
+    return lib_sort(a, n, 0, KEYMAP_U32, nthreads);
+}
+
+int bitonic_sort_float(float *a, size_t n, int nthreads) {
+    return lib_sort(a, n, 0, KEYMAP_FLOAT, nthreads);
+}
+
+int bitonic_sort_u64(uint64_t *a, size_t n, int nthreads) {
+    return lib_sort(a, n, 1, KEYMAP_NONE, nthreads);
+}
+
+int bitonic_sort_kv(uint64_t *kv, size_t n, int nthreads) {
+    return lib_sort(kv, n, 1, KEYMAP_NONE, nthreads);
+}
+
+int bitonic_sort(void *base, size_t n, size_t elem_size, bitonic_key_fn key, int nthreads) {
+    if (!key || !elem_size || n > (size_t)UINT32_MAX + 1) { errno = EINVAL; return -1; }
+    if (n < 2) return 0;
+    uint64_t *kv = (uint64_t *)malloc(n * sizeof(uint64_t));
+    char *out = (char *)malloc(n * elem_size);
+    if (!kv || !out) { free(kv); free(out); return -1; }
+    const char *src = (const char *)base;
+    for (size_t i = 0; i < n; i++) kv[i] = bitonic_kv_pack(key(src + i * elem_size), (uint32_t)i);
+    int rc = lib_sort(kv, n, 1, KEYMAP_NONE, nthreads);
+    if (!rc) {
+        for (size_t i = 0; i < n; i++)
+            memcpy(out + i * elem_size, src + (size_t)bitonic_kv_index(kv[i]) * elem_size, elem_size);
+        memcpy(base, out, n * elem_size);
     }
-    return NULL;
+    free(kv);
+    free(out);
+    return rc;
+}
+
+int bitonic_set_kernel(const char *name) {
+    if (select_kernel(name)) { errno = EINVAL; return -1; }
+    lib_kernel_set = 1;
+    return 0;
+}
+
+int bitonic_set_barrier(const char *name) {
+    if (select_barrier(name)) { errno = EINVAL; return -1; }
+    lib_reset();
+    return 0;
+}
+
+int bitonic_set_pin(const char *policy) {
+    int pin;
+    if (!strcmp(policy, "none")) pin = PIN_NONE;
+    else if (!strcmp(policy, "compact")) pin = PIN_COMPACT;
+    else if (!strcmp(policy, "scatter")) pin = PIN_SCATTER;
+    else { errno = EINVAL; return -1; }
+    lib_reset();
+    free(lib_cpus);
+    lib_cpus = NULL;
+    lib_ncpus = 0;
+    if (pin == PIN_NONE) return 0;
+    lib_cpus = (int *)calloc(CPU_SETSIZE, sizeof(int));
+    if (!lib_cpus) return -1;
+    lib_ncpus = pin_order(pin, lib_cpus, CPU_SETSIZE);
+    if (lib_ncpus <= 0) { free(lib_cpus); lib_cpus = NULL; lib_ncpus = 0; return -1; }
+    return 0;
 }
 
+#ifndef BITONIC_LIB
 // -------------------- CLI --------------------
+static void print_thread_count() {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f) { perror("fopen /proc/self/status"); return; }
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) != -1) {
+        if (strncmp(line, "Threads:", 8) == 0) {
+            fputs(line, stdout);
+            break;
+        }
+    }
+    free(line);
+    fclose(f);
+}
+
+static void print_wait(const double *wait_ms, int nthreads, double ms) {
+    double sum = 0;
+    for (int t = 0; t < nthreads; t++) sum += wait_ms[t];
+    printf("Wait: barrier=%s, avg %.3f ms (%.1f%% of the sort), per thread:", barrier_name(),
+           sum / nthreads, ms > 0 ? 100.0 * sum / nthreads / ms : 0.0);
+    for (int t = 0; t < nthreads; t++) printf(" %.3f", wait_ms[t]);
+    printf("\n");
+}
+
+static int cmp_double(const void *x, const void *y) {
+    double a = *(const double *)x, b = *(const double *)y;
+    return (a > b) - (a < b);
+}
+
+// Percentiles of the --repeat latencies, sorts lat
+static void print_latency(const char *what, double *lat, int count) {
+    qsort(lat, (size_t)count, sizeof(double), cmp_double);
+    const double ps[] = { 0.50, 0.90, 0.99 };
+    printf("Repeat: %s, %d sorts, ms:", what, count);
+    for (int i = 0; i < 3; i++) {
+        int k = (int)(ps[i] * count + 0.999999) - 1; // ceil(p * count) - 1
+        if (k < 0) k = 0;
+        printf(" p%d %.3f", (int)(ps[i] * 100), lat[k]);
+    }
+    printf(" max %.3f\n", lat[count - 1]);
+}
+
+static void print_verify(const int *a, size_t n) {
+    bool ok = true;
+    for (size_t i = 1; i < n; i++) if (a[i-1] > a[i]) { ok = false; break; }
+    printf("Verify: %s\n", ok ? "OK" : "FAIL");
+}
+
 static void usage(const char *prog) {
-#ifdef MODE_SYNC
+#if defined(MODE_SYNC)
     const char *mode = "sync";
-#else
+#elif defined(MODE_ATOMIC)
     const char *mode = "atomic";
+#else
+    const char *mode = "spin";
 #endif
     fprintf(stderr,
-        "Usage: %s -n <size> -t <threads> [-c] [--seed N] [--pause S] [--print-threads]\n"
+        "Usage: %s -n <size> -t <threads> [-c] [--seed N] [--pause S] [--print-threads] [--tile N] [--kernel K] [--hybrid] [--barrier B] [--pin P] [--repeat N]\n"
         "  mode: %s\n"
-        "  -n <size>         number of elements (will be padded to power of two)\n"
+        "  -n <size>         number of elements (any, no padding)\n"
         "  -t <threads>      number of worker threads (>=1)\n"
         "  -c                verify sort\n"
-        "  --seed N          RNG seed (default: time)\n"
+        "  --seed N          input seed (default: time)\n"
         "  --pause S         sleep S seconds after threads are created, before start\n"
-        "  --print-threads   print current Threads: count from /proc/self/status\n",
+        "  --print-threads   print current Threads: count from /proc/self/status\n"
+        "  --tile N          blocked mode with tiles of N elements (rounded down to a\n"
+        "                    power of two, e.g. 16384 = 64 KiB); 0 = off (default)\n"
+        "  --kernel K        compare-exchange kernel: auto (default), scalar, avx2,\n"
+        "                    avx512, neon\n"
+        "  --hybrid          also sort the same data with the hybrid mode (local radix\n"
+        "                    sort + bitonic merge of chunks) and print both times\n"
+        "  --barrier B       stage barrier of the spin mode: central (default), tree,\n"
+        "                    dissemination; sync and atomic have only their own one\n"
+        "  --pin P           pin workers: none (default), compact (fill a socket\n"
+        "                    core by core), scatter (round-robin over sockets)\n"
+        "  --repeat N        sort N more times on the kept workers and N times with\n"
+        "                    threads created per sort, print latency percentiles\n",
         prog, mode);
 }
 
@@ -210,6 +1440,12 @@ int main(int argc, char **argv) {
     int pause_sec = 0;
     unsigned seed = (unsigned)time(NULL);
     int print_threads = 0;
+    size_t tile = 0;
+    const char *kernel_name = "auto";
+    const char *barrier_arg = NULL;
+    int pin = PIN_NONE;
+    int hybrid = 0;
+    int repeat = 0;
 
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "-n") && i + 1 < argc) {
@@ -224,6 +1460,22 @@ int main(int argc, char **argv) {
             pause_sec = (int)strtol(argv[++i], NULL, 10);
         } else if (!strcmp(argv[i], "--print-threads")) {
             print_threads = 1;
+        } else if (!strcmp(argv[i], "--kernel") && i + 1 < argc) {
+            kernel_name = argv[++i];
+        } else if (!strcmp(argv[i], "--barrier") && i + 1 < argc) {
+            barrier_arg = argv[++i];
+        } else if (!strcmp(argv[i], "--pin") && i + 1 < argc) {
+            const char *p = argv[++i];
+            if (!strcmp(p, "compact")) pin = PIN_COMPACT;
+            else if (!strcmp(p, "scatter")) pin = PIN_SCATTER;
+            else if (!strcmp(p, "none")) pin = PIN_NONE;
+            else { fprintf(stderr, "Unknown pin policy: %s\n", p); return 1; }
+        } else if (!strcmp(argv[i], "--hybrid")) {
+            hybrid = 1;
+        } else if (!strcmp(argv[i], "--tile") && i + 1 < argc) {
+            tile = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            repeat = (int)strtol(argv[++i], NULL, 10);
         } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
             usage(argv[0]);
             return 0;
@@ -239,51 +1491,49 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    if (select_kernel(kernel_name)) {
+        fprintf(stderr, "Kernel %s is not available on this CPU\n", kernel_name);
+        return 1;
+    }
+    if (barrier_arg && select_barrier(barrier_arg)) {
+        fprintf(stderr, "Barrier %s is not available in this mode\n", barrier_arg);
+        return 1;
+    }
+
     size_t np2 = next_pow2(n);
-    int *a = (int *)malloc(np2 * sizeof(int));
+    if (tile) {
+        tile = next_pow2(tile + 1) >> 1; // round down
+        if (tile < 2) tile = 2;
+    }
+    // left untouched here: the workers fill it
+    int *a = (int *)malloc(n * sizeof(int));
     if (!a) { perror("malloc"); return 1; }
 
-    srand(seed);
-    for (size_t i = 0; i < n; i++) a[i] = (int)rand();
-    for (size_t i = n; i < np2; i++) a[i] = INT32_MAX; // padding
-
-    if (nthreads > (int)np2) nthreads = (int)np2; // cap threads
+    if ((size_t)nthreads > n) nthreads = (int)n; // cap threads
     if (nthreads < 1) nthreads = 1;
 
-    pthread_t *ths = (pthread_t *)calloc((size_t)nthreads, sizeof(pthread_t));
-    worker_ctx_t *ctxs = (worker_ctx_t *)calloc((size_t)nthreads, sizeof(worker_ctx_t));
-    if (!ths || !ctxs) { perror("calloc"); return 1; }
-
-#ifdef MODE_ATOMIC
-    barrier_t stage_barrier;
-    barrier_init(&stage_barrier, nthreads);
-    _Atomic bool start_flag = ATOMIC_VAR_INIT(false);
-#else
-    barrier_t start_barrier;
-    barrier_t stage_barrier;
-    barrier_init(&start_barrier, nthreads + 1);
-    barrier_init(&stage_barrier, nthreads);
-#endif
+    int *tmp = NULL;
+    if (hybrid) {
+        tmp = (int *)malloc(n * sizeof(int));
+        if (!tmp) { perror("malloc"); return 1; }
+    }
 
-    for (int t = 0; t < nthreads; ++t) {
-        ctxs[t].a = a;
-        ctxs[t].n = n;
-        ctxs[t].np2 = np2;
-        ctxs[t].tid = t;
-        ctxs[t].nthreads = nthreads;
-#ifdef MODE_ATOMIC
-        ctxs[t].stage_barrier = &stage_barrier;
-        ctxs[t].start_flag = &start_flag;
-#else
-        ctxs[t].start_barrier = &start_barrier;
-        ctxs[t].stage_barrier = &stage_barrier;
-#endif
-        if (pthread_create(&ths[t], NULL, worker_fn, &ctxs[t])) {
-            perror("pthread_create");
-            return 1;
-        }
+    int *cpus = NULL, ncpus = 0;
+    if (pin != PIN_NONE) {
+        cpus = (int *)calloc(CPU_SETSIZE, sizeof(int));
+        if (!cpus) { perror("calloc"); return 1; }
+        ncpus = pin_order(pin, cpus, CPU_SETSIZE);
+        if (ncpus <= 0) { perror("sched_getaffinity"); return 1; }
+        printf("Pin: %s, cpus:", pin == PIN_COMPACT ? "compact" : "scatter");
+        for (int t = 0; t < nthreads; t++) printf(" %d", cpus[t % ncpus]);
+        printf("\n");
     }
 
+    double *wait_ms = (double *)calloc((size_t)nthreads, sizeof(double));
+    if (!wait_ms) { perror("calloc"); return 1; }
+
+    pool_t *pool = pool_create(nthreads, cpus, ncpus);
+    if (!pool) { perror("pool_create"); return 1; }
     if (print_threads) {
         print_thread_count();
     }
@@ -292,36 +1542,59 @@ int main(int argc, char **argv) {
         sleep((unsigned)pause_sec);
     }
 
-    uint64_t t0 = now_ns();
-#ifdef MODE_ATOMIC
-    atomic_store_explicit(&start_flag, true, memory_order_release);
-#else
-    barrier_wait(&start_barrier); // release workers to start
-#endif
-
-    for (int t = 0; t < nthreads; ++t) pthread_join(ths[t], NULL);
-    uint64_t t1 = now_ns();
-
-    double ms = (double)(t1 - t0) / 1.0e6;
-    printf("Time: %.3f ms, n=%zu, threads=%d\n", ms, n, nthreads);
+    sort_opts_t opts = { n, np2, nthreads, tile, 0, NULL, seed, kernel, KEYMAP_NONE };
+    size_t barriers = 0;
+    pool_run(pool, a, &opts, JOB_FILL);
+    double ms = pool_sort(pool, a, &opts, &barriers, wait_ms);
+    printf("Time: %.3f ms, n=%zu, threads=%d, barriers=%zu, kernel=%s\n", ms, n, nthreads, barriers, kernel->name);
+    print_wait(wait_ms, nthreads, ms);
+    if (verify) print_verify(a, n);
 
-    if (verify) {
-        bool ok = true;
-        for (size_t i = 1; i < n; i++) if (a[i-1] > a[i]) { ok = false; break; }
-        printf("Verify: %s\n", ok ? "OK" : "FAIL");
+    if (hybrid) {
+        // the network over chunks needs a power-of-two number of them
+        int ht = (int)(next_pow2((size_t)nthreads + 1) >> 1);
+        // the workers generate the same input again
+        sort_opts_t hopts = { n, np2, ht, 0, 1, tmp, seed, kernel, KEYMAP_NONE };
+        pool_run(pool, a, &hopts, JOB_FILL);
+        double hms = pool_sort(pool, a, &hopts, &barriers, wait_ms);
+        printf("Hybrid: %.3f ms, n=%zu, threads=%d, barriers=%zu, bitonic/hybrid=%.2f\n", hms, n, ht, barriers, ms / hms);
+        print_wait(wait_ms, ht, hms);
+        if (verify) print_verify(a, n);
+        free(tmp);
     }
 
-#ifndef MODE_ATOMIC
-    barrier_destroy(&start_barrier);
-#endif
-#ifndef MODE_ATOMIC
-    barrier_destroy(&stage_barrier);
-#else
-    (void)stage_barrier; // nothing to destroy
-#endif
+    if (repeat > 0) {
+        // the same sort again and again on the pool, then with the threads
+        // created and joined around every sort; the input is refilled
+        // outside the timing (seed + r) by the pool in both cases
+        double *lat = (double *)calloc(2 * (size_t)repeat, sizeof(double));
+        if (!lat) { perror("calloc"); return 1; }
+        double *fresh = lat + repeat;
+        for (int r = 0; r < repeat; r++) {
+            opts.seed = seed + (unsigned)r;
+            pool_run(pool, a, &opts, JOB_FILL);
+            lat[r] = pool_sort(pool, a, &opts, NULL, NULL);
+        }
+        for (int r = 0; r < repeat; r++) {
+            opts.seed = seed + (unsigned)r;
+            pool_run(pool, a, &opts, JOB_FILL);
+            uint64_t t0 = now_ns();
+            pool_t *once = pool_create(nthreads, cpus, ncpus);
+            if (!once) { perror("pool_create"); return 1; }
+            pool_sort(once, a, &opts, NULL, NULL);
+            pool_destroy(once);
+            fresh[r] = (double)(now_ns() - t0) / 1.0e6;
+        }
+        print_latency("pool", lat, repeat);
+        print_latency("create/join", fresh, repeat);
+        if (verify) print_verify(a, n);
+        free(lat);
+    }
 
-    free(ths);
-    free(ctxs);
+    pool_destroy(pool);
+    free(cpus);
+    free(wait_ms);
     free(a);
     return 0;
 }
+#endif // BITONIC_LIB
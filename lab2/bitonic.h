@@ -0,0 +1,43 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Parallel bitonic sort engine (libbitonic.a). Every call sorts in place in
+// ascending order with nthreads workers and returns 0, or -1 with errno set
+// (EINVAL, ENOMEM, EAGAIN). The workers are kept between calls; a call made
+// while another thread's sort holds them starts workers of its own.
+//
+// Keys are compared as the type says: float in IEEE order with -0.0 before
+// +0.0 and NaNs at the ends by sign.
+
+int bitonic_sort_i32(int32_t *a, size_t n, int nthreads);
+int bitonic_sort_u32(uint32_t *a, size_t n, int nthreads);
+int bitonic_sort_u64(uint64_t *a, size_t n, int nthreads);
+int bitonic_sort_float(float *a, size_t n, int nthreads);
+
+// Key/payload pairs packed into one 64-bit word, key in the upper half, so
+// they sort as plain uint64: by key, then by index
+static inline uint64_t bitonic_kv_pack(uint32_t key, uint32_t index) {
+    return (uint64_t)key << 32 | index;
+}
+static inline uint32_t bitonic_kv_key(uint64_t kv) { return (uint32_t)(kv >> 32); }
+static inline uint32_t bitonic_kv_index(uint64_t kv) { return (uint32_t)kv; }
+
+int bitonic_sort_kv(uint64_t *kv, size_t n, int nthreads);
+
+// Any elements of elem_size bytes by a 32-bit key: (key, index) pairs are
+// sorted and the elements then moved into place, so the sort is stable.
+// n must fit in 32 bits.
+typedef uint32_t (*bitonic_key_fn)(const void *elem);
+int bitonic_sort(void *base, size_t n, size_t elem_size, bitonic_key_fn key, int nthreads);
+
+// Optional settings, taken by the sorts started after the call: the
+// compare-exchange kernel (auto, scalar, avx2, avx512, neon), the stage
+// barrier (see the README for the ones of each mode) and the thread pinning
+// policy (none, compact, scatter). Return -1 for a name not usable here.
+int bitonic_set_kernel(const char *name);
+int bitonic_set_barrier(const char *name);
+int bitonic_set_pin(const char *policy);
+
+// Stops the kept workers; the next sort starts them again
+void bitonic_shutdown(void);
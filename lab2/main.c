@@ -4,17 +4,34 @@
  * того, что две верхние карты в колоде из 52 карт одинаковые (по значению).
 
  * Компиляция:
- *   gcc -o monte-carlo-mutex main.c -pthread -DUSE_MUTEX
- *   gcc -o monte-carlo-atomic main.c -pthread -DUSE_ATOMIC
+ *   gcc -O3 -o monte-carlo-mutex main.c -pthread -lm -DUSE_MUTEX
+ *   gcc -O3 -o monte-carlo-atomic main.c -pthread -lm -DUSE_ATOMIC
+ *   (с -march=native пакетный движок векторизуется на AVX2/AVX-512)
  * 
  * Запуск:
- *   ./monte-carlo-mutex -r <rounds> -t <max_threads>
- *   ./monte-carlo-atomic -r <rounds> -t <max_threads>
+ *   ./monte-carlo-mutex -r <rounds> -t <max_threads> [-e fast|full] [--target-error E]
+ *   ./monte-carlo-atomic -r <rounds> -t <max_threads> [-e fast|full] [--target-error E]
+ *
+ * Раунды раздаются потокам порциями (--chunk) из общей очереди. Главный поток
+ * периодически суммирует счётчики потоков, печатает текущую оценку с 95%
+ * доверительным интервалом (--report) и с --target-error останавливает все
+ * потоки, как только полуширина интервала станет не больше E; -r тогда -
+ * верхняя граница числа раундов.
+ *
+ * Движки:
+ *   fast (по умолчанию) - тянет только две верхние карты (частичный
+ *        Фишер-Йетс) из xoshiro256**, пакетами по SIM_LANES независимых
+ *        симуляций, которые компилятор векторизует;
+ *   full - эталон: вся колода, полный Фишер-Йетс на rand_r, для проверки
+ *        статистики быстрого движка.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <math.h>
+#include <getopt.h>
 #include <pthread.h>
 #include <time.h>
 #include <unistd.h>
@@ -26,21 +43,49 @@
 
 #define DECK_SIZE 52
 #define CARD_VALUES 13  // A, 2-10, J, Q, K
+#define SIM_LANES 16    // симуляций в пакете быстрого движка
+#define CACHE_LINE 64
+#define DEFAULT_CHUNK 65536  // раундов в одной порции работы
+#define POLL_US 1000         // период опроса счётчиков главным потоком
+#define MIN_STOP_ROUNDS 10000 // раньше интервал ненадёжен, не останавливаем
+#define Z95 1.959963984540054 // квантиль нормального распределения для 95%
 
-// Глобальные переменные для подсчета результатов
+enum { ENGINE_FAST, ENGINE_FULL };
+int engine = ENGINE_FAST;
+
+// Счётчики одного потока, каждый поток в своей кэш-линии: пишет в них только
+// он сам (после каждой порции), главный поток только читает
+typedef struct {
+#ifdef USE_ATOMIC
+    _Alignas(CACHE_LINE) atomic_long matches;
+    atomic_long simulations;
+#else
+    _Alignas(CACHE_LINE) pthread_mutex_t mutex;
+    long matches;
+    long simulations;
+#endif
+} thread_stats_t;
+
+// Очередь работы: раунды [0, total_rounds) раздаются порциями по chunk_size
+long total_rounds = 0;
+long chunk_size = DEFAULT_CHUNK;
 #ifdef USE_ATOMIC
-atomic_long total_matches = 0;
-atomic_long total_simulations = 0;
+atomic_long next_round = 0;
+atomic_int stop_flag = 0;        // выставляет главный поток по --target-error
+atomic_int finished_threads = 0;
 #else
-long total_matches = 0;
-long total_simulations = 0;
-pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+long next_round = 0;
+int stop_flag = 0;
+int finished_threads = 0;
+pthread_mutex_t work_mutex = PTHREAD_MUTEX_INITIALIZER;  // защищает три поля выше
+pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;     // поток закончил
 #endif
 
 // Структура для передачи параметров в поток
 typedef struct {
-    long simulations_per_thread;
     int thread_id;
+    uint64_t seed;           // общее зерно, потоки получают из него свои потоки чисел
+    thread_stats_t *stats;
 } thread_args_t;
 
 // Семафор для ограничения количества потоков
@@ -116,35 +161,312 @@ int simulate_once(unsigned int *seed) {
     return check_top_two_match(deck);
 }
 
+// ---- Быстрый движок ----
+
+// splitmix64: раскладывает одно число в начальные состояния генераторов
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// Шаг одного генератора xoshiro256**, нужен для прыжков при посеве
+static uint64_t xoshiro_next(uint64_t s[4]) {
+    uint64_t out = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return out;
+}
+
+// Прыжок вперёд на 2^128 (XOSHIRO_JUMP) или 2^192 (XOSHIRO_LONG_JUMP) шагов
+static const uint64_t XOSHIRO_JUMP[4] = {
+    0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull
+};
+static const uint64_t XOSHIRO_LONG_JUMP[4] = {
+    0x76e15d3efefdcbbfull, 0xc5004e441c522fb3ull, 0x77710069854ee241ull, 0x39109bb02acbe635ull
+};
+
+static void xoshiro_jump(uint64_t s[4], const uint64_t poly[4]) {
+    uint64_t t[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (poly[i] & (1ull << b)) {
+                for (int k = 0; k < 4; k++) {
+                    t[k] ^= s[k];
+                }
+            }
+            xoshiro_next(s);
+        }
+    }
+    memcpy(s, t, sizeof(t));
+}
+
+// SIM_LANES независимых потоков xoshiro256**, состояние по столбцам
+// (s[k][lane]), чтобы один шаг всех дорожек был одним векторным циклом
+typedef struct {
+    uint64_t s[4][SIM_LANES];
+} xoshiro_lanes_t;
+
+// Дорожки потока stream: состояние из зерна через splitmix64, long jump на
+// каждый предыдущий поток и jump на каждую дорожку, так что последовательности
+// всех дорожек всех потоков гарантированно не пересекаются
+void lanes_seed(xoshiro_lanes_t *g, uint64_t seed, int stream) {
+    uint64_t s[4];
+    for (int k = 0; k < 4; k++) {
+        s[k] = splitmix64(&seed);
+    }
+    for (int t = 0; t < stream; t++) {
+        xoshiro_jump(s, XOSHIRO_LONG_JUMP);
+    }
+    for (int l = 0; l < SIM_LANES; l++) {
+        for (int k = 0; k < 4; k++) {
+            g->s[k][l] = s[k];
+        }
+        xoshiro_jump(s, XOSHIRO_JUMP);
+    }
+}
+
+// Следующее 64-битное число дорожки l
+static inline uint64_t lane_next(xoshiro_lanes_t *g, int l) {
+    uint64_t s0 = g->s[0][l], s1 = g->s[1][l], s2 = g->s[2][l], s3 = g->s[3][l];
+    uint64_t out = rotl64(s1 * 5, 7) * 9;
+    uint64_t t = s1 << 17;
+    s2 ^= s0;
+    s3 ^= s1;
+    s1 ^= s2;
+    s0 ^= s3;
+    s2 ^= t;
+    s3 = rotl64(s3, 45);
+    g->s[0][l] = s0;
+    g->s[1][l] = s1;
+    g->s[2][l] = s2;
+    g->s[3][l] = s3;
+    return out;
+}
+
+// Несмещённое число из [0, range) по методу Лемира: старшие 32 бита
+// произведения, отбрасываются x с младшей частью меньше 2^32 mod range
+static inline uint32_t bounded_reject_limit(uint32_t range) {
+    return (uint32_t)(-range) % range;
+}
+
+uint32_t lane_bounded(xoshiro_lanes_t *g, int l, uint32_t range) {
+    uint32_t limit = bounded_reject_limit(range);
+    uint64_t m;
+    do {
+        m = (uint64_t)(uint32_t)(lane_next(g, l) >> 32) * range;
+    } while ((uint32_t)m < limit);
+    return (uint32_t)(m >> 32);
+}
+
+// Две верхние карты без построения колоды: первая - любая из 52, вторая -
+// любая из оставшихся 51 (номер сдвигается за первую). Это первые два шага
+// Фишера-Йетса, распределение пары то же.
+int simulate_top_two(xoshiro_lanes_t *g, int l) {
+    uint32_t c0 = lane_bounded(g, l, DECK_SIZE);
+    uint32_t c1 = lane_bounded(g, l, DECK_SIZE - 1);
+    c1 += (c1 >= c0);
+    return c0 % CARD_VALUES == c1 % CARD_VALUES;
+}
+
+// Пакет из SIM_LANES симуляций, по одной на дорожку. Одно 64-битное число
+// даёт обе карты (старшая и младшая половины), отказ Лемира (вероятность
+// ~1e-8) не ветвится в векторном цикле: такие дорожки пересчитываются
+// скалярно. Возвращает число совпадений.
+int simulate_batch(xoshiro_lanes_t *g) {
+    const uint32_t lim0 = bounded_reject_limit(DECK_SIZE);
+    const uint32_t lim1 = bounded_reject_limit(DECK_SIZE - 1);
+    int match[SIM_LANES], bad[SIM_LANES];
+
+    for (int l = 0; l < SIM_LANES; l++) {
+        uint64_t x = lane_next(g, l);
+        uint64_t m0 = (x >> 32) * DECK_SIZE;
+        uint64_t m1 = (x & 0xFFFFFFFFull) * (DECK_SIZE - 1);
+        uint32_t c0 = (uint32_t)(m0 >> 32);
+        uint32_t c1 = (uint32_t)(m1 >> 32);
+        c1 += (c1 >= c0);
+        match[l] = c0 % CARD_VALUES == c1 % CARD_VALUES;
+        bad[l] = ((uint32_t)m0 < lim0) | ((uint32_t)m1 < lim1);
+    }
+
+    int matches = 0;
+    for (int l = 0; l < SIM_LANES; l++) {
+        if (bad[l]) {
+            matches += simulate_top_two(g, l);
+        } else {
+            matches += match[l];
+        }
+    }
+    return matches;
+}
+
+long simulate_fast(xoshiro_lanes_t *g, long count) {
+    long matches = 0;
+    long i = 0;
+    for (; i + SIM_LANES <= count; i += SIM_LANES) {
+        matches += simulate_batch(g);
+    }
+    for (; i < count; i++) {
+        matches += simulate_top_two(g, 0);
+    }
+    return matches;
+}
+
+// ---- Распределение работы ----
+
+// Берёт следующую порцию раундов, возвращает её размер (0 - работы больше нет)
+long take_chunk(void) {
+#ifdef USE_ATOMIC
+    if (atomic_load_explicit(&stop_flag, memory_order_relaxed)) {
+        return 0;
+    }
+    long start = atomic_fetch_add_explicit(&next_round, chunk_size, memory_order_relaxed);
+#else
+    pthread_mutex_lock(&work_mutex);
+    long start = stop_flag ? total_rounds : next_round;
+    if (start < total_rounds) {
+        next_round += chunk_size;
+    }
+    pthread_mutex_unlock(&work_mutex);
+#endif
+    if (start >= total_rounds) {
+        return 0;
+    }
+    long left = total_rounds - start;
+    return left < chunk_size ? left : chunk_size;
+}
+
+// Публикует накопленные потоком итоги
+void publish_stats(thread_stats_t *st, long matches, long simulations) {
+#ifdef USE_ATOMIC
+    atomic_store_explicit(&st->matches, matches, memory_order_relaxed);
+    atomic_store_explicit(&st->simulations, simulations, memory_order_release);
+#else
+    pthread_mutex_lock(&st->mutex);
+    st->matches = matches;
+    st->simulations = simulations;
+    pthread_mutex_unlock(&st->mutex);
+#endif
+}
+
+// Сумма итогов всех потоков
+void collect_stats(thread_stats_t *stats, int n, long *matches, long *simulations) {
+    *matches = 0;
+    *simulations = 0;
+    for (int i = 0; i < n; i++) {
+#ifdef USE_ATOMIC
+        *simulations += atomic_load_explicit(&stats[i].simulations, memory_order_acquire);
+        *matches += atomic_load_explicit(&stats[i].matches, memory_order_relaxed);
+#else
+        pthread_mutex_lock(&stats[i].mutex);
+        *simulations += stats[i].simulations;
+        *matches += stats[i].matches;
+        pthread_mutex_unlock(&stats[i].mutex);
+#endif
+    }
+}
+
+// Полуширина 95% доверительного интервала для доли matches / simulations
+double ci_half_width(long matches, long simulations) {
+    if (simulations == 0) {
+        return INFINITY;
+    }
+    double p = (double)matches / simulations;
+    return Z95 * sqrt(p * (1 - p) / simulations);
+}
+
 // Функция потока
 void *thread_function(void *arg) {
     thread_args_t *args = (thread_args_t *)arg;
-    unsigned int seed = time(NULL) + args->thread_id;
+    
+    // Свой поток чисел: дорожки xoshiro со своим прыжком, для rand_r -
+    // зерно, перемешанное splitmix64 (соседние thread_id не дают соседних зёрен)
+    xoshiro_lanes_t g;
+    uint64_t x = args->seed + (uint64_t)args->thread_id;
+    unsigned int seed = (unsigned int)splitmix64(&x);
+    if (engine == ENGINE_FAST) {
+        lanes_seed(&g, args->seed, args->thread_id);
+    }
     
     long local_matches = 0;
+    long local_simulations = 0;
+    long count;
     
-    // Выполняем симуляции
-    for (long i = 0; i < args->simulations_per_thread; i++) {
-        if (simulate_once(&seed)) {
-            local_matches++;
+    // Выполняем симуляции порциями, пока есть работа
+    while ((count = take_chunk()) > 0) {
+        if (engine == ENGINE_FAST) {
+            local_matches += simulate_fast(&g, count);
+        } else {
+            for (long i = 0; i < count; i++) {
+                if (simulate_once(&seed)) {
+                    local_matches++;
+                }
+            }
         }
+        local_simulations += count;
+        publish_stats(args->stats, local_matches, local_simulations);
     }
     
-    // Обновляем глобальные счетчики
+    // Сообщаем главному потоку о завершении
 #ifdef USE_ATOMIC
-    atomic_fetch_add(&total_matches, local_matches);
-    atomic_fetch_add(&total_simulations, args->simulations_per_thread);
+    atomic_fetch_add(&finished_threads, 1);
 #else
-    pthread_mutex_lock(&stats_mutex);
-    total_matches += local_matches;
-    total_simulations += args->simulations_per_thread;
-    pthread_mutex_unlock(&stats_mutex);
+    pthread_mutex_lock(&work_mutex);
+    finished_threads++;
+    pthread_cond_signal(&done_cond);
+    pthread_mutex_unlock(&work_mutex);
 #endif
     
     free(args);
     return NULL;
 }
 
+// Ждёт до POLL_US или завершения всех потоков, возвращает 1, если все закончили
+int wait_workers(int nthreads) {
+#ifdef USE_ATOMIC
+    if (atomic_load(&finished_threads) < nthreads) {
+        usleep(POLL_US);
+    }
+    return atomic_load(&finished_threads) == nthreads;
+#else
+    pthread_mutex_lock(&work_mutex);
+    if (finished_threads < nthreads) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += POLL_US * 1000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&done_cond, &work_mutex, &ts);
+    }
+    int done = finished_threads == nthreads;
+    pthread_mutex_unlock(&work_mutex);
+    return done;
+#endif
+}
+
+// Останавливает раздачу работы: потоки доделывают текущие порции и выходят
+void stop_workers(void) {
+#ifdef USE_ATOMIC
+    atomic_store(&stop_flag, 1);
+#else
+    pthread_mutex_lock(&work_mutex);
+    stop_flag = 1;
+    pthread_mutex_unlock(&work_mutex);
+#endif
+}
+
 // Функция для получения текущего времени в микросекундах
 long long current_time_micros() {
     struct timeval tv;
@@ -153,19 +475,38 @@ long long current_time_micros() {
 }
 
 void print_usage(const char *program_name) {
-    printf("Использование: %s -r <rounds> -t <max_threads>\n", program_name);
+    printf("Использование: %s -r <rounds> -t <max_threads> [-e fast|full] [--target-error E]\n"
+           "       [--chunk N] [--seed S] [--report MS]\n", program_name);
     printf("  -r <rounds>       Количество раундов (симуляций) Монте-Карло\n");
     printf("  -t <max_threads>  Максимальное количество одновременно работающих потоков\n");
-    printf("\nПример: %s -r 1000000 -t 4\n", program_name);
+    printf("  -e <engine>       fast - две верхние карты из xoshiro256** (по умолчанию),\n");
+    printf("                    full - полная колода и Фишер-Йетс на rand_r (эталон)\n");
+    printf("  --target-error E  остановиться, когда полуширина 95%% интервала <= E\n");
+    printf("  --chunk N         раундов в порции работы (по умолчанию %d)\n", DEFAULT_CHUNK);
+    printf("  --seed S          зерно генераторов (по умолчанию - текущее время)\n");
+    printf("  --report MS       печатать текущую оценку каждые MS мс (0 - не печатать,\n");
+    printf("                    по умолчанию 1000)\n");
+    printf("\nПример: %s -r 1000000000 -t 4 --target-error 0.0001\n", program_name);
 }
 
 int main(int argc, char *argv[]) {
-    long total_rounds = 0;
     int max_threads = 0;
+    double target_error = 0;
+    uint64_t seed = (uint64_t)time(NULL);
+    long report_ms = 1000;
+    
+    static const struct option long_options[] = {
+        { "target-error", required_argument, NULL, 'E' },
+        { "chunk", required_argument, NULL, 'C' },
+        { "seed", required_argument, NULL, 'S' },
+        { "report", required_argument, NULL, 'P' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
     
     // Парсинг аргументов командной строки
     int opt;
-    while ((opt = getopt(argc, argv, "r:t:h")) != -1) {
+    while ((opt = getopt_long(argc, argv, "r:t:e:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'r':
                 total_rounds = atol(optarg);
@@ -173,6 +514,28 @@ int main(int argc, char *argv[]) {
             case 't':
                 max_threads = atoi(optarg);
                 break;
+            case 'e':
+                if (strcmp(optarg, "fast") == 0) {
+                    engine = ENGINE_FAST;
+                } else if (strcmp(optarg, "full") == 0) {
+                    engine = ENGINE_FULL;
+                } else {
+                    fprintf(stderr, "Ошибка: неизвестный движок %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'E':
+                target_error = atof(optarg);
+                break;
+            case 'C':
+                chunk_size = atol(optarg);
+                break;
+            case 'S':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'P':
+                report_ms = atol(optarg);
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -188,6 +551,10 @@ int main(int argc, char *argv[]) {
         print_usage(argv[0]);
         return 1;
     }
+    if (chunk_size <= 0 || target_error < 0 || report_ms < 0) {
+        fprintf(stderr, "Ошибка: --chunk должен быть положительным, --target-error и --report - неотрицательными\n");
+        return 1;
+    }
     
     printf("=== Симуляция методом Монте-Карло ===\n");
     printf("Тип синхронизации: %s\n", 
@@ -197,11 +564,34 @@ int main(int argc, char *argv[]) {
            "Мьютексы (mutex)"
 #endif
     );
+    printf("Движок: %s\n", engine == ENGINE_FAST
+           ? "fast (две карты, xoshiro256**)" : "full (колода, Фишер-Йетс на rand_r)");
     printf("Количество раундов: %ld\n", total_rounds);
     printf("Максимум потоков: %d\n", max_threads);
+    printf("Порция: %ld раундов, зерно: %llu\n", chunk_size, (unsigned long long)seed);
+    if (target_error > 0) {
+        printf("Целевая погрешность: %g\n", target_error);
+    }
     printf("PID процесса: %d\n", getpid());
     printf("\n");
     
+    // Счётчики потоков, каждый в своей кэш-линии
+    thread_stats_t *stats = aligned_alloc(CACHE_LINE, sizeof(thread_stats_t) * max_threads);
+    if (stats == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти\n");
+        return 1;
+    }
+    for (int i = 0; i < max_threads; i++) {
+#ifdef USE_ATOMIC
+        atomic_init(&stats[i].matches, 0);
+        atomic_init(&stats[i].simulations, 0);
+#else
+        pthread_mutex_init(&stats[i].mutex, NULL);
+        stats[i].matches = 0;
+        stats[i].simulations = 0;
+#endif
+    }
+    
     // Инициализация семафора для ограничения потоков
     sem_init_custom(&thread_limit_sem, max_threads);
     
@@ -209,9 +599,6 @@ int main(int argc, char *argv[]) {
     long long start_time = current_time_micros();
     
     // Создание потоков
-    long simulations_per_thread = total_rounds / max_threads;
-    long remaining = total_rounds % max_threads;
-    
     pthread_t threads[max_threads];
     
     for (int i = 0; i < max_threads; i++) {
@@ -219,12 +606,8 @@ int main(int argc, char *argv[]) {
         
         thread_args_t *args = malloc(sizeof(thread_args_t));
         args->thread_id = i;
-        args->simulations_per_thread = simulations_per_thread;
-        
-        // Добавляем оставшиеся раунды к последнему потоку
-        if (i == max_threads - 1) {
-            args->simulations_per_thread += remaining;
-        }
+        args->seed = seed;
+        args->stats = &stats[i];
         
         if (pthread_create(&threads[i], NULL, thread_function, args) != 0) {
             fprintf(stderr, "Ошибка создания потока %d\n", i);
@@ -234,6 +617,27 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    // Промежуточные оценки и остановка по точности, пока потоки работают
+    long long last_report = start_time;
+    int stopped = 0;
+    while (!wait_workers(max_threads)) {
+        long matches, simulations;
+        collect_stats(stats, max_threads, &matches, &simulations);
+        double half = ci_half_width(matches, simulations);
+        long long now = current_time_micros();
+        if (report_ms > 0 && now - last_report >= report_ms * 1000) {
+            last_report = now;
+            printf("[%.1f сек] симуляций: %ld, оценка: %.6f ± %.6f (95%%)\n",
+                   (now - start_time) / 1000000.0, simulations,
+                   simulations ? (double)matches / simulations : 0.0, half);
+            fflush(stdout);
+        }
+        if (!stopped && target_error > 0 && simulations >= MIN_STOP_ROUNDS && half <= target_error) {
+            stop_workers();
+            stopped = 1;
+        }
+    }
+    
     // Ожидание завершения всех потоков
     for (int i = 0; i < max_threads; i++) {
         pthread_join(threads[i], NULL);
@@ -245,21 +649,21 @@ int main(int argc, char *argv[]) {
     double elapsed_seconds = (end_time - start_time) / 1000000.0;
     
     // Вычисление и вывод результатов
-#ifdef USE_ATOMIC
-    long final_matches = atomic_load(&total_matches);
-    long final_simulations = atomic_load(&total_simulations);
-#else
-    long final_matches = total_matches;
-    long final_simulations = total_simulations;
-#endif
+    long final_matches, final_simulations;
+    collect_stats(stats, max_threads, &final_matches, &final_simulations);
     
     double probability = (double)final_matches / final_simulations;
     
     printf("=== Результаты ===\n");
     printf("Всего симуляций: %ld\n", final_simulations);
+    if (stopped) {
+        printf("Остановлено по --target-error: выполнено %.1f%% от -r\n",
+               100.0 * final_simulations / total_rounds);
+    }
     printf("Совпадений: %ld\n", final_matches);
     printf("Экспериментальная вероятность: %.6f (%.4f%%)\n", 
            probability, probability * 100);
+    printf("95%% доверительный интервал: ± %.6f\n", ci_half_width(final_matches, final_simulations));
     printf("Время выполнения: %.3f сек\n", elapsed_seconds);
     printf("Скорость: %.0f симуляций/сек\n", final_simulations / elapsed_seconds);
     
@@ -279,8 +683,11 @@ int main(int argc, char *argv[]) {
     // Очистка ресурсов
     sem_destroy_custom(&thread_limit_sem);
 #ifndef USE_ATOMIC
-    pthread_mutex_destroy(&stats_mutex);
+    for (int i = 0; i < max_threads; i++) {
+        pthread_mutex_destroy(&stats[i].mutex);
+    }
 #endif
+    free(stats);
     
     return 0;
 }
@@ -0,0 +1,201 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+// Single-producer single-consumer ring of fixed-size slots in the shm
+// segment (--ring mode). The server fills slot head % nslots and publishes
+// it by bumping head, the client drains slot tail % nslots and frees it by
+// bumping tail, so both run at the same time as long as the ring is neither
+// empty nor full. A waiting side spins for RING_SPIN polls (not on a single
+// CPU), then sleeps in futex on the counter it waits for; the other side
+// only calls FUTEX_WAKE when someone sleeps. head and tail are free-running,
+// nslots is a power of two. A slot of length 0 marks EOF; in -j mode its seq
+// is RING_SEQ_EOF, since a chunk of skipped lines also sums to 0 bytes.
+
+#define RING_DEFAULT_SLOTS 16
+#define RING_DEFAULT_SLOT_SIZE 65536
+#define RING_MAX_SLOT_SIZE (64u << 20)
+#ifndef RING_SPIN
+#define RING_SPIN 4000
+#endif
+#define RING_CACHE_LINE 64
+#define RING_SEQ_EOF UINT32_MAX
+// How often a daemon session and its pool client check on each other while
+// waiting on the ring
+#define RING_CHECK_MS 100
+
+typedef struct {
+    _Alignas(RING_CACHE_LINE) atomic_uint head; // slots published by the server
+    atomic_int head_sleepers;                   // client asleep on head
+    _Alignas(RING_CACHE_LINE) atomic_uint tail; // slots freed by the client
+    atomic_int tail_sleepers;                   // server asleep on tail
+    atomic_int closed;                          // client is gone, stop producing
+    _Alignas(RING_CACHE_LINE) uint32_t nslots;
+    uint32_t slot_size;                         // payload bytes per slot
+} ring_hdr_t;
+
+typedef struct {
+    _Alignas(RING_CACHE_LINE) uint32_t len;
+    uint32_t seq;                               // chunk number in -j mode
+    char data[];
+} ring_slot_t;
+
+static inline size_t ring_slot_stride(uint32_t slot_size) {
+    size_t s = sizeof(ring_slot_t) + slot_size;
+    return (s + RING_CACHE_LINE - 1) & ~(size_t)(RING_CACHE_LINE - 1);
+}
+
+// Bytes of the shm segment for the ring
+static inline size_t ring_bytes(uint32_t nslots, uint32_t slot_size) {
+    return sizeof(ring_hdr_t) + (size_t)nslots * ring_slot_stride(slot_size);
+}
+
+// -j N puts 2N rings of the same size back to back: ring 2k feeds chunks to
+// worker k, ring 2k + 1 carries its sums back
+static inline ring_hdr_t *ring_at(void *base, unsigned i, uint32_t nslots, uint32_t slot_size) {
+    return (ring_hdr_t *)((char *)base + (size_t)i * ring_bytes(nslots, slot_size));
+}
+
+static inline void ring_init(ring_hdr_t *r, uint32_t nslots, uint32_t slot_size) {
+    atomic_init(&r->head, 0);
+    atomic_init(&r->head_sleepers, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->tail_sleepers, 0);
+    atomic_init(&r->closed, 0);
+    r->nslots = nslots;
+    r->slot_size = slot_size;
+}
+
+static inline ring_slot_t *ring_slot(ring_hdr_t *r, uint32_t i) {
+    char *base = (char *)(r + 1);
+    return (ring_slot_t *)(base + (size_t)(i & (r->nslots - 1)) * ring_slot_stride(r->slot_size));
+}
+
+static inline void ring_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Spinning only helps when the other side runs on another CPU
+static inline int ring_spin_limit(void) {
+    static int limit = -1;
+    if (limit < 0) limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? RING_SPIN : 0;
+    return limit;
+}
+
+// Waits until *word != old, or after the spin for one futex sleep of at most
+// timeout_ms (-1: no limit), so the caller re-checks. The segment is shared
+// between processes, so the futex calls are not _PRIVATE.
+static inline void ring_wait_for(atomic_uint *word, atomic_int *sleepers, unsigned old, int timeout_ms) {
+    int spins = ring_spin_limit();
+    TRACE_BEGIN(trace_t0);
+    for (int i = 0; i < spins; i++) {
+        if (atomic_load_explicit(word, memory_order_acquire) != old) {
+            TRACE_VALUE("ring_spins", i);
+            return;
+        }
+        ring_cpu_relax();
+    }
+    TRACE_VALUE("ring_spins", spins);
+    struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000 };
+    atomic_fetch_add(sleepers, 1);
+    if (timeout_ms >= 0) {
+        if (atomic_load(word) == old)
+            syscall(SYS_futex, word, FUTEX_WAIT, old, &ts, NULL, 0);
+    } else {
+        while (atomic_load(word) == old)
+            syscall(SYS_futex, word, FUTEX_WAIT, old, NULL, NULL, 0);
+    }
+    atomic_fetch_sub(sleepers, 1);
+    TRACE_END("ring_futex_wait", trace_t0);
+}
+
+static inline void ring_wait(atomic_uint *word, atomic_int *sleepers, unsigned old) {
+    ring_wait_for(word, sleepers, old, -1);
+}
+
+static inline void ring_bump(atomic_uint *word, atomic_int *sleepers) {
+    // seq_cst pairs with ring_wait: either the sleeper sees the new value or
+    // we see the sleeper
+    atomic_fetch_add(word, 1);
+    if (atomic_load(sleepers))
+        syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Producer: the next free slot, or NULL once the client has closed the ring
+static inline ring_slot_t *ring_produce_begin(ring_hdr_t *r) {
+    unsigned h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    for (;;) {
+        if (atomic_load_explicit(&r->closed, memory_order_acquire)) return NULL;
+        unsigned t = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (h - t < r->nslots) return ring_slot(r, h);
+        ring_wait(&r->tail, &r->tail_sleepers, t);
+    }
+}
+
+// Producer with a deadline: the next free slot, or NULL if the client has
+// closed the ring or no slot frees up within about timeout_ms; r->closed
+// tells the two apart
+static inline ring_slot_t *ring_produce_timed(ring_hdr_t *r, int timeout_ms) {
+    unsigned h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (atomic_load_explicit(&r->closed, memory_order_acquire)) return NULL;
+    unsigned t = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (h - t < r->nslots) return ring_slot(r, h);
+    ring_wait_for(&r->tail, &r->tail_sleepers, t, timeout_ms);
+    if (atomic_load_explicit(&r->closed, memory_order_acquire)) return NULL;
+    t = atomic_load_explicit(&r->tail, memory_order_acquire);
+    return h - t < r->nslots ? ring_slot(r, h) : NULL;
+}
+
+static inline void ring_produce_end(ring_hdr_t *r) {
+    ring_bump(&r->head, &r->head_sleepers);
+}
+
+// Consumer: the oldest filled slot, waits for one
+static inline ring_slot_t *ring_consume_begin(ring_hdr_t *r) {
+    unsigned t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    for (;;) {
+        unsigned h = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (h != t) return ring_slot(r, t);
+        ring_wait(&r->head, &r->head_sleepers, h);
+    }
+}
+
+// Consumer with a deadline: the oldest filled slot, or NULL if none shows up
+// within timeout_ms (0: do not wait). A single futex sleep without spinning:
+// the caller has something to do on a timeout, and an early wakeup only
+// makes it do that sooner.
+static inline ring_slot_t *ring_consume_timed(ring_hdr_t *r, int timeout_ms) {
+    unsigned t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    unsigned h = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (h == t && timeout_ms > 0) {
+        struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000 };
+        atomic_fetch_add(&r->head_sleepers, 1);
+        if (atomic_load(&r->head) == h)
+            syscall(SYS_futex, &r->head, FUTEX_WAIT, h, &ts, NULL, 0);
+        atomic_fetch_sub(&r->head_sleepers, 1);
+        h = atomic_load_explicit(&r->head, memory_order_acquire);
+    }
+    return h != t ? ring_slot(r, t) : NULL;
+}
+
+static inline void ring_consume_end(ring_hdr_t *r) {
+    ring_bump(&r->tail, &r->tail_sleepers);
+}
+
+// Consumer leaves early: the extra tail bump wakes a producer waiting for a
+// free slot, which then sees closed
+static inline void ring_close(ring_hdr_t *r) {
+    atomic_store(&r->closed, 1);
+    ring_bump(&r->tail, &r->tail_sleepers);
+}
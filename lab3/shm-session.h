@@ -0,0 +1,134 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Names of the per-run objects and the daemon protocol.
+//
+// A forked run names its segment and semaphores after the server pid:
+// the server puts it into SUM_SHM_ID before forking, and both sides build the
+// names with shm_name(), so concurrent runs do not share /sum_shm. Without
+// SUM_SHM_ID the plain base names are used.
+//
+// sum-server-shm --daemon SOCK keeps a pool of `sum-client-shm --pool`
+// processes, each on a socketpair (its stdin). A session
+// (sum-server-shm --connect SOCK) creates its ring in a memfd, so the
+// segment has no name at all, opens the output file, connects and sends a
+// session_req_t with three fds: ring, output file, its stderr. The daemon
+// passes the accepted connection to an idle pool client; that client reads
+// the request from the connection, sums the ring into the file, answers with
+// one status byte (0 = success) and tells the daemon it is idle by writing
+// one byte to its socketpair. While the ring is streaming both ends check the
+// connection every RING_CHECK_MS, so the death of either one fails the
+// other's session instead of leaving it blocked on the ring.
+
+#define SESSION_MAGIC 0x53554d31u // "SUM1"
+#define SESSION_FDS 3             // ring segment, output file, stderr
+
+typedef struct {
+    uint32_t magic;
+    uint32_t pad;
+} session_req_t;
+
+// base + "." + SUM_SHM_ID into dst[cap]
+static inline const char *shm_name(char *dst, size_t cap, const char *base) {
+    const char *id = getenv("SUM_SHM_ID");
+    size_t n = strlen(base), m = id ? strlen(id) : 0;
+    if (!id || n + 1 + m + 1 > cap) m = 0;
+    memcpy(dst, base, n);
+    if (m) {
+        dst[n++] = '.';
+        memcpy(dst + n, id, m);
+        n += m;
+    }
+    dst[n] = '\0';
+    return dst;
+}
+
+// v in decimal into dst (room for 11 bytes), NUL-terminated
+static inline char *u32_to_str(uint32_t v, char *dst) {
+    char tmp[10];
+    int i = 0;
+    do { tmp[i++] = (char)('0' + v % 10); v /= 10; } while (v);
+    char *p = dst;
+    while (i--) *p++ = tmp[i];
+    *p = '\0';
+    return dst;
+}
+
+// One message of len bytes with nfds descriptors attached
+static inline int sess_send(int sock, const void *msg, size_t len, const int *fds, int nfds) {
+    union {
+        struct cmsghdr h;
+        char buf[CMSG_SPACE(sizeof(int) * SESSION_FDS)];
+    } ctl;
+    struct iovec iov = { (void *)msg, len };
+    struct msghdr mh = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if (nfds > 0) {
+        memset(&ctl, 0, sizeof(ctl));
+        mh.msg_control = ctl.buf;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds);
+        struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)nfds);
+        memcpy(CMSG_DATA(c), fds, sizeof(int) * (size_t)nfds);
+    }
+    for (;;) {
+        ssize_t n = sendmsg(sock, &mh, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        return n == (ssize_t)len ? 0 : -1;
+    }
+}
+
+// Receives one message of exactly len bytes and up to maxfds descriptors
+// (close-on-exec). Returns the number of descriptors, -1 on an error or a
+// short message, -2 on EOF. Descriptors of a bad message are closed.
+static inline int sess_recv(int sock, void *msg, size_t len, int *fds, int maxfds) {
+    union {
+        struct cmsghdr h;
+        char buf[CMSG_SPACE(sizeof(int) * SESSION_FDS)];
+    } ctl;
+    struct iovec iov = { msg, len };
+    struct msghdr mh = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl.buf,
+                         .msg_controllen = sizeof(ctl.buf) };
+    ssize_t n;
+    do n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    while (n < 0 && errno == EINTR);
+    if (n == 0) return -2;
+
+    int got = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int k = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < k; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + sizeof(int) * (size_t)i, sizeof(int));
+            if (got < maxfds) fds[got++] = fd;
+            else close(fd);
+        }
+    }
+    if (n != (ssize_t)len || (mh.msg_flags & MSG_CTRUNC)) {
+        while (got > 0) close(fds[--got]);
+        return -1;
+    }
+    return got;
+}
+
+// Whether the other end of a session connection has gone. Nothing is sent
+// between the request and the status byte, so anything readable there is EOF
+// (or the status of a client that has just closed the ring: check closed
+// after this).
+static inline int sess_peer_gone(int sock) {
+    struct pollfd p = { .fd = sock, .events = POLLIN };
+    int n;
+    do n = poll(&p, 1, 0);
+    while (n < 0 && errno == EINTR);
+    return n > 0;
+}
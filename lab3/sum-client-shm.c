@@ -6,14 +6,22 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
-#include <ctype.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <semaphore.h>
+#include <time.h>
+#include "shm-ring.h"
+#include "shm-session.h"
+#include "sumparse.h"
+#include "outbuf.h"
 
 #define SHM_NAME "/sum_shm"
 #define SEM_DATA_READY "/sum_data_ready"
 #define SEM_PROCESSED "/sum_processed"
 #define BUF_SIZE 8192
+// Longest line, its newline included; longer lines are skipped whole with a
+// warning in every mode, wherever they fall relative to buffers and slots
+#define LINE_MAX_BYTES BUF_SIZE
 
 typedef struct {
     char buf[BUF_SIZE];
@@ -46,56 +54,412 @@ static char *i64_to_str(long long v, char *dst) {
     return dst;
 }
 
+static void warn_long_line(void) {
+    const char msg[] = "warning: input line too long, skipped\n";
+    write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+}
+
+static void die_output(void) {
+    const char msg[] = "error: failed to write output file\n";
+    write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+    _exit(EXIT_FAILURE);
+}
+
+// Where the sums go: the buffered output file, or memory (the sum slot of
+// --worker; a sum is no longer than the line it comes from, so with the
+// newlines the sums of a chunk always fit in a slot of the same size)
+typedef struct {
+    outbuf_t *file;
+    char *mem;
+    size_t len;
+} sink_t;
+
+// Room for one sum and its newline
+static char *sink_space(sink_t *s) {
+    if (s->mem) return s->mem + s->len;
+    char *w = ob_space(s->file, 32);
+    if (!w) die_output();
+    return w;
+}
+
+static void sink_commit(sink_t *s, char *end) {
+    if (s->mem) s->len = (size_t)(end - s->mem);
+    else ob_commit(s->file, end);
+}
+
+// Writes the sum of every complete line in buf[0..len) to out; *used is
+// set past the last newline. Returns 1 at an empty line (end of input).
+static int sum_lines(const char *buf, size_t len, size_t *used, sink_t *out) {
+    const char *start = buf;
+    const char *end = buf + len;
+    int done = 0;
+    for (;;) {
+        const char *nl = sp_find_newline(start, end);
+        if (nl == end) break;
+        if (nl == start) {
+            done = 1;
+            break;
+        }
+        if ((size_t)(nl - start) + 1 > LINE_MAX_BYTES) {
+            warn_long_line();
+            start = nl + 1;
+            continue;
+        }
+
+        int clamped = 0;
+        long long sum = sp_line_sum(start, nl, &clamped);
+        while (clamped--) {
+            const char msg[] = "warning: integer out of range, clamped\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        }
+
+        // Write sum followed by newline to file
+        char *w = sink_space(out);
+        w = i64_to_str(sum, w);
+        *w++ = '\n';
+        sink_commit(out, w);
+
+        // Move to next line
+        start = nl + 1;
+    }
+    *used = (size_t)(start - buf);
+    return done;
+}
+
+// sem_wait for at most ms milliseconds; -1 with ETIMEDOUT when it ran out
+static int sem_wait_ms(sem_t *sem, int ms) {
+    if (ms == 0) return sem_trywait(sem);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return sem_timedwait(sem, &ts);
+}
+
+// Same over inbuf[0..*in_len), keeping the unfinished tail at the start.
+// An unfinished tail already too long to be a line is dropped and *skip set:
+// the rest of that line is dropped from the following buffers, so the tail
+// never exceeds LINE_MAX_BYTES - 1 and a whole buffer always fits after it.
+static int process_lines(char *inbuf, size_t *in_len, int *skip, sink_t *out) {
+    size_t start = 0;
+    if (*skip) {
+        const char *nl = memchr(inbuf, '\n', *in_len);
+        if (!nl) {
+            *in_len = 0;
+            return 0;
+        }
+        start = (size_t)(nl - inbuf) + 1;
+        *skip = 0;
+    }
+    size_t used;
+    if (sum_lines(inbuf + start, *in_len - start, &used, out)) return 1;
+    start += used;
+
+    size_t rem = *in_len - start;
+    if (rem >= LINE_MAX_BYTES) {
+        warn_long_line();
+        *skip = 1;
+        rem = 0;
+    }
+    memmove(inbuf, inbuf + start, rem);
+    *in_len = rem;
+    return 0;
+}
+
+// A line that spans slots: its start is copied here until the newline shows
+// up. Lines longer than LINE_MAX_BYTES are dropped up to their newline.
+typedef struct {
+    char buf[LINE_MAX_BYTES];
+    size_t len;
+    int skip;
+} carry_t;
+
+static void carry_add(carry_t *c, const char *p, size_t n) {
+    if (c->skip) return;
+    if (c->len + n > sizeof(c->buf)) {
+        warn_long_line();
+        c->len = 0;
+        c->skip = 1;
+        return;
+    }
+    memcpy(c->buf + c->len, p, n);
+    c->len += n;
+}
+
+// Maps the whole ring segment; its size comes from the server
+static void *map_rings(int shm_fd, size_t *size) {
+    struct stat st;
+    if (fstat(shm_fd, &st) == -1 || (size_t)st.st_size < sizeof(ring_hdr_t)) {
+        const char msg[] = "error: bad ring segment\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    void *shm = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (shm == MAP_FAILED) {
+        const char msg[] = "error: failed to mmap shared memory\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return NULL;
+    }
+    // a daemon session brings its own segment, so it is checked
+    ring_hdr_t *r = shm;
+    if (r->nslots < 2 || (r->nslots & (r->nslots - 1)) || r->slot_size < 64 ||
+        r->slot_size > RING_MAX_SLOT_SIZE || ring_bytes(r->nslots, r->slot_size) > *size) {
+        const char msg[] = "error: bad ring segment\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        munmap(shm, *size);
+        return NULL;
+    }
+    return shm;
+}
+
+// --worker K (sum-server-shm -j N): chunks of whole lines come in ring 2K,
+// their sums go out under the same seq in ring 2K + 1
+static int run_worker(int shm_fd, unsigned k) {
+    size_t size;
+    ring_hdr_t *r0 = map_rings(shm_fd, &size);
+    if (!r0) return EXIT_FAILURE;
+    if ((size_t)(2 * k + 2) * ring_bytes(r0->nslots, r0->slot_size) > size) {
+        const char msg[] = "error: no rings for this worker\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        munmap(r0, size);
+        return EXIT_FAILURE;
+    }
+    ring_hdr_t *in = ring_at(r0, 2 * k, r0->nslots, r0->slot_size);
+    ring_hdr_t *out = ring_at(r0, 2 * k + 1, r0->nslots, r0->slot_size);
+
+    for (;;) {
+        ring_slot_t *chunk = ring_consume_begin(in);
+        ring_slot_t *sums = ring_produce_begin(out); // the merger never closes
+        sink_t sink = { .file = NULL, .mem = sums->data, .len = 0 };
+        size_t used;
+        if (chunk->len) sum_lines(chunk->data, chunk->len, &used, &sink);
+        sums->len = (uint32_t)sink.len;
+        sums->seq = chunk->seq;
+        ring_produce_end(out);
+        ring_consume_end(in);
+        if (!chunk->len) break; // EOF, passed on to the merger
+    }
+
+    munmap(r0, size);
+    return EXIT_SUCCESS;
+}
+
+// The next filled slot. Buffered sums wait for it only up to the latency
+// bound; a pool client also gives up on it, returning NULL, once the session
+// on peer (else -1) has hung up.
+static ring_slot_t *next_slot(ring_hdr_t *r, sink_t *out, int peer) {
+    for (;;) {
+        int wait_ms = ob_ms_left(out->file);
+        if (wait_ms < 0 && peer < 0) return ring_consume_begin(r);
+        if (peer >= 0 && (wait_ms < 0 || wait_ms > RING_CHECK_MS)) wait_ms = RING_CHECK_MS;
+        ring_slot_t *slot = ring_consume_timed(r, wait_ms);
+        if (slot) return slot;
+        if (ob_ms_left(out->file) == 0 && ob_flush(out->file) == -1) die_output();
+        if (peer >= 0 && sess_peer_gone(peer)) return NULL;
+    }
+}
+
+// --ring: parse every slot in place until the EOF slot or an empty line;
+// only the pieces of lines that cross a slot boundary are copied
+static int run_ring(int shm_fd, sink_t *out, int peer) {
+    size_t size;
+    ring_hdr_t *r = map_rings(shm_fd, &size);
+    if (!r) return EXIT_FAILURE;
+
+    static carry_t carry;
+    carry.len = 0; // a pool client runs one session after another
+    carry.skip = 0;
+    int done = 0;
+    while (!done) {
+        ring_slot_t *slot = next_slot(r, out, peer);
+        if (!slot) {
+            munmap(r, size);
+            return EXIT_FAILURE;
+        }
+        size_t len = slot->len;
+        if (len == 0) break; // EOF
+        const char *p = slot->data;
+        size_t used = 0;
+
+        // finish the line carried over from the previous slots
+        if (carry.len || carry.skip) {
+            const char *nl = memchr(p, '\n', len);
+            used = nl ? (size_t)(nl - p) + 1 : len;
+            carry_add(&carry, p, used);
+            if (nl) {
+                size_t u;
+                if (!carry.skip) done = sum_lines(carry.buf, carry.len, &u, out);
+                carry.len = 0;
+                carry.skip = 0;
+            }
+        }
+        if (!done && used < len) {
+            size_t u;
+            done = sum_lines(p + used, len - used, &u, out);
+            used += u;
+            if (!done) carry_add(&carry, p + used, len - used);
+        }
+        // the slot goes back to the server only now: it is parsed in place
+        ring_consume_end(r);
+    }
+    // Empty line => finish, the server may still be producing
+    if (done) ring_close(r);
+
+    munmap(r, size);
+    return EXIT_SUCCESS;
+}
+
+// One daemon session on conn: the request carries the ring segment, the
+// output file and the stderr of sum-server-shm --connect; warnings go to that
+// stderr while the session lasts. Answers with the status byte.
+static void serve_session(int conn, int own_stderr) {
+    session_req_t req;
+    int fds[SESSION_FDS];
+    int n = sess_recv(conn, &req, sizeof(req), fds, SESSION_FDS);
+    if (n != SESSION_FDS || req.magic != SESSION_MAGIC) {
+        while (n > 0) close(fds[--n]);
+        // EOF: the session gave up before its request (no output file)
+        if (n == -2) return;
+        const char msg[] = "warning: bad session request\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return;
+    }
+    dup2(fds[2], STDERR_FILENO);
+    close(fds[2]);
+
+    unsigned char status = 1;
+    outbuf_t out;
+    if (ob_attach(&out, fds[1]) == -1) {
+        const char msg[] = "error: failed to set up output file\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+    } else {
+        sink_t sink = { .file = &out, .mem = NULL, .len = 0 };
+        int rc = run_ring(fds[0], &sink, conn);
+        if (ob_close(&out) == -1) die_output();
+        status = rc != EXIT_SUCCESS;
+    }
+    close(fds[0]);
+    // the file is complete before the session hears about it; a session
+    // that is gone is reported on the pool's own stderr
+    int sent = send(conn, &status, 1, MSG_NOSIGNAL) == 1;
+    dup2(own_stderr, STDERR_FILENO);
+    if (!sent) {
+        const char msg[] = "warning: session left before its status\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+    }
+}
+
+// --pool (sum-server-shm --daemon): a warm client. The daemon sends the
+// accepted session connections over ctl, one at a time; a byte back means
+// idle again. EOF on ctl means the daemon is gone.
+static int run_pool(int ctl) {
+    int own_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3);
+    if (own_stderr == -1) return EXIT_FAILURE;
+    for (;;) {
+        char tag;
+        int conn;
+        int n = sess_recv(ctl, &tag, 1, &conn, 1);
+        if (n == -2) break;
+        if (n != 1) {
+            const char msg[] = "error: bad message from the daemon\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            return EXIT_FAILURE;
+        }
+        serve_session(conn, own_stderr);
+        close(conn);
+        if (send(ctl, "", 1, MSG_NOSIGNAL) != 1) break;
+    }
+    close(own_stderr);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char **argv) {
     if (argc < 2) {
-        const char msg[] = "usage: sum-client-shm <output_file>\n";
+        const char msg[] = "usage: sum-client-shm <output_file> [--ring [--worker K]] | --pool\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
         _exit(EXIT_FAILURE);
     }
+    if (strcmp(argv[1], "--pool") == 0) return run_pool(STDIN_FILENO);
 
-    int out = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0600);
-    if (out == -1) {
+    char shm_nm[64], ready_nm[64], done_nm[64];
+    shm_name(shm_nm, sizeof(shm_nm), SHM_NAME);
+    shm_name(ready_nm, sizeof(ready_nm), SEM_DATA_READY);
+    shm_name(done_nm, sizeof(done_nm), SEM_PROCESSED);
+
+    if (argc > 4 && strcmp(argv[2], "--ring") == 0 && strcmp(argv[3], "--worker") == 0) {
+        // the merge process writes the file
+        int shm_fd = shm_open(shm_nm, O_RDWR, 0600);
+        if (shm_fd == -1) {
+            const char msg[] = "error: failed to open shared memory\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            _exit(EXIT_FAILURE);
+        }
+        int rc = run_worker(shm_fd, (unsigned)strtoul(argv[4], NULL, 10));
+        close(shm_fd);
+        return rc;
+    }
+
+    outbuf_t out;
+    if (ob_open(&out, argv[1]) == -1) {
         const char msg[] = "error: failed to open output file\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
         _exit(EXIT_FAILURE);
     }
 
     // Open shared memory
-    int shm_fd = shm_open(SHM_NAME, O_RDWR, 0600);
+    int shm_fd = shm_open(shm_nm, O_RDWR, 0600);
     if (shm_fd == -1) {
         const char msg[] = "error: failed to open shared memory\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-        close(out);
+        ob_close(&out);
         _exit(EXIT_FAILURE);
     }
 
+    sink_t sink = { .file = &out, .mem = NULL, .len = 0 };
+    if (argc > 2 && strcmp(argv[2], "--ring") == 0) {
+        int rc = run_ring(shm_fd, &sink, -1);
+        close(shm_fd);
+        if (ob_close(&out) == -1) die_output();
+        return rc;
+    }
+
     shared_data_t *data = mmap(NULL, sizeof(shared_data_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
     if (data == MAP_FAILED) {
         const char msg[] = "error: failed to mmap shared memory\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
         close(shm_fd);
-        close(out);
+        ob_close(&out);
         _exit(EXIT_FAILURE);
     }
     close(shm_fd);
 
     // Open semaphores
-    sem_t *sem_data_ready = sem_open(SEM_DATA_READY, 0);
-    sem_t *sem_processed = sem_open(SEM_PROCESSED, 0);
+    sem_t *sem_data_ready = sem_open(ready_nm, 0);
+    sem_t *sem_processed = sem_open(done_nm, 0);
     if (sem_data_ready == SEM_FAILED || sem_processed == SEM_FAILED) {
         const char msg[] = "error: failed to open semaphores\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
         munmap(data, sizeof(shared_data_t));
-        close(out);
+        ob_close(&out);
         _exit(EXIT_FAILURE);
     }
 
-    char inbuf[BUF_SIZE];
+    // a partial line (shorter than LINE_MAX_BYTES) plus a whole buffer
+    char inbuf[LINE_MAX_BYTES + BUF_SIZE];
     size_t in_len = 0;
+    int skip = 0;
 
     for (;;) {
-        // Wait for data
-        if (sem_wait(sem_data_ready) == -1) {
+        // Wait for data; buffered sums wait only up to the latency bound
+        int wait_ms = ob_ms_left(&out);
+        int got = wait_ms >= 0 && sem_wait_ms(sem_data_ready, wait_ms) == 0;
+        if (!got && wait_ms >= 0 && ob_flush(&out) == -1) die_output();
+        if (!got && sem_wait(sem_data_ready) == -1) {
             if (errno == EINTR) continue;
             const char msg[] = "error: sem_wait failed\n";
             write_all(STDERR_FILENO, msg, sizeof(msg)-1);
@@ -108,80 +472,24 @@ int main(int argc, char **argv) {
         }
 
         // Copy data to local buffer
-        size_t to_copy = data->len;
-        if (in_len + to_copy > sizeof(inbuf)) {
-            to_copy = sizeof(inbuf) - in_len;
-        }
-        memcpy(inbuf + in_len, data->buf, to_copy);
-        in_len += to_copy;
+        size_t n = data->len < BUF_SIZE ? data->len : BUF_SIZE;
+        memcpy(inbuf + in_len, data->buf, n);
+        in_len += n;
 
         // Signal processed
         sem_post(sem_processed);
 
-        // Process complete lines
-        size_t start = 0;
-        for (size_t i = 0; i < in_len; ++i) {
-            if (inbuf[i] == '\n') {
-                size_t linelen = i - start; // not including \n
-                if (linelen == 0) {
-                    // Empty line => finish
-                    close(out);
-                    munmap(data, sizeof(shared_data_t));
-                    sem_close(sem_data_ready);
-                    sem_close(sem_processed);
-                    _exit(EXIT_SUCCESS);
-                }
-
-                // Parse ints and compute sum
-                long long sum = 0;
-                char *p = inbuf + start;
-                char *end = inbuf + i;
-                while (p < end) {
-                    // skip spaces
-                    while (p < end && isspace((unsigned char)*p)) p++;
-                    if (p >= end) break;
-                    errno = 0;
-                    char *q = NULL;
-                    long val = strtol(p, &q, 10);
-                    if (q == p) {
-                        // invalid token, skip one char
-                        p++;
-                        continue;
-                    }
-                    if (errno == ERANGE) {
-                        const char msg[] = "warning: integer out of range, clamped\n";
-                        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-                    }
-                    sum += (long long)val;
-                    p = q;
-                }
-
-                // Write sum followed by newline to file
-                char outbuf[64];
-                char *w = outbuf;
-                w = i64_to_str(sum, w);
-                *w++ = '\n';
-                write_all(out, outbuf, (size_t)(w - outbuf));
-
-                // Move to next line
-                start = i + 1;
-            }
-        }
-
-        if (start > 0) {
-            // Move leftover to beginning
-            size_t rem = in_len - start;
-            memmove(inbuf, inbuf + start, rem);
-            in_len = rem;
-        } else if (in_len == sizeof(inbuf)) {
-            // Line too long without newline; drop buffer (or could error)
-            const char msg[] = "warning: input line too long, truncating\n";
-            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-            in_len = 0;
+        if (process_lines(inbuf, &in_len, &skip, &sink)) {
+            // Empty line => finish
+            if (ob_close(&out) == -1) die_output();
+            munmap(data, sizeof(shared_data_t));
+            sem_close(sem_data_ready);
+            sem_close(sem_processed);
+            _exit(EXIT_SUCCESS);
         }
     }
 
-    close(out);
+    if (ob_close(&out) == -1) die_output();
     munmap(data, sizeof(shared_data_t));
     sem_close(sem_data_ready);
     sem_close(sem_processed);
@@ -5,15 +5,23 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
+#include <poll.h>
 #include <sys/wait.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <fcntl.h>
 #include <semaphore.h>
+#include "shm-ring.h"
+#include "shm-session.h"
+#include "trace.h"
 
 #define SHM_NAME "/sum_shm"
 #define SEM_DATA_READY "/sum_data_ready"
 #define SEM_PROCESSED "/sum_processed"
 #define BUF_SIZE 8192
+#define MAX_JOBS 64
 
 typedef struct {
     char buf[BUF_SIZE];
@@ -50,7 +58,500 @@ static int read_line(int fd, char *buf, size_t cap) {
     return (int)n;
 }
 
+static void usage(void) {
+    const char msg[] = "usage: sum-server-shm [--ring] [-j N] [--slots N] [--slot-size BYTES]\n"
+                       "       sum-server-shm --daemon SOCK [--pool N]\n"
+                       "       sum-server-shm --connect SOCK [--slots N] [--slot-size BYTES]\n"
+                       "  --ring            slot ring instead of the lockstep 8 KiB buffer\n"
+                       "  -j N              N clients summing chunks in parallel (implies --ring)\n"
+                       "  --slots N         ring slots, a power of two (default 16)\n"
+                       "  --slot-size B     bytes per slot (default 65536)\n"
+                       "  --daemon SOCK     keep warm clients and serve sessions on the socket SOCK\n"
+                       "  --pool N          warm clients of the daemon (default 4)\n"
+                       "  --connect SOCK    run this session on the daemon at SOCK (ring mode)\n";
+    write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+}
+
+// Lockstep mode: one 8 KiB buffer, the client signals when it has taken it.
+// stdin is read straight into the shared buffer.
+static void serve_sem(shared_data_t *data, sem_t *sem_data_ready, sem_t *sem_processed) {
+    for (;;) {
+        // Fill buffer
+        ssize_t r = read(STDIN_FILENO, data->buf, sizeof(data->buf));
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            const char msg[] = "error: failed to read from stdin\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            break;
+        }
+        if (r == 0) {
+            // EOF
+            data->len = 0;
+            data->eof = 1;
+            sem_post(sem_data_ready);
+            break;
+        }
+        data->len = (size_t)r;
+        data->eof = 0;
+        TRACE_VALUE("sem_bytes", r);
+
+        // Signal data ready
+        sem_post(sem_data_ready);
+
+        // Wait for processed
+        TRACE_BEGIN(trace_t0);
+        while (sem_wait(sem_processed) == -1) {
+            if (errno == EINTR) continue;
+            const char msg[] = "error: sem_wait processed failed\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            return;
+        }
+        TRACE_END("sem_processed_wait", trace_t0);
+    }
+}
+
+// --ring: stdin is read straight into the next free slot while the client
+// parses the filled ones in place. Returns -1 on a read error; the EOF slot
+// is published either way. A --connect session passes its connection as
+// peer (else -1) and returns -1 without EOF once the pool client is gone.
+static int serve_ring(ring_hdr_t *r, int peer) {
+    int rc = 0;
+    for (;;) {
+        ring_slot_t *slot;
+        if (peer < 0) {
+            slot = ring_produce_begin(r);
+        } else {
+            while (!(slot = ring_produce_timed(r, RING_CHECK_MS)) && !atomic_load(&r->closed)) {
+                if (sess_peer_gone(peer) && !atomic_load(&r->closed)) {
+                    const char msg[] = "error: pool client died\n";
+                    write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+                    return -1;
+                }
+            }
+        }
+        if (!slot) break; // client saw the empty line and left
+        ssize_t n = read(STDIN_FILENO, slot->data, r->slot_size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            const char msg[] = "error: failed to read from stdin\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            n = 0;
+            rc = -1;
+        }
+        slot->len = (uint32_t)n;
+        TRACE_VALUE("ring_bytes", n);
+        ring_produce_end(r);
+        if (n == 0) break; // EOF
+    }
+    return rc;
+}
+
+// -j N: stdin is read into slots of the worker rings in turn; a slot is cut
+// after its last newline and numbered, the partial line goes on to the start
+// of the next worker's slot. The empty line ends the input here, so workers
+// only ever see whole non-empty lines. Every worker gets an EOF slot at the
+// end. Returns -1 on a read error.
+static int dispatch_ring_chunks(void *shm, int jobs) {
+    ring_hdr_t *r0 = shm;
+    uint32_t nslots = r0->nslots, slot_size = r0->slot_size;
+    uint32_t seq = 0;
+    ring_hdr_t *r = NULL;
+    ring_slot_t *slot = NULL;
+    const char *tail = NULL; // unfinished line in the last published slot
+    size_t tail_len = 0, fill = 0;
+    int skip = 0; // inside a line longer than a slot: drop up to its '\n'
+    int rc = 0;
+    for (;;) {
+        if (!slot) {
+            // workers never close their rings, so a slot always comes
+            r = ring_at(shm, 2 * (seq % (unsigned)jobs), nslots, slot_size);
+            slot = ring_produce_begin(r);
+            memcpy(slot->data, tail, tail_len);
+            fill = tail_len;
+        }
+        ssize_t n = read(STDIN_FILENO, slot->data + fill, slot_size - fill);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            const char msg[] = "error: failed to read from stdin\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            rc = -1;
+            break;
+        }
+        if (n == 0) break; // a last line without '\n' is dropped, as by the client
+        fill += (size_t)n;
+        if (skip) {
+            char *nl = memchr(slot->data, '\n', fill);
+            if (!nl) {
+                fill = 0;
+                continue;
+            }
+            fill -= (size_t)(nl - slot->data) + 1;
+            memmove(slot->data, nl + 1, fill);
+            skip = 0;
+        }
+
+        char *last = memrchr(slot->data, '\n', fill);
+        if (!last) {
+            if (fill == slot_size) {
+                const char msg[] = "warning: input line too long, skipped\n";
+                write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+                fill = 0;
+                skip = 1;
+            }
+            continue;
+        }
+        size_t len = (size_t)(last - slot->data) + 1;
+        tail = last + 1;
+        tail_len = fill - len;
+
+        // the slot starts a line: an empty line is a leading '\n' or "\n\n"
+        char *empty = slot->data[0] == '\n' ? slot->data : memmem(slot->data, len, "\n\n", 2);
+        if (empty) len = (size_t)(empty - slot->data) + (empty != slot->data);
+        if (len > 0) {
+            slot->len = (uint32_t)len;
+            slot->seq = seq++;
+            TRACE_VALUE("ring_bytes", len);
+            ring_produce_end(r);
+            slot = NULL;
+        }
+        if (empty) break;
+    }
+
+    for (int k = 0; k < jobs; k++) {
+        // an unpublished slot is simply handed out again here
+        ring_hdr_t *in = ring_at(shm, 2 * (unsigned)k, nslots, slot_size);
+        ring_slot_t *eof = ring_produce_begin(in);
+        eof->len = 0;
+        eof->seq = RING_SEQ_EOF;
+        ring_produce_end(in);
+    }
+    return rc;
+}
+
+// -j N merge process: chunk seq was summed by worker seq % jobs, and each
+// worker answers its chunks in order, so taking the sum rings in turn restores
+// the input order; seq is only checked. Stops at the EOF slot of the worker
+// whose turn it is.
+static int merge_ring_output(void *shm, int jobs, const char *filename) {
+    int out = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (out == -1) {
+        const char msg[] = "error: failed to open output file\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return EXIT_FAILURE;
+    }
+    ring_hdr_t *r0 = shm;
+    uint32_t nslots = r0->nslots, slot_size = r0->slot_size;
+    for (uint32_t seq = 0;; seq++) {
+        ring_hdr_t *r = ring_at(shm, 2 * (seq % (unsigned)jobs) + 1, nslots, slot_size);
+        ring_slot_t *slot = ring_consume_begin(r);
+        if (slot->len == 0 && slot->seq == RING_SEQ_EOF) break;
+        if (slot->seq != seq) {
+            const char msg[] = "error: chunk out of order\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            close(out);
+            return EXIT_FAILURE;
+        }
+        write_all(out, slot->data, slot->len);
+        ring_consume_end(r);
+    }
+    close(out);
+    return EXIT_SUCCESS;
+}
+
+// Forks the -j workers and the merge process, feeds the workers and waits for
+// everyone. Returns the exit code for main.
+static int serve_jobs(void *shm, int jobs, char *filename) {
+    pid_t pids[MAX_JOBS + 1]; // pids[jobs] is the merge process
+    for (int k = 0; k <= jobs; k++) {
+        pids[k] = fork();
+        if (pids[k] < 0) {
+            const char msg[] = "error: failed to fork\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            _exit(EXIT_FAILURE);
+        }
+        if (pids[k] > 0) continue;
+        if (k == jobs) {
+            int rc = merge_ring_output(shm, jobs, filename);
+            TRACE_DUMP();
+            _exit(rc);
+        }
+
+        char w[16];
+        u32_to_str((uint32_t)k, w);
+        char *const args[] = { (char*)"sum-client-shm", filename, (char*)"--ring", (char*)"--worker", w, NULL };
+        execv("./sum-client-shm", args);
+        const char msg[] = "error: failed to exec sum-client-shm\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        _exit(EXIT_FAILURE);
+    }
+
+    int failed = dispatch_ring_chunks(shm, jobs) < 0;
+    for (int k = 0; k <= jobs; k++) {
+        int status = 0;
+        if (waitpid(pids[k], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = 1;
+    }
+    if (failed) {
+        const char msg[] = "error: child exited with error\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// --daemon: a warm `sum-client-shm --pool` with the daemon end of its
+// socketpair
+typedef struct {
+    pid_t pid;
+    int ctl;
+    int idle;
+} pool_client_t;
+
+static const char *daemon_path;
+
+static void daemon_stop(int sig) {
+    (void)sig;
+    unlink(daemon_path);
+    TRACE_DUMP();
+    _exit(EXIT_SUCCESS);
+}
+
+static int spawn_pool_client(pool_client_t *c) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) return -1;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // dup2 clears close-on-exec, the other clients' ends stay closed
+        dup2(sv[1], STDIN_FILENO);
+        char *const args[] = { (char*)"sum-client-shm", (char*)"--pool", NULL };
+        execv("./sum-client-shm", args);
+        const char msg[] = "error: failed to exec sum-client-shm\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        _exit(EXIT_FAILURE);
+    }
+    close(sv[1]);
+    c->pid = pid;
+    c->ctl = sv[0];
+    c->idle = 1;
+    return 0;
+}
+
+// Binds the listening socket; a socket file nobody listens on is left over
+// from a daemon that was killed, and is replaced
+static int listen_on(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        const char msg[] = "error: socket path too long\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return -1;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        const char msg[] = "error: a daemon already listens on this socket\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        close(fd);
+        return -1;
+    }
+    if (errno == ECONNREFUSED) unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 64) == -1) {
+        const char msg[] = "error: failed to listen on the socket\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// --daemon: accepts sessions while some pool client is idle and passes each
+// connection to one; the rest wait in the listen backlog. A pool client that
+// dies is replaced, its session sees EOF instead of a status. Runs until
+// SIGINT/SIGTERM.
+static int run_daemon(const char *path, int pool) {
+    int lfd = listen_on(path);
+    if (lfd == -1) return EXIT_FAILURE;
+    daemon_path = path;
+    signal(SIGINT, daemon_stop);
+    signal(SIGTERM, daemon_stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    pool_client_t clients[MAX_JOBS];
+    for (int k = 0; k < pool; k++) {
+        if (spawn_pool_client(&clients[k]) == -1) {
+            const char msg[] = "error: failed to fork\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            unlink(path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (;;) {
+        struct pollfd pfd[MAX_JOBS + 1];
+        int idle = 0;
+        for (int k = 0; k < pool; k++) {
+            pfd[k] = (struct pollfd){ clients[k].ctl, POLLIN, 0 };
+            idle += clients[k].idle;
+        }
+        pfd[pool] = (struct pollfd){ idle ? lfd : -1, POLLIN, 0 };
+        if (poll(pfd, (nfds_t)pool + 1, -1) == -1) {
+            if (errno == EINTR) continue;
+            const char msg[] = "error: poll failed\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            break;
+        }
+
+        for (int k = 0; k < pool; k++) {
+            if (!pfd[k].revents) continue;
+            char b;
+            ssize_t n = recv(clients[k].ctl, &b, 1, 0);
+            if (n == 1) {
+                clients[k].idle = 1;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            close(clients[k].ctl);
+            waitpid(clients[k].pid, NULL, 0);
+            const char msg[] = "warning: pool client died, restarting it\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            if (spawn_pool_client(&clients[k]) == -1) {
+                const char err[] = "error: failed to fork\n";
+                write_all(STDERR_FILENO, err, sizeof(err)-1);
+                unlink(path);
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (pfd[pool].revents & POLLIN) {
+            int conn = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+            if (conn == -1) continue;
+            int k = 0;
+            while (!clients[k].idle) k++;
+            if (sess_send(clients[k].ctl, "s", 1, &conn, 1) == 0) clients[k].idle = 0;
+            close(conn);
+        }
+    }
+    unlink(path);
+    return EXIT_FAILURE;
+}
+
+// --connect: the session's ring lives in a memfd, passed to the daemon with
+// the output file and stderr; stdin is then served into the ring as in
+// --ring. The status byte comes once the file is complete.
+static int run_session(const char *path, const char *filename, uint32_t nslots, uint32_t slot_size) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        const char msg[] = "error: socket path too long\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return EXIT_FAILURE;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        const char msg[] = "error: failed to connect to the daemon\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return EXIT_FAILURE;
+    }
+
+    size_t shm_size = ring_bytes(nslots, slot_size);
+    int out = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (out == -1) {
+        const char msg[] = "error: failed to open output file\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        close(sock);
+        return EXIT_FAILURE;
+    }
+    int shm_fd = memfd_create("sum_shm", MFD_CLOEXEC);
+    void *shm = MAP_FAILED;
+    if (shm_fd != -1 && ftruncate(shm_fd, (off_t)shm_size) == 0)
+        shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (shm == MAP_FAILED) {
+        const char msg[] = "error: failed to create shared memory\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        close(out);
+        close(sock);
+        return EXIT_FAILURE;
+    }
+    ring_init(shm, nslots, slot_size);
+
+    session_req_t req = { .magic = SESSION_MAGIC, .pad = 0 };
+    int fds[SESSION_FDS] = { shm_fd, out, STDERR_FILENO };
+    int rc = sess_send(sock, &req, sizeof(req), fds, SESSION_FDS);
+    close(shm_fd);
+    close(out);
+    if (rc == 0 && serve_ring(shm, sock) == -1) rc = -1;
+
+    unsigned char status = 1;
+    ssize_t n = -1;
+    if (rc == 0) {
+        do n = recv(sock, &status, 1, 0);
+        while (n < 0 && errno == EINTR);
+    }
+    munmap(shm, shm_size);
+    close(sock);
+    if (n == 1 && status == 0) return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    const char msg[] = "error: session failed\n";
+    write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+    return EXIT_FAILURE;
+}
+
 int main(int argc, char **argv) {
+    int ring = 0, jobs = 1, pool = 4;
+    const char *daemon_sock = NULL, *connect_sock = NULL;
+    unsigned long nslots = RING_DEFAULT_SLOTS, slot_size = RING_DEFAULT_SLOT_SIZE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ring") == 0) {
+            ring = 1;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--slots") == 0 && i + 1 < argc) {
+            nslots = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--slot-size") == 0 && i + 1 < argc) {
+            slot_size = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) {
+            daemon_sock = argv[++i];
+        } else if (strcmp(argv[i], "--pool") == 0 && i + 1 < argc) {
+            pool = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connect_sock = argv[++i];
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (nslots < 2 || nslots > 65536 || (nslots & (nslots - 1)) ||
+        slot_size < 64 || slot_size > RING_MAX_SLOT_SIZE) {
+        const char msg[] = "error: --slots must be a power of two in 2..65536, --slot-size in 64..64M\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return EXIT_FAILURE;
+    }
+    if (jobs < 1 || jobs > MAX_JOBS) {
+        const char msg[] = "error: -j must be in 1..64\n";
+        write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+        return EXIT_FAILURE;
+    }
+    if ((daemon_sock && connect_sock) || ((daemon_sock || connect_sock) && jobs > 1)) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (daemon_sock) {
+        if (pool < 1 || pool > MAX_JOBS) {
+            const char msg[] = "error: --pool must be in 1..64\n";
+            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
+            return EXIT_FAILURE;
+        }
+        return run_daemon(daemon_sock, pool);
+    }
+    // workers and the merge process talk over rings only
+    if (jobs > 1) ring = 1;
+    size_t nrings = jobs > 1 ? 2 * (size_t)jobs : 1;
+    size_t shm_size = ring ? nrings * ring_bytes((uint32_t)nslots, (uint32_t)slot_size) : sizeof(shared_data_t);
+
     // 1) Read output filename from parent's stdin (first line)
     char filename[1024];
     int rl = read_line(STDIN_FILENO, filename, sizeof(filename));
@@ -61,58 +562,79 @@ int main(int argc, char **argv) {
     }
     // strip trailing newline
     if (filename[rl-1] == '\n') filename[rl-1] = '\0';
+    if (connect_sock) return run_session(connect_sock, filename, (uint32_t)nslots, (uint32_t)slot_size);
+
+    // Objects of this run are named after the server pid, the clients find
+    // the names in SUM_SHM_ID
+    char id[16], shm_nm[64], ready_nm[64], done_nm[64];
+    setenv("SUM_SHM_ID", u32_to_str((uint32_t)getpid(), id), 1);
+    shm_name(shm_nm, sizeof(shm_nm), SHM_NAME);
+    shm_name(ready_nm, sizeof(ready_nm), SEM_DATA_READY);
+    shm_name(done_nm, sizeof(done_nm), SEM_PROCESSED);
 
     // Create shared memory
-    int shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0600);
+    int shm_fd = shm_open(shm_nm, O_CREAT | O_RDWR, 0600);
     if (shm_fd == -1) {
         const char msg[] = "error: failed to create shared memory\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
         return EXIT_FAILURE;
     }
-    if (ftruncate(shm_fd, sizeof(shared_data_t)) == -1) {
+    if (ftruncate(shm_fd, (off_t)shm_size) == -1) {
         const char msg[] = "error: failed to ftruncate shared memory\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
         close(shm_fd);
-        shm_unlink(SHM_NAME);
+        shm_unlink(shm_nm);
         return EXIT_FAILURE;
     }
 
-    shared_data_t *data = mmap(NULL, sizeof(shared_data_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-    if (data == MAP_FAILED) {
+    void *shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    shared_data_t *data = shm;
+    if (shm == MAP_FAILED) {
         const char msg[] = "error: failed to mmap shared memory\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
         close(shm_fd);
-        shm_unlink(SHM_NAME);
+        shm_unlink(shm_nm);
         return EXIT_FAILURE;
     }
     close(shm_fd);
+    for (size_t i = 0; ring && i < nrings; i++)
+        ring_init(ring_at(shm, (unsigned)i, (uint32_t)nslots, (uint32_t)slot_size), (uint32_t)nslots, (uint32_t)slot_size);
 
-    sem_t *sem_data_ready = sem_open(SEM_DATA_READY, O_CREAT, 0600, 0);
-    sem_t *sem_processed = sem_open(SEM_PROCESSED, O_CREAT, 0600, 0);
+    sem_t *sem_data_ready = sem_open(ready_nm, O_CREAT, 0600, 0);
+    sem_t *sem_processed = sem_open(done_nm, O_CREAT, 0600, 0);
     if (sem_data_ready == SEM_FAILED || sem_processed == SEM_FAILED) {
         const char msg[] = "error: failed to create semaphores\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-        munmap(data, sizeof(shared_data_t));
-        shm_unlink(SHM_NAME);
+        munmap(shm, shm_size);
+        shm_unlink(shm_nm);
         return EXIT_FAILURE;
     }
 
+    if (jobs > 1) {
+        int rc = serve_jobs(shm, jobs, filename);
+        munmap(shm, shm_size);
+        shm_unlink(shm_nm);
+        sem_unlink(ready_nm);
+        sem_unlink(done_nm);
+        return rc;
+    }
+
     pid_t child = fork();
     if (child < 0) {
         const char msg[] = "error: failed to fork\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-        munmap(data, sizeof(shared_data_t));
-        shm_unlink(SHM_NAME);
-        sem_unlink(SEM_DATA_READY);
-        sem_unlink(SEM_PROCESSED);
+        munmap(shm, shm_size);
+        shm_unlink(shm_nm);
+        sem_unlink(ready_nm);
+        sem_unlink(done_nm);
         return EXIT_FAILURE;
     }
 
     if (child == 0) {
         // Child: exec sum-client-shm
-        munmap(data, sizeof(shared_data_t)); // child will mmap again
+        munmap(shm, shm_size); // child will mmap again
 
-        char *const args[] = { (char*)"sum-client-shm", filename, NULL };
+        char *const args[] = { (char*)"sum-client-shm", filename, ring ? (char*)"--ring" : NULL, NULL };
         execv("./sum-client-shm", args);
 
         const char msg[] = "error: failed to exec sum-client-shm\n";
@@ -121,62 +643,24 @@ int main(int argc, char **argv) {
     }
 
     // Parent
-    char inbuf[BUF_SIZE];
-    size_t in_len = 0;
-
-    for (;;) {
-        // Fill buffer
-        if (in_len < sizeof(inbuf)) {
-            ssize_t r = read(STDIN_FILENO, inbuf + in_len, sizeof(inbuf) - in_len);
-            if (r < 0) {
-                if (errno == EINTR) continue;
-                const char msg[] = "error: failed to read from stdin\n";
-                write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-                break;
-            }
-            if (r == 0) {
-                // EOF
-                data->len = 0;
-                data->eof = 1;
-                sem_post(sem_data_ready);
-                break;
-            }
-            in_len += (size_t)r;
-        }
-
-        // Send data to shared memory
-        data->len = in_len;
-        data->eof = 0;
-        memcpy(data->buf, inbuf, in_len);
-        in_len = 0;
-
-        // Signal data ready
-        sem_post(sem_data_ready);
-
-        // Wait for processed
-        if (sem_wait(sem_processed) == -1) {
-            if (errno == EINTR) continue;
-            const char msg[] = "error: sem_wait processed failed\n";
-            write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-            break;
-        }
-    }
+    if (ring) serve_ring(shm, -1);
+    else serve_sem(data, sem_data_ready, sem_processed);
 
     int status = 0;
     if (waitpid(child, &status, 0) < 0) {
         const char msg[] = "error: waitpid failed\n";
         write_all(STDERR_FILENO, msg, sizeof(msg)-1);
-        munmap(data, sizeof(shared_data_t));
-        shm_unlink(SHM_NAME);
-        sem_unlink(SEM_DATA_READY);
-        sem_unlink(SEM_PROCESSED);
+        munmap(shm, shm_size);
+        shm_unlink(shm_nm);
+        sem_unlink(ready_nm);
+        sem_unlink(done_nm);
         return EXIT_FAILURE;
     }
 
-    munmap(data, sizeof(shared_data_t));
-    shm_unlink(SHM_NAME);
-    sem_unlink(SEM_DATA_READY);
-    sem_unlink(SEM_PROCESSED);
+    munmap(shm, shm_size);
+    shm_unlink(shm_nm);
+    sem_unlink(ready_nm);
+    sem_unlink(done_nm);
 
     if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
         return EXIT_SUCCESS;
@@ -0,0 +1,72 @@
+#!/bin/sh
+# Daemon sessions whose peer dies mid-stream: the survivor must fail the
+# session instead of hanging on the ring, and the daemon must keep serving.
+# Run from lab3 after make (make check).
+set -u
+
+dir=$(mktemp -d)
+sock=$dir/sum.sock
+fail=0
+daemon=
+
+cleanup() {
+    [ -n "$daemon" ] && kill "$daemon" 2>/dev/null
+    exec 3>&- 2>/dev/null
+    rm -rf "$dir"
+}
+trap cleanup EXIT
+
+check() {
+    if [ "$1" -eq 0 ]; then echo "ok: $2"; else echo "FAIL: $2"; fail=1; fi
+}
+
+# One session, no one killed: prints the sums of "1 2" and "3 4 5"
+session_ok() {
+    printf '%s\n1 2\n3 4 5\n\n' "$dir/out.txt" | timeout 5 ./sum-server-shm --connect "$sock" &&
+        [ "$(cat "$dir/out.txt")" = "$(printf '3\n12')" ]
+}
+
+# The only client of the pool
+pool_client() {
+    pgrep -P "$daemon" sum-client-shm
+}
+
+./sum-server-shm --daemon "$sock" --pool 1 2>"$dir/daemon.err" &
+daemon=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do [ -S "$sock" ] && break; sleep 0.1; done
+
+session_ok
+check $? "plain session"
+
+# The session dies while its pool client waits for the next slot
+mkfifo "$dir/in"
+./sum-server-shm --connect "$sock" <"$dir/in" 2>/dev/null &
+session=$!
+exec 3>"$dir/in"
+printf '%s\n1 2\n' "$dir/dead.txt" >&3
+sleep 0.3
+kill -9 "$session"
+wait "$session" 2>/dev/null
+exec 3>&-
+session_ok
+check $? "pool client recovers from a killed session"
+
+# The pool client dies while the session waits for a free slot: stop it so
+# the ring fills up, then kill it
+client=$(pool_client)
+kill -STOP "$client"
+(printf '%s\n' "$dir/big.txt"; yes '1 2 3' | head -n 1000000) |
+    timeout 10 ./sum-server-shm --connect "$sock" --slots 2 --slot-size 4096 2>/dev/null &
+session=$!
+sleep 0.3
+kill -9 "$client"
+wait "$session"
+rc=$?
+[ "$rc" -ne 0 ] && [ "$rc" -ne 124 ]
+check $? "session fails when its pool client is killed (rc=$rc)"
+
+for i in 1 2 3 4 5 6 7 8 9 10; do [ -n "$(pool_client)" ] && break; sleep 0.1; done
+session_ok
+check $? "daemon replaces the killed pool client"
+
+exit $fail
@@ -1,18 +1,110 @@
+#define _GNU_SOURCE // trace.h needs POSIX with -DLAB_TRACE
 #include "free_list.h"
 #include <string.h>
+#include "trace.h"
+
+// Every block starts with a block_header; a free block also ends with a
+// footer holding its size. The successor of a block is at b + b->size and,
+// when prev_free is set, the start of the predecessor is read from the
+// footer right in front of b. Both neighbours are found in O(1) on free.
+
+static inline size_t *footer_of(block_header *b) {
+    return (size_t*)((unsigned char*)b + b->size - sizeof(size_t));
+}
+
+static inline block_header* next_block(block_header *b) {
+    return (block_header*)((unsigned char*)b + b->size);
+}
+
+static inline block_header* prev_block(block_header *b) {
+    size_t prev_size = *((size_t*)b - 1);
+    return (block_header*)((unsigned char*)b - prev_size);
+}
+
+static inline int in_arena(Allocator *a, block_header *b) {
+    return (unsigned char*)b < a->base + a->size;
+}
+
+#ifdef FREE_LIST_SEGREGATED
+static int bin_index(size_t size) {
+    int k = (int)(sizeof(size_t) * 8 - 1) - __builtin_clzl(size);
+    if (k < FL_MIN_BIN_SHIFT) return 0;
+    // FL_BIN_SPLIT linear sub-bins per power of two
+    int sub = (int)(size >> (k - FL_BIN_SPLIT_SHIFT)) & (FL_BIN_SPLIT - 1);
+    int i = (k - FL_MIN_BIN_SHIFT) * FL_BIN_SPLIT + sub;
+    return i < FL_NUM_BINS ? i : FL_NUM_BINS - 1;
+}
+#endif
+
+// Head of the list a free block of this size belongs to
+static inline block_header** list_head(Allocator *a, size_t size) {
+#ifdef FREE_LIST_SEGREGATED
+    return &a->bins[bin_index(size)];
+#else
+    (void)size;
+    return &a->free_list;
+#endif
+}
+
+static void list_insert(Allocator *a, block_header *b) {
+    block_header **head = list_head(a, b->size);
+    block_header *prev = NULL;
+    block_header *next = *head;
+#ifdef FREE_LIST_ADDRESS_ORDERED
+    // Optional policy: keep the list sorted by address (O(n) per free)
+    size_t depth = 0;
+    while (next && next < b) {
+        prev = next;
+        next = next->next;
+        depth++;
+    }
+    TRACE_VALUE("fl_insert_depth", depth);
+#endif
+    b->prev = prev;
+    b->next = next;
+    if (next) next->prev = b;
+    if (prev) prev->next = b; else *head = b;
+#ifdef FREE_LIST_SEGREGATED
+    a->bin_mask |= 1ull << bin_index(b->size);
+#endif
+}
+
+static void list_remove(Allocator *a, block_header *b) {
+    block_header **head = list_head(a, b->size);
+    if (b->prev) b->prev->next = b->next; else *head = b->next;
+    if (b->next) b->next->prev = b->prev;
+#ifdef FREE_LIST_SEGREGATED
+    if (!*head) a->bin_mask &= ~(1ull << bin_index(b->size));
+#endif
+    b->next = b->prev = NULL;
+}
+
+// Mark b free, write its footer and tell the successor about it
+static void mark_free(Allocator *a, block_header *b) {
+    b->free = 1;
+    *footer_of(b) = b->size;
+    block_header *nb = next_block(b);
+    if (in_arena(a, nb)) nb->prev_free = 1;
+}
 
 Allocator* allocator_create(void * memory, size_t size) {
     Allocator *a = (Allocator*)memory;
     a->base = (unsigned char*)memory;
     a->size = size;
 
-    size_t off = align_up(sizeof(Allocator), alignof(block_header));
+    size_t off = align_up(sizeof(Allocator), alignof(max_align_t));
     block_header *b = (block_header*)(a->base + off);
     size_t usable = size - off;
     b->size = usable;
-    b->next = NULL;
-    b->free = 1;
-    a->free_list = b;
+    b->prev_free = 0;
+#ifdef FREE_LIST_SEGREGATED
+    for (int i = 0; i < FL_NUM_BINS; i++) a->bins[i] = NULL;
+    a->bin_mask = 0;
+#else
+    a->free_list = NULL;
+#endif
+    mark_free(a, b);
+    list_insert(a, b);
     return a;
 }
 
@@ -20,36 +112,87 @@ void allocator_destroy(Allocator *a) {
     (void)a;
 }
 
-static void split_block(block_header *b, size_t need) {
-
+// b is already unlinked; carve `need` bytes off its front
+static void split_block(Allocator *a, block_header *b, size_t need) {
     if (b->size >= need + sizeof(block_header) + 16) {
         block_header *nb = (block_header*)((unsigned char*)b + need);
         nb->size = b->size - need;
-        nb->next = b->next;
-        nb->free = 1;
+        nb->prev_free = 0;
         b->size = need;
-        b->next = nb;
+        // successor of nb already has prev_free set: it followed free b
+        nb->free = 1;
+        *footer_of(nb) = nb->size;
+        list_insert(a, nb);
+    } else {
+        block_header *nb = next_block(b);
+        if (in_arena(a, nb)) nb->prev_free = 0;
     }
 }
 
+#ifdef FREE_LIST_SEGREGATED
+static block_header* find_fit(Allocator *a, size_t need) {
+    int i = bin_index(need);
+    // First-fit inside the smallest bin that may hold a fitting block
+    block_header *p = a->bins[i];
+    size_t depth = 0;
+    while (p && p->size < need) { p = p->next; depth++; }
+    TRACE_VALUE("fl_walk_depth", depth);
+    if (p) return p;
+    // Any block of a larger bin fits, take the head of the first non-empty one
+    uint64_t mask = (i + 1 < FL_NUM_BINS) ? a->bin_mask & ~((2ull << i) - 1) : 0;
+    if (!mask) return NULL;
+    return a->bins[__builtin_ctzll(mask)];
+}
+#else
+static block_header* find_fit(Allocator *a, size_t need) {
+    block_header *p = a->free_list;
+    size_t depth = 0;
+    while (p && p->size < need) { p = p->next; depth++; }
+    TRACE_VALUE("fl_walk_depth", depth);
+    return p;
+}
+#endif
+
 void* allocator_alloc(Allocator *a, size_t size) {
     if (size == 0) return NULL;
     size_t need = align_up(size, alignof(max_align_t)) + sizeof(block_header);
-    block_header **pp = &a->free_list;
-    block_header *p = a->free_list;
-    while (p) {
-        if (p->free && p->size >= need) {
-            split_block(p, need);
+    block_header *p = find_fit(a, need);
+    if (!p) return NULL;
+    list_remove(a, p);
+    split_block(a, p, need);
+    p->free = 0;
+    return (unsigned char*)p + sizeof(block_header);
+}
+
+// Carves up to n blocks of one size out of as few free blocks as possible:
+// the first fit for the whole rest of the batch is tried before any fit
+size_t allocator_alloc_batch(Allocator *a, size_t size, size_t n, void **out) {
+    if (size == 0) return 0;
+    size_t need = align_up(size, alignof(max_align_t)) + sizeof(block_header);
+    size_t got = 0;
+    while (got < n) {
+        block_header *p = (n - got > 1) ? find_fit(a, need * (n - got)) : NULL;
+        if (!p) p = find_fit(a, need);
+        if (!p) break;
+        list_remove(a, p);
+        size_t k = p->size / need;
+        if (k > n - got) k = n - got;
+        size_t total = p->size;
+        for (size_t i = 1; i < k; i++) {
+            p->size = need;
             p->free = 0;
-            // Remove from free list
-            *pp = p->next;
-            p->next = NULL;
-            return (unsigned char*)p + sizeof(block_header);
+            out[got++] = (unsigned char*)p + sizeof(block_header);
+            p = next_block(p);
+            p->prev_free = 0;
+            total -= need;
         }
-        pp = &p->next;
-        p = p->next;
+        // the last one takes the rest and splits it off as usual
+        p->size = total;
+        split_block(a, p, need);
+        p->free = 0;
+        out[got++] = (unsigned char*)p + sizeof(block_header);
     }
-    return NULL;
+    return got;
 }
 
 static block_header* ptr_to_block(void *ptr) {
@@ -59,40 +202,87 @@ static block_header* ptr_to_block(void *ptr) {
 void allocator_free(Allocator *a, void *ptr) {
     if (!ptr) return;
     block_header *b = ptr_to_block(ptr);
-    b->free = 1;
-    
-    // Insert in sorted order by address for better coalescing
-    block_header **pp = &a->free_list;
-    block_header *p = a->free_list;
-    while (p && p < b) {
-        pp = &p->next;
-        p = p->next;
+
+    // Coalesce with the physical successor
+    block_header *nb = next_block(b);
+    if (in_arena(a, nb) && nb->free) {
+        list_remove(a, nb);
+        b->size += nb->size;
     }
-    b->next = p;
-    *pp = b;
-    
-    // Try to coalesce with next block
-    if (b->next && b->next->free) {
-        unsigned char *end = (unsigned char*)b + b->size;
-        if (end == (unsigned char*)b->next) {
-            b->size += b->next->size;
-            b->next = b->next->next;
-        }
+
+    // Coalesce with the physical predecessor
+    if (b->prev_free) {
+        block_header *pb = prev_block(b);
+        list_remove(a, pb);
+        pb->size += b->size;
+        b = pb;
     }
-    
-    // Try to coalesce with previous block
-    pp = &a->free_list;
-    p = a->free_list;
-    while (p && p != b) {
-        if (p->next == b) {
-            unsigned char *end = (unsigned char*)p + p->size;
-            if (end == (unsigned char*)b) {
-                p->size += b->size;
-                p->next = b->next;
-                break;
-            }
-        }
-        pp = &p->next;
-        p = p->next;
+
+    mark_free(a, b);
+    list_insert(a, b);
+}
+
+void allocator_free_batch(Allocator *a, void **ptrs, size_t n) {
+    for (size_t i = 0; i < n; i++) allocator_free(a, ptrs[i]);
+}
+
+size_t allocator_usable_size(Allocator *a, void *ptr) {
+    (void)a;
+    if (!ptr) return 0;
+    return ptr_to_block(ptr)->size - sizeof(block_header);
+}
+
+// Give the tail of an allocated block beyond `need` back to the free lists,
+// merged with the successor if that one is free
+static void shrink_block(Allocator *a, block_header *b, size_t need) {
+    if (b->size < need + sizeof(block_header) + 16) return;
+    block_header *nb = (block_header*)((unsigned char*)b + need);
+    nb->size = b->size - need;
+    nb->prev_free = 0;
+    b->size = need;
+    block_header *nn = next_block(nb);
+    if (in_arena(a, nn) && nn->free) {
+        list_remove(a, nn);
+        nb->size += nn->size;
+    }
+    mark_free(a, nb);
+    list_insert(a, nb);
+}
+
+void* allocator_realloc(Allocator *a, void *ptr, size_t size) {
+    if (!ptr) return allocator_alloc(a, size);
+    if (size == 0) { allocator_free(a, ptr); return NULL; }
+    block_header *b = ptr_to_block(ptr);
+    size_t need = align_up(size, alignof(max_align_t)) + sizeof(block_header);
+    if (need <= b->size) {
+        shrink_block(a, b, need);
+        return ptr;
+    }
+    // Grow in place by absorbing the free successor
+    block_header *nb = next_block(b);
+    if (in_arena(a, nb) && nb->free && b->size + nb->size >= need) {
+        list_remove(a, nb);
+        b->size += nb->size;
+        block_header *nn = next_block(b);
+        if (in_arena(a, nn)) nn->prev_free = 0;
+        shrink_block(a, b, need);
+        return ptr;
+    }
+    void *q = allocator_alloc(a, size);
+    if (!q) return NULL;
+    memcpy(q, ptr, b->size - sizeof(block_header));
+    allocator_free(a, ptr);
+    return q;
+}
+
+void allocator_stats(Allocator *a, allocator_stats_t *st) {
+    size_t off = align_up(sizeof(Allocator), alignof(max_align_t));
+    st->arena_bytes = a->size - off;
+    st->free_bytes = st->largest_free = 0;
+    // walk the blocks in address order
+    for (block_header *b = (block_header*)(a->base + off); in_arena(a, b); b = next_block(b)) {
+        if (!b->free) continue;
+        st->free_bytes += b->size;
+        if (b->size > st->largest_free) st->largest_free = b->size;
     }
 }
@@ -3,17 +3,38 @@
 #include <stdint.h>
 #include <stdalign.h>
 
+#include "../include/allocator_api.h"
+
+// Build with -DFREE_LIST_SEGREGATED for the segregated-fit mode: free blocks
+// are bucketed by size class, first-fit order is kept inside each bucket and
+// the search starts at the smallest bucket that can fit the request.
+// Each power of two [2^k, 2^(k+1)) is split into FL_BIN_SPLIT equal classes.
+#define FL_MIN_BIN_SHIFT 5   // bins of the first range hold [32, 64) bytes
+#define FL_BIN_SPLIT_SHIFT 2
+#define FL_BIN_SPLIT (1 << FL_BIN_SPLIT_SHIFT)
+#define FL_NUM_BINS 64       // last bin takes everything above
+
+// Free blocks are inserted at the head of their list (LIFO). Build with
+// -DFREE_LIST_ADDRESS_ORDERED to keep each list sorted by address instead;
+// that costs a list walk per free but gives first-fit its low fragmentation.
 
 typedef struct Allocator {
     unsigned char *base;
     size_t size;
+#ifdef FREE_LIST_SEGREGATED
+    struct block_header *bins[FL_NUM_BINS];
+    uint64_t bin_mask;       // bit i set <=> bins[i] is not empty
+#else
     struct block_header * free_list;
+#endif
 } Allocator;
 
 typedef struct block_header {
-    size_t size;
-    struct block_header *next;
+    size_t size;                 // whole block, header included
+    struct block_header *next;   // free list links, valid while free
+    struct block_header *prev;
     int free;
+    int prev_free;               // physical predecessor is free, footer valid
 } block_header;
 
 static inline size_t align_up(size_t x, size_t a) {
@@ -24,3 +45,8 @@ void* allocator_alloc(Allocator *a, size_t size);
 void allocator_free(Allocator *a, void *ptr);
 Allocator* allocator_create(void *memory, size_t size);
 void allocator_destroy(Allocator *a);
+size_t allocator_usable_size(Allocator *a, void *ptr);
+void* allocator_realloc(Allocator *a, void *ptr, size_t size);
+void allocator_stats(Allocator *a, allocator_stats_t *st);
+size_t allocator_alloc_batch(Allocator *a, size_t size, size_t n, void **out);
+void allocator_free_batch(Allocator *a, void **ptrs, size_t n);
@@ -5,58 +5,118 @@
 
 // Simple buddy allocator with power-of-two size classes (McKusick–Karels style)
 // We store a small header (uint16_t order) at the beginning of each allocated block.
+// With -DMC_KUSICK_PAGES the buddy system only hands out whole pages and the
+// real McKusick–Karels scheme sits on top of it (see below), no header is used.
+// Free blocks of each order form a doubly linked list, and a per-order bitmap
+// in the arena header marks which blocks are free, so the buddy test on free
+// is a single bit test and unlinking the buddy is O(1).
 
-typedef struct FreeNode { struct FreeNode *next; } FreeNode;
+typedef struct FreeNode { struct FreeNode *next, *prev; } FreeNode;
 
 typedef struct Allocator Allocator; // forward (from header)
 
 static inline size_t align_up(size_t x, size_t a){ return (x + (a-1)) & ~(a-1); }
 static inline size_t pow2(int k){ return (size_t)1 << k; }
 
-static int ilog2_ceil(size_t x){
+static inline int ilog2_ceil(size_t x){
     int k = 0; size_t v = 1;
     while (v < x) { v <<= 1; k++; }
     return k;
 }
 
+// -------- per-order free bitmaps --------
+static inline size_t block_index(const Allocator *A, const void *b, int k){
+    return (size_t)((const unsigned char*)b - A->arena) >> k;
+}
+static inline int bit_test(const Allocator *A, int k, size_t i){ return (A->free_bits[k][i >> 6] >> (i & 63)) & 1; }
+static inline void bit_set(Allocator *A, int k, size_t i){ A->free_bits[k][i >> 6] |= 1ull << (i & 63); }
+static inline void bit_clear(Allocator *A, int k, size_t i){ A->free_bits[k][i >> 6] &= ~(1ull << (i & 63)); }
+
+static size_t bitmap_words(size_t usable, int k){ return ((usable >> k) + 63) / 64; }
+
+static void list_push(Allocator *A, int k, FreeNode *n){
+    n->prev = NULL;
+    n->next = A->free_lists[k];
+    if (n->next) n->next->prev = n;
+    A->free_lists[k] = n;
+    A->nonempty |= 1ull << k;
+    bit_set(A, k, block_index(A, n, k));
+}
+static void list_remove(Allocator *A, int k, FreeNode *n){
+    if (n->prev) n->prev->next = n->next; else A->free_lists[k] = n->next;
+    if (n->next) n->next->prev = n->prev;
+    if (!A->free_lists[k]) A->nonempty &= ~(1ull << k);
+    bit_clear(A, k, block_index(A, n, k));
+}
+static FreeNode* list_pop(Allocator *A, int k){ FreeNode *n = A->free_lists[k]; if(n) list_remove(A, k, n); return n; }
+
+static int floor_log2(size_t x){ return (int)(sizeof(size_t) * 8 - 1) - __builtin_clzl(x); }
+
+// Bytes needed for the header, bitmaps and page descriptors of a region of
+// at most `avail` bytes.
+static size_t header_bytes(size_t avail, int min_order){
+    size_t bytes = align_up(sizeof(Allocator), 16);
+    for (int k = min_order; k <= floor_log2(avail); k++) bytes += bitmap_words(avail, k) * sizeof(uint64_t);
+#ifdef MC_KUSICK_PAGES
+    size_t npages = avail >> MK_PAGE_SHIFT;
+    bytes = align_up(bytes, 16) + npages * sizeof(uint32_t);
+    bytes += npages;
+#endif
+    return align_up(bytes, 16) + 16;
+}
+
 Allocator* allocator_create(void *memory, size_t size){
-    Allocator *A = (Allocator*)memory;
+    // The buddy region starts at `memory` and is only aligned to its smallest
+    // block: buddies are found by offset from the region start, not by
+    // absolute address. The header goes to the tail of the memory, so no
+    // padding is spent on aligning the region to its largest block.
+#ifdef MC_KUSICK_PAGES
+    int min_order = MK_PAGE_SHIFT; // buddy system works on whole pages
+#else
+    int min_order = 4; // 16 bytes minimal block
+
+    if (pow2(min_order) < sizeof(FreeNode)) min_order = ilog2_ceil(sizeof(FreeNode));
+    if (pow2(min_order) < sizeof(uint16_t) + 8) min_order = ilog2_ceil(sizeof(uint16_t)+8);
+#endif
+    unsigned char *end = (unsigned char*)memory + size;
+    unsigned char *arena = (unsigned char*)align_up((uintptr_t)memory, pow2(min_order));
+    if (arena >= end) return NULL;
+    size_t avail = (size_t)(end - arena);
+    if (avail < pow2(min_order)) return NULL;
+    size_t hdr = header_bytes(avail, min_order);
+    if (hdr + pow2(min_order) > avail) return NULL;
+    size_t usable = (avail - hdr) & ~(pow2(min_order) - 1);
+
+    Allocator *A = (Allocator*)align_up((uintptr_t)(arena + usable), 16);
     A->base = (unsigned char*)memory;
     A->size = size;
+    A->arena = arena;
+    A->arena_size = usable;
+    A->min_order = min_order;
+    // Max order such that a single block fits in usable
+    A->max_order = floor_log2(usable);
 
-    size_t off = align_up(sizeof(Allocator), 16);
-    size_t usable = size - off;
-    if (usable < 64) return NULL;
-
-    A->min_order = 4; // 16 bytes minimal block
+    for (int i=0;i<64;i++) { A->free_lists[i] = NULL; A->free_bits[i] = NULL; }
+    A->nonempty = 0;
 
-    if (pow2(A->min_order) < sizeof(uint16_t) + 8) A->min_order = ilog2_ceil(sizeof(uint16_t)+8);
+    // Bitmaps follow the header
+    uint64_t *bits = (uint64_t*)((unsigned char*)A + align_up(sizeof(Allocator), 16));
+    size_t words = 0;
+    for (int k = A->min_order; k <= A->max_order; k++) { A->free_bits[k] = bits + words; words += bitmap_words(usable, k); }
+    memset(bits, 0, words * sizeof(uint64_t));
+#ifdef MC_KUSICK_PAGES
+    // run lengths and kmemsizes (one byte per page) after the bitmaps
+    size_t npages = usable >> MK_PAGE_SHIFT;
+    A->kmempages = (uint32_t*)align_up((uintptr_t)(bits + words), 16);
+    A->kmemsizes = (uint8_t*)(A->kmempages + npages);
+    for (int i = 0; i < MK_PAGE_SHIFT; i++) A->small_lists[i] = NULL;
+#endif
 
-    // Max order such that a single block fits in usable
-    // Limit max_order to 20 (1MB blocks) to avoid excessive alignment padding
-    A->max_order = 0;
-    while (A->max_order < 20 && pow2(A->max_order+1) <= usable) A->max_order++;
-    if (A->max_order < A->min_order) return NULL;
-
-    for (int i=0;i<64;i++) A->free_lists[i] = NULL;
-
-    // Align starting region to largest block size boundary
-    unsigned char *arena = A->base + off;
-    size_t mask = pow2(A->max_order) - 1;
-    uintptr_t aligned = ((uintptr_t)arena + mask) & ~((uintptr_t)mask);
-    size_t align_pad = (size_t)(aligned - (uintptr_t)arena);
-    if (align_pad >= usable) return NULL;
-    arena = (unsigned char*)aligned;
-    usable -= align_pad;
-    usable &= ~mask; // round down to multiple of largest block size
-
-    // Insert all memory into free lists splitting into max_order blocks
-    size_t blocks = usable >> A->max_order;
-    for (size_t i=0;i<blocks;i++){
-        unsigned char *b = arena + (i << A->max_order);
-        FreeNode *node = (FreeNode*)b;
-        node->next = (FreeNode*)A->free_lists[A->max_order];
-        A->free_lists[A->max_order] = node;
+    // Cover the region with blocks of decreasing order; each one starts at
+    // an offset that is a multiple of its size
+    size_t off = 0;
+    for (int k = A->max_order; k >= A->min_order; k--){
+        if (usable & pow2(k)) { list_push(A, k, (FreeNode*)(arena + off)); off += pow2(k); }
     }
     return A;
 }
@@ -64,68 +124,359 @@ Allocator* allocator_create(void *memory, size_t size){
 void allocator_destroy(Allocator *a){ (void)a; }
 
 static int order_for(size_t size, int min_order){
+#ifndef MC_KUSICK_PAGES
     // include header in returned block
-    size_t need = size + sizeof(uint16_t);
+    size += sizeof(uint16_t);
+#endif
     int k = min_order;
-    while (pow2(k) < need) k++;
+    while (pow2(k) < size) k++;
     return k;
 }
 
-static void list_push(FreeNode **head, FreeNode *n){ n->next = *head; *head = n; }
-static FreeNode* list_pop(FreeNode **head){ FreeNode *n = *head; if(n) *head = n->next; return n; }
-static int list_remove(FreeNode **head, FreeNode *n){
-    FreeNode **pp = head; FreeNode *p = *head;
-    while (p){ if (p==n){ *pp = p->next; return 1; } pp = &p->next; p = p->next; }
-    return 0;
-}
-
-void* allocator_alloc(Allocator *A, size_t size){
-    if (size==0) return NULL;
-    int k = order_for(size, A->min_order);
-    if (k > A->max_order) return NULL;
-    int cur = k;
-    while (cur <= A->max_order && A->free_lists[cur] == NULL) cur++;
-    if (cur > A->max_order) return NULL; // out of memory
+// -------- buddy core --------
+static unsigned char* buddy_take(Allocator *A, int k){
+    // first non-empty order >= k
+    uint64_t avail = A->nonempty & ~(pow2(k) - 1);
+    if (!avail) return NULL; // out of memory
+    int cur = __builtin_ctzll(avail);
     // split down from cur to k
-    FreeNode *node = list_pop((FreeNode**)&A->free_lists[cur]);
+    FreeNode *node = list_pop(A, cur);
     unsigned char *block = (unsigned char*)node;
     while (cur > k){
         cur--;
         // split block into two buddies of order cur
         unsigned char *buddy = block + pow2(cur);
-        list_push((FreeNode**)&A->free_lists[cur], (FreeNode*)buddy);
+        list_push(A, cur, (FreeNode*)buddy);
         // keep block as first half
     }
+    return block;
+}
+
+static void buddy_release(Allocator *A, unsigned char *block, int k){
+    // Try to coalesce up: one bit test per order
+    while (k < A->max_order){
+        size_t rel = (size_t)(block - A->arena);
+        size_t buddy_rel = rel ^ pow2(k);
+        if (buddy_rel >= A->arena_size) break;
+        if (!bit_test(A, k, buddy_rel >> k)) break;
+        // remove buddy and merge
+        list_remove(A, k, (FreeNode*)(A->arena + buddy_rel));
+        // new block is min(block, buddy)
+        block = A->arena + (rel & ~pow2(k));
+        k++;
+    }
+    list_push(A, k, (FreeNode*)block);
+}
+
+// Takes up to n blocks of order k: free blocks of order k first, then one
+// larger block at a time (the smallest one that covers the rest of the batch,
+// or the largest there is) is cut into pieces of order k in one go, without
+// pushing the intermediate halves. The untaken tail goes back as aligned blocks.
+static size_t buddy_take_batch(Allocator *A, int k, size_t n, void **out){
+    size_t got = 0;
+    while (got < n){
+        if (A->free_lists[k]) { out[got++] = list_pop(A, k); continue; }
+        uint64_t avail = A->nonempty & ~(pow2(k + 1) - 1);
+        if (!avail) break;
+        int want = k + ilog2_ceil(n - got);
+        uint64_t cover = want <= A->max_order ? avail & ~(pow2(want) - 1) : 0;
+        int j = cover ? __builtin_ctzll(cover) : floor_log2(avail);
+        unsigned char *block = (unsigned char*)list_pop(A, j);
+        size_t take = pow2(j - k);
+        if (take > n - got) take = n - got;
+        for (size_t i = 0; i < take; i++) out[got++] = block + (i << k);
+        for (size_t cur = take << k; cur < pow2(j); ){
+            int m = __builtin_ctzl(cur);
+            list_push(A, m, (FreeNode*)(block + cur));
+            cur += pow2(m);
+        }
+    }
+    return got;
+}
+
+// -------- large requests: runs --------
+// Rounding a large request up to a power of two can waste almost half of it
+// and fails as soon as no block of that order is left. A request of order
+// BUDDY_RUN_ORDER or more takes one buddy block and hands the unused tail back
+// right away, so it only occupies `len` bytes (a multiple of the smallest
+// block). The tail is given back as aligned blocks of increasing order.
+static unsigned char* run_take(Allocator *A, size_t len, int k){
+    unsigned char *block = buddy_take(A, k);
+    if (!block) return NULL;
+    size_t cur = (size_t)(block - A->arena) + len;
+    size_t end = (size_t)(block - A->arena) + pow2(k);
+    while (cur < end){
+        int j = __builtin_ctzl(cur);
+        list_push(A, j, (FreeNode*)(A->arena + cur));
+        cur += pow2(j);
+    }
+    return block;
+}
+
+static void run_release(Allocator *A, unsigned char *run, size_t len){
+    size_t cur = (size_t)(run - A->arena);
+    size_t end = cur + len;
+    while (cur < end){
+        // largest aligned block that starts at cur and fits the run
+        int j = cur ? __builtin_ctzl(cur) : A->max_order;
+        while (pow2(j) > end - cur) j--;
+        buddy_release(A, A->arena + cur, j);
+        cur += pow2(j);
+    }
+}
+
+// -------- in-place resize --------
+// Shrinking a block of order k to order newk hands its upper halves back.
+static void buddy_shrink(Allocator *A, unsigned char *block, int k, int newk){
+    while (k > newk){
+        k--;
+        buddy_release(A, block + pow2(k), k);
+    }
+}
+
+// Growing works while the block is the lower half of its pair and the upper
+// half is free at every order on the way up; nothing is touched otherwise.
+static int buddy_grow(Allocator *A, unsigned char *block, int k, int newk){
+    size_t rel = (size_t)(block - A->arena);
+    if (newk > A->max_order || rel + pow2(newk) > A->arena_size) return 0;
+    for (int j = k; j < newk; j++){
+        if (rel & pow2(j)) return 0;
+        if (!bit_test(A, j, (rel + pow2(j)) >> j)) return 0;
+    }
+    for (int j = k; j < newk; j++) list_remove(A, j, (FreeNode*)(block + pow2(j)));
+    return 1;
+}
+
+// Fallback for realloc: move the data to a new block
+static void* realloc_move(Allocator *A, void *ptr, size_t old_size, size_t size){
+    void *q = allocator_alloc(A, size);
+    if (!q) return NULL;
+    memcpy(q, ptr, old_size < size ? old_size : size);
+    allocator_free(A, ptr);
+    return q;
+}
+
+#ifdef MC_KUSICK_PAGES
+// McKusick–Karels: requests up to half a page are rounded to a power of two
+// and carved from pages dedicated to that size; kmemsizes[page] records the
+// order of everything on the page, so blocks carry no header and come back
+// aligned to their size. Larger requests get a buddy run of whole pages, its
+// order recorded in kmemsizes of the first page. As in 4.3BSD, pages given
+// to a small size class stay with it.
+
+static inline size_t page_of(const Allocator *A, const void *p){
+    return (size_t)((const unsigned char*)p - A->arena) >> MK_PAGE_SHIFT;
+}
+
+// Dedicates a fresh page to class k, its blocks chained in address order
+static FreeNode* small_refill(Allocator *A, int k){
+    unsigned char *page = buddy_take(A, MK_PAGE_SHIFT);
+    if (!page) return NULL;
+    A->kmemsizes[page_of(A, page)] = (uint8_t)k;
+    FreeNode *n = NULL;
+    size_t bs = pow2(k);
+    for (size_t off = pow2(MK_PAGE_SHIFT); off > 0; ){
+        off -= bs;
+        FreeNode *b = (FreeNode*)(page + off);
+        b->next = n;
+        n = b;
+    }
+    return n;
+}
+
+void* allocator_alloc(Allocator *A, size_t size){
+    if (size==0 || size > A->arena_size) return NULL;
+    int k = order_for(size, MK_MIN_SMALL_ORDER);
+    if (k > A->max_order) return NULL;
+    if (k >= BUDDY_RUN_ORDER) {
+        size_t len = align_up(size, pow2(MK_PAGE_SHIFT));
+        unsigned char *run = run_take(A, len, k);
+        if (!run) return NULL;
+        A->kmemsizes[page_of(A, run)] = MK_RUN;
+        A->kmempages[page_of(A, run)] = (uint32_t)(len >> MK_PAGE_SHIFT);
+        return run;
+    }
+    if (k >= MK_PAGE_SHIFT) {
+        unsigned char *run = buddy_take(A, k);
+        if (!run) return NULL;
+        A->kmemsizes[page_of(A, run)] = (uint8_t)k;
+        return run;
+    }
+    FreeNode *n = A->small_lists[k];
+    if (!n && !(n = small_refill(A, k))) return NULL;
+    A->small_lists[k] = n->next;
+    return n;
+}
+
+size_t allocator_alloc_batch(Allocator *A, size_t size, size_t n, void **out){
+    if (size==0 || size > A->arena_size) return 0;
+    int k = order_for(size, MK_MIN_SMALL_ORDER);
+    size_t got = 0;
+    if (k >= BUDDY_RUN_ORDER) {
+        while (got < n && (out[got] = allocator_alloc(A, size))) got++;
+        return got;
+    }
+    if (k >= MK_PAGE_SHIFT) {
+        got = buddy_take_batch(A, k, n, out);
+        for (size_t i = 0; i < got; i++) A->kmemsizes[page_of(A, out[i])] = (uint8_t)k;
+        return got;
+    }
+    // pop the class list, a page at a time
+    FreeNode *head = A->small_lists[k];
+    while (got < n) {
+        if (!head && !(head = small_refill(A, k))) break;
+        out[got++] = head;
+        head = head->next;
+    }
+    A->small_lists[k] = head;
+    return got;
+}
+
+void allocator_free(Allocator *A, void *ptr){
+    if (!ptr) return;
+    size_t page = page_of(A, ptr);
+    int k = A->kmemsizes[page];
+    if (k == MK_RUN) { run_release(A, (unsigned char*)ptr, (size_t)A->kmempages[page] << MK_PAGE_SHIFT); return; }
+    if (k >= MK_PAGE_SHIFT) { buddy_release(A, (unsigned char*)ptr, k); return; }
+    FreeNode *n = (FreeNode*)ptr;
+    n->next = A->small_lists[k];
+    A->small_lists[k] = n;
+}
+
+size_t allocator_usable_size(Allocator *A, void *ptr){
+    if (!ptr) return 0;
+    size_t page = page_of(A, ptr);
+    int k = A->kmemsizes[page];
+    if (k == MK_RUN) return (size_t)A->kmempages[page] << MK_PAGE_SHIFT;
+    return pow2(k);
+}
+
+void* allocator_realloc(Allocator *A, void *ptr, size_t size){
+    if (!ptr) return allocator_alloc(A, size);
+    if (size == 0) { allocator_free(A, ptr); return NULL; }
+    size_t page = page_of(A, ptr);
+    int k = A->kmemsizes[page];
+    size_t old_size = allocator_usable_size(A, ptr);
+    if (size > A->arena_size) return NULL;
+    if (k == MK_RUN) {
+        // a run only shrinks in place: its tail pages go back
+        size_t len = align_up(size, pow2(MK_PAGE_SHIFT));
+        if (len > old_size) return realloc_move(A, ptr, old_size, size);
+        run_release(A, (unsigned char*)ptr + len, old_size - len);
+        A->kmempages[page] = (uint32_t)(len >> MK_PAGE_SHIFT);
+        return ptr;
+    }
+    int newk = order_for(size, MK_MIN_SMALL_ORDER);
+    if (k < MK_PAGE_SHIFT) {
+        // blocks of a size-class page cannot change their size
+        return newk <= k ? ptr : realloc_move(A, ptr, old_size, size);
+    }
+    if (newk < MK_PAGE_SHIFT) newk = MK_PAGE_SHIFT;
+    if (newk < k) buddy_shrink(A, (unsigned char*)ptr, k, newk);
+    else if (newk > k && (newk >= BUDDY_RUN_ORDER || !buddy_grow(A, (unsigned char*)ptr, k, newk)))
+        return realloc_move(A, ptr, old_size, size);
+    A->kmemsizes[page] = (uint8_t)newk;
+    return ptr;
+}
+#else
+// Runs carry a wider header: their length, then the usual order slot set to
+// BUDDY_RUN_MARK right in front of the returned pointer.
+typedef struct { size_t len; uint16_t pad[3]; uint16_t order; } RunHeader;
+
+void* allocator_alloc(Allocator *A, size_t size){
+    if (size==0 || size > A->arena_size) return NULL;
+    int k = order_for(size, A->min_order);
+    if (k > A->max_order) return NULL;
+    if (k >= BUDDY_RUN_ORDER) {
+        size_t len = align_up(size + sizeof(RunHeader), pow2(A->min_order));
+        k = ilog2_ceil(len);
+        if (k > A->max_order) return NULL;
+        RunHeader *h = (RunHeader*)run_take(A, len, k);
+        if (!h) return NULL;
+        h->len = len;
+        h->order = BUDDY_RUN_MARK;
+        return h + 1;
+    }
+    unsigned char *block = buddy_take(A, k);
+    if (!block) return NULL;
     // mark header
     uint16_t *hdr = (uint16_t*)block; *hdr = (uint16_t)k;
     return block + sizeof(uint16_t);
 }
 
+size_t allocator_alloc_batch(Allocator *A, size_t size, size_t n, void **out){
+    if (size==0 || size > A->arena_size) return 0;
+    int k = order_for(size, A->min_order);
+    size_t got = 0;
+    if (k >= BUDDY_RUN_ORDER) {
+        while (got < n && (out[got] = allocator_alloc(A, size))) got++;
+        return got;
+    }
+    got = buddy_take_batch(A, k, n, out);
+    for (size_t i = 0; i < got; i++){
+        *(uint16_t*)out[i] = (uint16_t)k;
+        out[i] = (unsigned char*)out[i] + sizeof(uint16_t);
+    }
+    return got;
+}
+
 void allocator_free(Allocator *A, void *ptr){
     if (!ptr) return;
     unsigned char *p = (unsigned char*)ptr - sizeof(uint16_t);
-    uint16_t k = *(uint16_t*)p;
-    unsigned char *block = p; // header at start of block
-    // Try to coalesce up
-    for(;;){
-        // find buddy
-        uintptr_t rel = (uintptr_t)block - (uintptr_t)A->base;
-        uintptr_t buddy_rel = rel ^ pow2(k);
-        unsigned char *buddy = A->base + buddy_rel;
-        // Is buddy within arena and free at same order?
-        int found = 0;
-        FreeNode *it = (FreeNode*)A->free_lists[k];
-        while (it){ if ((unsigned char*)it == buddy){ found = 1; break; } it = it->next; }
-        if (!found) {
-            // cannot merge; push this block into list k
-            list_push((FreeNode**)&A->free_lists[k], (FreeNode*)block);
-            break;
-        }
-        // remove buddy and merge
-        list_remove((FreeNode**)&A->free_lists[k], (FreeNode*)buddy);
-        // new block is min(block, buddy)
-        block = (buddy < block) ? buddy : block;
-        k++;
-        if (k > A->max_order) { list_push((FreeNode**)&A->free_lists[k-1], (FreeNode*)block); break; }
+    int k = *(uint16_t*)p;
+    if (k == BUDDY_RUN_MARK) { RunHeader *h = (RunHeader*)ptr - 1; run_release(A, (unsigned char*)h, h->len); return; }
+    buddy_release(A, p, k); // header at start of block
+}
+
+size_t allocator_usable_size(Allocator *A, void *ptr){
+    (void)A;
+    if (!ptr) return 0;
+    int k = *((uint16_t*)ptr - 1);
+    if (k == BUDDY_RUN_MARK) return ((RunHeader*)ptr - 1)->len - sizeof(RunHeader);
+    return pow2(k) - sizeof(uint16_t);
+}
+
+void* allocator_realloc(Allocator *A, void *ptr, size_t size){
+    if (!ptr) return allocator_alloc(A, size);
+    if (size == 0) { allocator_free(A, ptr); return NULL; }
+    size_t old_size = allocator_usable_size(A, ptr);
+    if (size > A->arena_size) return NULL;
+    uint16_t *hdr = (uint16_t*)ptr - 1;
+    if (*hdr == BUDDY_RUN_MARK) {
+        // a run only shrinks in place: its tail goes back
+        RunHeader *h = (RunHeader*)ptr - 1;
+        size_t len = align_up(size + sizeof(RunHeader), pow2(A->min_order));
+        if (len > h->len) return realloc_move(A, ptr, old_size, size);
+        run_release(A, (unsigned char*)h + len, h->len - len);
+        h->len = len;
+        return ptr;
+    }
+    int k = *hdr;
+    int newk = order_for(size, A->min_order);
+    unsigned char *block = (unsigned char*)hdr;
+    if (newk < k) buddy_shrink(A, block, k, newk);
+    else if (newk > k && (newk >= BUDDY_RUN_ORDER || !buddy_grow(A, block, k, newk)))
+        return realloc_move(A, ptr, old_size, size);
+    *hdr = (uint16_t)newk;
+    return ptr;
+}
+#endif
+
+void allocator_free_batch(Allocator *A, void **ptrs, size_t n){
+    for (size_t i = 0; i < n; i++) allocator_free(A, ptrs[i]);
+}
+
+void allocator_stats(Allocator *A, allocator_stats_t *st){
+    st->arena_bytes = A->arena_size;
+    st->free_bytes = 0;
+    st->largest_free = A->nonempty ? pow2(floor_log2(A->nonempty)) : 0;
+    for (int k = A->min_order; k <= A->max_order; k++)
+        for (FreeNode *n = A->free_lists[k]; n; n = n->next) st->free_bytes += pow2(k);
+#ifdef MC_KUSICK_PAGES
+    // free blocks of the small classes count as free, they only serve their class
+    for (int k = MK_MIN_SMALL_ORDER; k < MK_PAGE_SHIFT; k++) {
+        for (FreeNode *n = A->small_lists[k]; n; n = n->next) st->free_bytes += pow2(k);
+        if (A->small_lists[k] && pow2(k) > st->largest_free) st->largest_free = pow2(k);
     }
+#endif
 }
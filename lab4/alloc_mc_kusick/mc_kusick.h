@@ -2,17 +2,43 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "../include/allocator_api.h"
+
 // Buddy allocator (McKusick–Karels style size classes)
+// -DMC_KUSICK_PAGES: page-descriptor McKusick–Karels mode on top of the buddy pages
+
+#define MK_PAGE_SHIFT 12       // 4 KiB pages
+#define MK_MIN_SMALL_ORDER 4   // smallest size class = 16 bytes
+#define MK_RUN 0xFF            // kmemsizes value of the first page of a run
+
+// Requests of 16 KiB and more are served as runs trimmed to their length
+#define BUDDY_RUN_ORDER 14
+#define BUDDY_RUN_MARK 0xFFFF
 
 typedef struct Allocator {
     unsigned char *base;
     size_t size;
     int min_order;   // minimal block = 1<<min_order
     int max_order;   // maximal block = 1<<max_order (fits into size)
+    unsigned char *arena;   // start of the buddy region, offsets are relative to it;
+                            // this header sits right behind the region
+    size_t arena_size;
+    uint64_t nonempty;      // bit k set <=> free_lists[k] is not empty
     struct FreeNode *free_lists[64];
+    uint64_t *free_bits[64]; // per-order bitmaps: bit i <=> i-th block of order k is free
+#ifdef MC_KUSICK_PAGES
+    uint8_t *kmemsizes;      // order of the blocks on each page of the buddy region
+    uint32_t *kmempages;     // length in pages of the run starting at a page
+    struct FreeNode *small_lists[MK_PAGE_SHIFT];
+#endif
 } Allocator;
 
 void* allocator_alloc(Allocator *a, size_t size);
 void allocator_free(Allocator *a, void *ptr);
 Allocator* allocator_create(void *memory, size_t size);
 void allocator_destroy(Allocator *a);
+size_t allocator_usable_size(Allocator *a, void *ptr);
+void* allocator_realloc(Allocator *a, void *ptr, size_t size);
+void allocator_stats(Allocator *a, allocator_stats_t *st);
+size_t allocator_alloc_batch(Allocator *a, size_t size, size_t n, void **out);
+void allocator_free_batch(Allocator *a, void **ptrs, size_t n);
@@ -0,0 +1,152 @@
+#include "tcache.h"
+#include <stdatomic.h>
+#include <string.h>
+
+const int allocator_thread_safe = 1;
+
+typedef struct {
+    int count;
+    void *slots[TC_CAP];
+} tc_bin;
+
+typedef struct {
+    uint64_t owner;         // id of the allocator the cached blocks belong to
+    tc_bin bins[TC_NUM_CLASSES];
+} tcache_t;
+
+static _Thread_local tcache_t tc;
+static atomic_uint_fast64_t next_id = 1;
+
+static inline size_t align_up(size_t x, size_t a){ return (x + (a-1)) & ~(a-1); }
+
+// class c holds blocks of at least (c + 1) * 16 usable bytes
+static inline int class_of_request(size_t size){ return (int)((size - 1) >> TC_CLASS_SHIFT); }
+static inline size_t class_size(int c){ return (size_t)(c + 1) << TC_CLASS_SHIFT; }
+
+static tcache_t* cache_for(Allocator *A){
+    if (tc.owner != A->id) {
+        for (int c = 0; c < TC_NUM_CLASSES; c++) tc.bins[c].count = 0;
+        tc.owner = A->id;
+    }
+    return &tc;
+}
+
+Allocator* allocator_create(void *memory, size_t size){
+    size_t off = align_up(sizeof(Allocator), 64);
+    if (!memory || size <= off) return NULL;
+    Allocator *A = (Allocator*)memory;
+    A->backend = mt_backend_create((unsigned char*)memory + off, size - off);
+    if (!A->backend) return NULL;
+    if (pthread_mutex_init(&A->lock, NULL)) return NULL;
+    A->id = atomic_fetch_add(&next_id, 1);
+    return A;
+}
+
+void allocator_destroy(Allocator *A){
+    if (tc.owner == A->id) tc.owner = 0;
+    mt_backend_destroy(A->backend);
+    pthread_mutex_destroy(&A->lock);
+}
+
+static int refill(Allocator *A, tc_bin *bin, int c){
+    pthread_mutex_lock(&A->lock);
+    bin->count += (int)mt_backend_alloc_batch(A->backend, class_size(c), (size_t)(TC_BATCH - bin->count), bin->slots + bin->count);
+    pthread_mutex_unlock(&A->lock);
+    return bin->count;
+}
+
+// Hand the oldest TC_BATCH blocks of a full class back to the backend
+static void drain(Allocator *A, tc_bin *bin){
+    pthread_mutex_lock(&A->lock);
+    mt_backend_free_batch(A->backend, bin->slots, TC_BATCH);
+    pthread_mutex_unlock(&A->lock);
+    bin->count -= TC_BATCH;
+    memmove(bin->slots, bin->slots + TC_BATCH, (size_t)bin->count * sizeof(void*));
+}
+
+void* allocator_alloc(Allocator *A, size_t size){
+    if (size == 0) return NULL;
+    if (size > TC_MAX_SIZE) {
+        pthread_mutex_lock(&A->lock);
+        void *p = mt_backend_alloc(A->backend, size);
+        pthread_mutex_unlock(&A->lock);
+        return p;
+    }
+    int c = class_of_request(size);
+    tc_bin *bin = &cache_for(A)->bins[c];
+    if (bin->count == 0 && !refill(A, bin, c)) return NULL;
+    return bin->slots[--bin->count];
+}
+
+void allocator_free(Allocator *A, void *ptr){
+    if (!ptr) return;
+    // The header of a live block is only touched by its owner, no lock needed
+    size_t usable = mt_backend_usable_size(A->backend, ptr);
+    if (usable < class_size(0) || usable >= class_size(TC_NUM_CLASSES)) {
+        pthread_mutex_lock(&A->lock);
+        mt_backend_free(A->backend, ptr);
+        pthread_mutex_unlock(&A->lock);
+        return;
+    }
+    // largest class the block can serve
+    int c = (int)(usable >> TC_CLASS_SHIFT) - 1;
+    tc_bin *bin = &cache_for(A)->bins[c];
+    if (bin->count == TC_CAP) drain(A, bin);
+    bin->slots[bin->count++] = ptr;
+}
+
+// Small requests are served from the cache first, the rest of the batch
+// comes from the backend under one lock
+size_t allocator_alloc_batch(Allocator *A, size_t size, size_t n, void **out){
+    if (size == 0) return 0;
+    size_t got = 0;
+    if (size <= TC_MAX_SIZE) {
+        int c = class_of_request(size);
+        tc_bin *bin = &cache_for(A)->bins[c];
+        while (got < n && bin->count) out[got++] = bin->slots[--bin->count];
+        if (got == n) return got;
+        size = class_size(c);
+    }
+    pthread_mutex_lock(&A->lock);
+    got += mt_backend_alloc_batch(A->backend, size, n - got, out + got);
+    pthread_mutex_unlock(&A->lock);
+    return got;
+}
+
+void allocator_free_batch(Allocator *A, void **ptrs, size_t n){
+    for (size_t i = 0; i < n; i++) allocator_free(A, ptrs[i]);
+}
+
+size_t allocator_usable_size(Allocator *A, void *ptr){
+    return mt_backend_usable_size(A->backend, ptr);
+}
+
+void* allocator_realloc(Allocator *A, void *ptr, size_t size){
+    if (!ptr) return allocator_alloc(A, size);
+    if (size == 0) { allocator_free(A, ptr); return NULL; }
+    // small blocks that still fit stay as they are, the rest is up to the backend
+    size_t usable = mt_backend_usable_size(A->backend, ptr);
+    if (size <= usable && usable < class_size(TC_NUM_CLASSES)) return ptr;
+    pthread_mutex_lock(&A->lock);
+    void *q = mt_backend_realloc(A->backend, ptr, size);
+    pthread_mutex_unlock(&A->lock);
+    return q;
+}
+
+// Blocks sitting in thread caches are reported as used
+void allocator_stats(Allocator *A, allocator_stats_t *st){
+    pthread_mutex_lock(&A->lock);
+    mt_backend_stats(A->backend, st);
+    pthread_mutex_unlock(&A->lock);
+}
+
+void allocator_thread_flush(Allocator *A){
+    if (tc.owner != A->id) return;
+    pthread_mutex_lock(&A->lock);
+    for (int c = 0; c < TC_NUM_CLASSES; c++) {
+        tc_bin *bin = &tc.bins[c];
+        for (int i = 0; i < bin->count; i++) mt_backend_free(A->backend, bin->slots[i]);
+        bin->count = 0;
+    }
+    pthread_mutex_unlock(&A->lock);
+}
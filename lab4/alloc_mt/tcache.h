@@ -0,0 +1,54 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "../include/allocator_api.h"
+
+// Thread-safe front end for any allocator of this lab (tcache style).
+// The backend is compiled with its allocator_* functions renamed to
+// mt_backend_* (see Makefile) and linked into the same library.
+//
+// Every thread keeps a small cache of free blocks per size class. Requests
+// up to TC_MAX_SIZE are served from it without locking; an empty class is
+// refilled and a full one drained TC_BATCH blocks at a time under the single
+// backend lock. Larger requests go straight to the backend under the lock.
+//
+// A thread's cache belongs to one allocator: when the thread switches to
+// another one, its cached blocks are dropped (they stay allocated in the old
+// arena). Call allocator_thread_flush before a thread exits to hand them back.
+
+#define TC_CLASS_SHIFT 4                          // classes in 16-byte steps
+#define TC_NUM_CLASSES 64
+#define TC_MAX_SIZE (TC_NUM_CLASSES << TC_CLASS_SHIFT) // 1024 bytes
+#define TC_CAP 32      // blocks cached per class and thread
+#define TC_BATCH 16    // blocks moved to or from the backend at once
+
+typedef struct Backend Backend;
+
+typedef struct Allocator {
+    pthread_mutex_t lock;   // guards the backend
+    Backend *backend;
+    uint64_t id;            // tells caches of reused arenas apart
+} Allocator;
+
+Backend* mt_backend_create(void *memory, size_t size);
+void mt_backend_destroy(Backend *b);
+void* mt_backend_alloc(Backend *b, size_t size);
+void mt_backend_free(Backend *b, void *ptr);
+size_t mt_backend_usable_size(Backend *b, void *ptr);
+void* mt_backend_realloc(Backend *b, void *ptr, size_t size);
+void mt_backend_stats(Backend *b, allocator_stats_t *st);
+size_t mt_backend_alloc_batch(Backend *b, size_t size, size_t n, void **out);
+void mt_backend_free_batch(Backend *b, void **ptrs, size_t n);
+
+Allocator* allocator_create(void *memory, size_t size);
+void allocator_destroy(Allocator *a);
+void* allocator_alloc(Allocator *a, size_t size);
+void allocator_free(Allocator *a, void *ptr);
+size_t allocator_usable_size(Allocator *a, void *ptr);
+void* allocator_realloc(Allocator *a, void *ptr, size_t size);
+void allocator_stats(Allocator *a, allocator_stats_t *st);
+size_t allocator_alloc_batch(Allocator *a, size_t size, size_t n, void **out);
+void allocator_free_batch(Allocator *a, void **ptrs, size_t n);
+void allocator_thread_flush(Allocator *a);
@@ -8,10 +8,37 @@ typedef Allocator* (*allocator_create_fn)(void *memory, size_t size);
 typedef void (*allocator_destroy_fn)(Allocator *a);
 typedef void* (*allocator_alloc_fn)(Allocator *a, size_t size);
 typedef void (*allocator_free_fn)(Allocator *a, void *ptr);
+// Optional entry points, resolved with dlsym when present
+typedef size_t (*allocator_usable_size_fn)(Allocator *a, void *ptr);
+// realloc semantics: NULL ptr allocates, size 0 frees, contents are kept
+typedef void* (*allocator_realloc_fn)(Allocator *a, void *ptr, size_t size);
+
+// Batch entry points: alloc_batch stores up to n blocks of `size` bytes in
+// out[] and returns how many it got; free_batch frees n blocks at once.
+typedef size_t (*allocator_alloc_batch_fn)(Allocator *a, size_t size, size_t n, void **out);
+typedef void (*allocator_free_batch_fn)(Allocator *a, void **ptrs, size_t n);
+
+// Heap state for the workload benchmark: bytes the allocator hands out
+// blocks from (its own metadata excluded), bytes of it in free blocks and
+// the largest single free block.
+typedef struct {
+    size_t arena_bytes;
+    size_t free_bytes;
+    size_t largest_free;
+} allocator_stats_t;
+typedef void (*allocator_stats_fn)(Allocator *a, allocator_stats_t *st);
+
+// A library that exports `const int allocator_thread_safe = 1;` may be called
+// from several threads at once; others are serialized by the caller.
 
 typedef struct {
     allocator_create_fn create;
     allocator_destroy_fn destroy;
     allocator_alloc_fn alloc;
     allocator_free_fn free;
+    allocator_usable_size_fn usable_size; // may be NULL
+    allocator_realloc_fn realloc;         // the driver falls back to alloc+memcpy+free
+    allocator_stats_fn stats;             // may be NULL
+    allocator_alloc_batch_fn alloc_batch; // the driver falls back to a loop
+    allocator_free_batch_fn free_batch;
 } allocator_api_t;
@@ -2,11 +2,15 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -17,25 +21,573 @@ static size_t page_size(void){ static size_t p=0; if(!p) p=(size_t)sysconf(_SC_P
 static size_t align_up_size(size_t x, size_t a){ return (x + (a-1)) & ~(a-1); }
 
 // -------- Fallback wrapper on top of mmap() --------
-typedef struct { int dummy; } Fallback;
+// Freed mappings of up to FB_CACHE_PAGES pages are kept, FB_CACHE_DEPTH per
+// page count, and handed out again instead of a fresh mmap: those pages are
+// already faulted in. --no-map-cache restores one mmap/munmap per block.
+#define FB_CACHE_PAGES 64
+#define FB_CACHE_DEPTH 32
 
-static Allocator* fb_create(void *mem, size_t sz){ (void)mem; (void)sz; return (Allocator*)calloc(1, sizeof(Fallback)); }
-static void fb_destroy(Allocator *a){ free(a); }
-static void* fb_alloc(Allocator *a, size_t size){ (void)a; if(size==0) return NULL; size_t hdr = sizeof(size_t);
+typedef struct {
+    pthread_mutex_t lock;
+    int enabled;
+    int count[FB_CACHE_PAGES + 1];
+    void *maps[FB_CACHE_PAGES + 1][FB_CACHE_DEPTH];
+} Fallback;
+
+static int fb_cache_enabled = 1;
+
+static Allocator* fb_create(void *mem, size_t sz){ (void)mem; (void)sz;
+    Fallback *f = (Fallback*)calloc(1, sizeof(Fallback));
+    if (!f) return NULL;
+    pthread_mutex_init(&f->lock, NULL);
+    f->enabled = fb_cache_enabled;
+    return (Allocator*)f;
+}
+static void fb_destroy(Allocator *a){ Fallback *f = (Fallback*)a;
+    for (size_t np=1; np<=FB_CACHE_PAGES; np++)
+        for (int i=0;i<f->count[np];i++) munmap(f->maps[np][i], np * page_size());
+    pthread_mutex_destroy(&f->lock);
+    free(f);
+}
+static void* fb_alloc(Allocator *a, size_t size){ Fallback *f = (Fallback*)a; if(size==0) return NULL; size_t hdr = sizeof(size_t);
     size_t total = align_up_size(size + hdr, page_size());
-    void *p = mmap(NULL, total, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-    if(p==MAP_FAILED) return NULL;
+    size_t np = total / page_size();
+    void *p = NULL;
+    if (f->enabled && np <= FB_CACHE_PAGES) {
+        pthread_mutex_lock(&f->lock);
+        if (f->count[np]) p = f->maps[np][--f->count[np]];
+        pthread_mutex_unlock(&f->lock);
+    }
+    if (!p) {
+        p = mmap(NULL, total, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if(p==MAP_FAILED) return NULL;
+    }
     *(size_t*)p = total; // store mapping size at start
     return (unsigned char*)p + hdr;
 }
-static void fb_free(Allocator *a, void *ptr){ (void)a; if(!ptr) return; unsigned char *base = (unsigned char*)ptr - sizeof(size_t); size_t total = *(size_t*)base; munmap(base, total); }
+static void fb_free(Allocator *a, void *ptr){ Fallback *f = (Fallback*)a; if(!ptr) return;
+    unsigned char *base = (unsigned char*)ptr - sizeof(size_t); size_t total = *(size_t*)base;
+    size_t np = total / page_size();
+    if (f->enabled && np <= FB_CACHE_PAGES) {
+        pthread_mutex_lock(&f->lock);
+        int kept = f->count[np] < FB_CACHE_DEPTH;
+        if (kept) f->maps[np][f->count[np]++] = base;
+        pthread_mutex_unlock(&f->lock);
+        if (kept) return;
+    }
+    munmap(base, total);
+}
+static size_t fb_usable_size(Allocator *a, void *ptr){ (void)a; if(!ptr) return 0; return *((size_t*)ptr - 1) - sizeof(size_t); }
+static void* fb_realloc(Allocator *a, void *ptr, size_t size){
+    if(!ptr) return fb_alloc(a, size);
+    if(size==0){ fb_free(a, ptr); return NULL; }
+    unsigned char *base = (unsigned char*)ptr - sizeof(size_t); size_t total = *(size_t*)base;
+    size_t ntotal = align_up_size(size + sizeof(size_t), page_size());
+    void *p = mremap(base, total, ntotal, MREMAP_MAYMOVE);
+    if(p==MAP_FAILED) return NULL;
+    *(size_t*)p = ntotal;
+    return (unsigned char*)p + sizeof(size_t);
+}
+
+// -------- realloc emulation for libraries without allocator_realloc --------
+static allocator_api_t *emul_api;
+static void* emul_realloc(Allocator *a, void *ptr, size_t size){
+    if(!ptr) return emul_api->alloc(a, size);
+    if(size==0){ emul_api->free(a, ptr); return NULL; }
+    size_t old = emul_api->usable_size(a, ptr);
+    if(size <= old) return ptr;
+    void *q = emul_api->alloc(a, size);
+    if(!q) return NULL;
+    memcpy(q, ptr, old);
+    emul_api->free(a, ptr);
+    return q;
+}
+
+static Allocator* recreate(allocator_api_t *api, Allocator *A, void *memory, size_t size);
+
+// -------- batch emulation for libraries without the batch entry points --------
+static size_t emul_alloc_batch(Allocator *a, size_t size, size_t n, void **out){
+    size_t i = 0;
+    while (i < n && (out[i] = emul_api->alloc(a, size))) i++;
+    return i;
+}
+static void emul_free_batch(Allocator *a, void **ptrs, size_t n){
+    for (size_t i=0;i<n;i++) emul_api->free(a, ptrs[i]);
+}
+
+// -------- Batch benchmark --------
+// Rounds of `batch` allocations of one small size, then freeing all of them:
+// once with one alloc/free call per block, once through alloc_batch and
+// free_batch. Each mode runs on a freshly created allocator.
+static const size_t batch_sizes[] = { 16, 64, 256 };
+
+static double batch_round_ns(allocator_api_t *api, Allocator *A, size_t size, size_t total, size_t batch, int batched, size_t *failed){
+    void **ptrs = (void**)malloc(batch * sizeof(void*));
+    if (!ptrs) return 0;
+    uint64_t t0 = now_ns();
+    for (size_t done = 0; done < total; done += batch){
+        size_t got;
+        if (batched) got = api->alloc_batch(A, size, batch, ptrs);
+        else for (got = 0; got < batch && (ptrs[got] = api->alloc(A, size)); got++) {}
+        *failed += batch - got;
+        if (batched) api->free_batch(A, ptrs, got);
+        else for (size_t i=0;i<got;i++) api->free(A, ptrs[i]);
+    }
+    uint64_t t1 = now_ns();
+    free(ptrs);
+    return (double)(t1 - t0) / (double)total;
+}
+
+static void run_batch_bench(allocator_api_t *api, Allocator **A, void *memory, size_t size, size_t total, size_t batch, int native){
+    if (batch == 0) batch = 1;
+    if (total < batch) total = batch;
+    for (size_t s=0; s<sizeof batch_sizes/sizeof batch_sizes[0]; s++){
+        size_t failed = 0;
+        if (!(*A = recreate(api, *A, memory, size))) return;
+        double call_ns = batch_round_ns(api, *A, batch_sizes[s], total, batch, 0, &failed);
+        if (!(*A = recreate(api, *A, memory, size))) return;
+        double batch_ns = batch_round_ns(api, *A, batch_sizes[s], total, batch, 1, &failed);
+        printf("batch size=%zu n=%zu api=%s call_ns=%.1f batch_ns=%.1f speedup=%.2f failed=%zu\n",
+               batch_sizes[s], batch, native ? "native" : "emulated", call_ns, batch_ns, call_ns / batch_ns, failed);
+    }
+}
+
+// -------- Vector growth benchmark --------
+// VEC_COUNT buffers grow round-robin by 1.5x from 16 bytes up to VEC_MAX, then
+// start over. mode "realloc" uses api->realloc, mode "copy" does what a
+// caller without realloc has to do: alloc, memcpy, free.
+#define VEC_COUNT 4
+#define VEC_MAX (64u << 10)
+
+static void run_vector_bench(allocator_api_t *api, Allocator *A, size_t grows, int use_realloc){
+    unsigned char *buf[VEC_COUNT] = {0};
+    size_t len[VEC_COUNT] = {0};
+    size_t in_place = 0, failed = 0;
+    uint64_t t0 = now_ns();
+    for (size_t g=0; g<grows; g++){
+        int v = (int)(g % VEC_COUNT);
+        size_t nlen = len[v] ? align_up_size(len[v] + len[v]/2, 16) : 16;
+        if (nlen > VEC_MAX) { api->free(A, buf[v]); buf[v] = NULL; len[v] = 0; nlen = 16; }
+        unsigned char *q;
+        if (use_realloc) q = (unsigned char*)api->realloc(A, buf[v], nlen);
+        else {
+            q = (unsigned char*)api->alloc(A, nlen);
+            if (q && buf[v]) { memcpy(q, buf[v], len[v]); api->free(A, buf[v]); }
+        }
+        if (!q) { failed++; continue; }
+        if (q == buf[v]) in_place++;
+        memset(q + len[v], (int)g, nlen - len[v]); // the caller fills the new part
+        buf[v] = q; len[v] = nlen;
+    }
+    uint64_t t1 = now_ns();
+    for (int v=0; v<VEC_COUNT; v++) if (buf[v]) api->free(A, buf[v]);
+    printf("vector mode=%s grows=%zu ms=%.3f ns_per_grow=%.1f in_place=%.1f%% failed=%zu\n",
+           use_realloc ? "realloc" : "copy", grows, (t1-t0)/1e6, (t1-t0)/(double)grows,
+           100.0*in_place/(double)grows, failed);
+}
+
+// -------- Multithreaded benchmark --------
+// Each thread keeps a window of MT_WINDOW live blocks (16..512 bytes) and
+// replaces a random one per step: one free plus one alloc. Libraries that do
+// not export allocator_thread_safe are serialized with a global mutex here.
+#define MT_WINDOW 64
+
+typedef struct {
+    allocator_api_t *api;
+    Allocator *A;
+    pthread_mutex_t *lock;   // NULL when the library is thread-safe
+    void (*flush)(Allocator*);
+    size_t steps;
+    unsigned seed;
+    size_t failed;
+} mt_arg_t;
+
+static void* mt_alloc(mt_arg_t *w, size_t size){
+    if (!w->lock) return w->api->alloc(w->A, size);
+    pthread_mutex_lock(w->lock); void *p = w->api->alloc(w->A, size); pthread_mutex_unlock(w->lock);
+    return p;
+}
+static void mt_free(mt_arg_t *w, void *ptr){
+    if (!w->lock) { w->api->free(w->A, ptr); return; }
+    pthread_mutex_lock(w->lock); w->api->free(w->A, ptr); pthread_mutex_unlock(w->lock);
+}
+
+static void* mt_worker(void *arg){
+    mt_arg_t *w = (mt_arg_t*)arg;
+    void *live[MT_WINDOW] = {0};
+    for (size_t s=0;s<w->steps;s++){
+        unsigned r = rand_r(&w->seed);
+        int i = (int)(r % MT_WINDOW);
+        if (live[i]) mt_free(w, live[i]);
+        live[i] = mt_alloc(w, 16 + (r >> 8) % 497);
+        if (!live[i]) w->failed++;
+    }
+    for (int i=0;i<MT_WINDOW;i++) if (live[i]) mt_free(w, live[i]);
+    if (w->flush) w->flush(w->A);
+    return NULL;
+}
+
+// Runs the benchmark for 1, 2, 4, ... max_threads threads, same steps per thread
+static void run_mt_bench(allocator_api_t *api, Allocator *A, int thread_safe, void (*flush)(Allocator*), int max_threads, size_t steps){
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_t *ths = (pthread_t*)malloc((size_t)max_threads * sizeof(pthread_t));
+    mt_arg_t *args = (mt_arg_t*)calloc((size_t)max_threads, sizeof(mt_arg_t));
+    if (!ths || !args) { fprintf(stderr, "oom\n"); free(ths); free(args); return; }
+    double base_mops = 0;
+    for (int t = 1; ; t = (t*2 > max_threads && t < max_threads) ? max_threads : t*2){
+        for (int i=0;i<t;i++){
+            args[i] = (mt_arg_t){ api, A, thread_safe ? NULL : &lock, flush, steps, 12345u + (unsigned)i*7919u, 0 };
+        }
+        uint64_t t0 = now_ns();
+        for (int i=0;i<t;i++) pthread_create(&ths[i], NULL, mt_worker, &args[i]);
+        for (int i=0;i<t;i++) pthread_join(ths[i], NULL);
+        uint64_t t1 = now_ns();
+        size_t failed = 0; for (int i=0;i<t;i++) failed += args[i].failed;
+        double ops = 2.0 * (double)steps * t; // one alloc and one free per step
+        double mops = ops / ((t1-t0)/1e3);
+        if (t == 1) base_mops = mops;
+        printf("threads=%d locking=%s ops=%.0f wall_ms=%.3f mops=%.2f scaling=%.2f failed=%zu\n",
+               t, thread_safe ? "library" : "global", ops, (t1-t0)/1e6, mops, mops/base_mops, failed);
+        if (t >= max_threads) break;
+    }
+    free(ths); free(args);
+}
+
+// -------- Arena provisioning --------
+// --hugetlb maps the arena from the hugetlbfs pool (falls back to normal
+// pages when the pool is empty), --thp aligns it to 2 MiB and asks for
+// transparent huge pages, --populate faults it in up front and --numa N binds
+// it to node N. With --thp or --numa the arena is pre-faulted by touching it
+// after madvise/mbind, MAP_POPULATE would fault it in before they apply.
+#define HUGE_PAGE (2u << 20)
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+typedef struct {
+    int hugetlb, thp, populate;
+    int numa_node;   // -1: no binding
+} arena_opts;
+
+// Maps at least `size` bytes, *mapped gets the length to munmap
+static void* map_arena(size_t size, size_t *mapped, const arena_opts *o){
+    int flags = MAP_PRIVATE|MAP_ANONYMOUS;
+    int touch = o->populate && (o->thp || o->numa_node >= 0);
+    if (o->populate && !touch) flags |= MAP_POPULATE;
+    void *p = MAP_FAILED;
+    if (o->hugetlb) {
+        *mapped = align_up_size(size, HUGE_PAGE);
+        p = mmap(NULL, *mapped, PROT_READ|PROT_WRITE, flags|MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) perror("mmap MAP_HUGETLB, using normal pages");
+    }
+    if (p == MAP_FAILED && o->thp) {
+        // map a huge page more and trim both ends to a 2 MiB boundary
+        *mapped = align_up_size(size, HUGE_PAGE);
+        unsigned char *raw = (unsigned char*)mmap(NULL, *mapped + HUGE_PAGE, PROT_READ|PROT_WRITE, flags & ~MAP_POPULATE, -1, 0);
+        if (raw == MAP_FAILED) return NULL;
+        unsigned char *al = (unsigned char*)align_up_size((uintptr_t)raw, HUGE_PAGE);
+        if (al > raw) munmap(raw, (size_t)(al - raw));
+        munmap(al + *mapped, HUGE_PAGE - (size_t)(al - raw));
+        if (madvise(al, *mapped, MADV_HUGEPAGE)) perror("madvise MADV_HUGEPAGE");
+        p = al;
+    }
+    if (p == MAP_FAILED) { *mapped = size; p = mmap(NULL, size, PROT_READ|PROT_WRITE, flags, -1, 0); }
+    if (p == MAP_FAILED) return NULL;
+    if (o->numa_node >= 0) {
+        unsigned long mask = 1ul << o->numa_node;
+        if (syscall(SYS_mbind, p, *mapped, MPOL_BIND, &mask, sizeof(mask) * 8, 0)) perror("mbind");
+    }
+    if (touch) for (size_t off = 0; off < *mapped; off += page_size()) ((volatile unsigned char*)p)[off] = 0;
+    return p;
+}
+
+static long minor_faults(void){ struct rusage ru; getrusage(RUSAGE_SELF, &ru); return ru.ru_minflt; }
+
+static Allocator* recreate(allocator_api_t *api, Allocator *A, void *memory, size_t size){
+    if (A) api->destroy(A);
+    return api->create(memory, size);
+}
+
+// -------- Workload suite --------
+// A workload is a trace of operations on numbered blocks: alloc (size > 0)
+// or free (size 0). Generated workloads and trace files run the same way,
+// each on a fresh allocator. Trace files are text, one operation per line:
+// "a <id> <size>" or "f <id>"; empty lines and lines starting with '#' are
+// skipped. A free of a block whose alloc failed is skipped too.
+#define WL_LIVE_MAX 4096      // live blocks cap of the interleaved workloads
+#define WL_STATS_EVERY 256    // ops between allocator_stats samples
+#define WL_MAX_ID (1u << 24)
+
+typedef struct { uint32_t id; uint32_t size; } wl_op;
+
+typedef struct {
+    wl_op *ops;
+    size_t n, cap;
+    uint32_t nids;            // ids are below this
+} wl_trace;
+
+static int wl_push(wl_trace *t, uint32_t id, uint32_t size){
+    if (t->n == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 1024;
+        wl_op *ops = (wl_op*)realloc(t->ops, cap * sizeof(wl_op));
+        if (!ops) return -1;
+        t->ops = ops; t->cap = cap;
+    }
+    t->ops[t->n++] = (wl_op){ id, size };
+    if (id >= t->nids) t->nids = id + 1;
+    return 0;
+}
+
+static uint32_t size_uniform(unsigned *seed){ return 8 + (uint32_t)(rand_r(seed) % 4089); }
+
+// Pareto, alpha 1.2, from 16 bytes and cut at 64 KiB: mostly small blocks, heavy tail
+static uint32_t size_powerlaw(unsigned *seed){
+    double u = (rand_r(seed) + 1.0) / ((double)RAND_MAX + 2.0);
+    double s = 16.0 / pow(u, 1.0 / 1.2);
+    return s > 65536.0 ? 65536u : (uint32_t)s;
+}
+
+// n allocs, then n frees in reverse (lifo) or the same (fifo) order
+static int gen_stack(wl_trace *t, size_t n, int fifo, unsigned seed){
+    for (size_t i=0;i<n;i++) if (wl_push(t, (uint32_t)i, size_uniform(&seed))) return -1;
+    for (size_t i=0;i<n;i++) if (wl_push(t, (uint32_t)(fifo ? i : n-1-i), 0)) return -1;
+    return 0;
+}
+
+// n allocs interleaved with frees of random live blocks; allocs win 3:2 until
+// WL_LIVE_MAX blocks are live, whatever is left is freed at the end
+static int gen_random(wl_trace *t, size_t n, uint32_t (*size_fn)(unsigned*), unsigned seed){
+    uint32_t *live = (uint32_t*)malloc(WL_LIVE_MAX * sizeof(uint32_t));
+    if (!live) return -1;
+    size_t nlive = 0, next = 0;
+    int rc = 0;
+    while (!rc && (next < n || nlive)) {
+        unsigned r = rand_r(&seed);
+        if (next < n && (nlive == 0 || (nlive < WL_LIVE_MAX && r % 5 < 3))) {
+            live[nlive++] = (uint32_t)next;
+            rc = wl_push(t, (uint32_t)next++, size_fn(&seed));
+        } else {
+            size_t i = (r / 5) % nlive;
+            rc = wl_push(t, live[i], 0);
+            live[i] = live[--nlive];
+        }
+    }
+    free(live);
+    return rc;
+}
+
+// A queue: the producer allocates bursts of 1..64 blocks, the consumer frees
+// bursts of 1..48 from the other end, so blocks die in allocation order
+static int gen_prodcons(wl_trace *t, size_t n, unsigned seed){
+    uint32_t *q = (uint32_t*)malloc(WL_LIVE_MAX * sizeof(uint32_t));
+    if (!q) return -1;
+    size_t head = 0, len = 0, next = 0;
+    int rc = 0;
+    while (!rc && (next < n || len)) {
+        unsigned r = rand_r(&seed);
+        for (size_t b = 1 + r % 64; !rc && b && next < n && len < WL_LIVE_MAX; b--, len++) {
+            q[(head + len) % WL_LIVE_MAX] = (uint32_t)next;
+            rc = wl_push(t, (uint32_t)next++, size_uniform(&seed));
+        }
+        size_t b = next < n ? 1 + (r >> 8) % 48 : len;
+        for (; !rc && b && len; b--, len--) {
+            rc = wl_push(t, q[head], 0);
+            head = (head + 1) % WL_LIVE_MAX;
+        }
+    }
+    free(q);
+    return rc;
+}
+
+static int load_trace(wl_trace *t, const char *path){
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return -1; }
+    char buf[128];
+    unsigned long id, size;
+    size_t line = 0;
+    int rc = 0;
+    while (!rc && fgets(buf, sizeof buf, f)) {
+        line++;
+        if (buf[0] == '#' || buf[0] == '\n') continue;
+        if (sscanf(buf, "a %lu %lu", &id, &size) == 2 && id < WL_MAX_ID && size > 0 && size <= UINT32_MAX)
+            rc = wl_push(t, (uint32_t)id, (uint32_t)size);
+        else if (sscanf(buf, "f %lu", &id) == 1 && id < WL_MAX_ID)
+            rc = wl_push(t, (uint32_t)id, 0);
+        else { fprintf(stderr, "%s:%zu: bad trace line\n", path, line); rc = -1; }
+    }
+    fclose(f);
+    return rc;
+}
+
+static int save_trace(const wl_trace *t, const char *path){
+    FILE *f = fopen(path, "w");
+    if (!f) { perror(path); return -1; }
+    for (size_t i=0;i<t->n;i++){
+        if (t->ops[i].size) fprintf(f, "a %u %u\n", t->ops[i].id, t->ops[i].size);
+        else fprintf(f, "f %u\n", t->ops[i].id);
+    }
+    return fclose(f);
+}
+
+// Builds the trace of a workload: lifo, fifo, random, prodcons, powerlaw or trace:FILE
+static int make_workload(wl_trace *t, const char *name, size_t n){
+    unsigned seed = 12345;
+    if (!strcmp(name, "lifo")) return gen_stack(t, n, 0, seed);
+    if (!strcmp(name, "fifo")) return gen_stack(t, n, 1, seed);
+    if (!strcmp(name, "random")) return gen_random(t, n, size_uniform, seed);
+    if (!strcmp(name, "prodcons")) return gen_prodcons(t, n, seed);
+    if (!strcmp(name, "powerlaw")) return gen_random(t, n, size_powerlaw, seed);
+    if (!strncmp(name, "trace:", 6)) return load_trace(t, name + 6);
+    fprintf(stderr, "unknown workload: %s\n", name);
+    return -1;
+}
+
+typedef struct {
+    size_t allocs, frees, failed;
+    uint32_t alloc_p50, alloc_p99, free_p50, free_p99; // ns
+    size_t peak_live;     // requested bytes
+    size_t peak_used;     // arena bytes not free, sampled; 0 without allocator_stats
+    size_t arena;
+    double ext_frag;      // mean of 1 - largest_free/free_bytes over the samples
+} wl_result;
+
+static int cmp_u32(const void *a, const void *b){
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(uint32_t *v, size_t n, double q){
+    return n ? v[(size_t)(q * (double)(n - 1))] : 0;
+}
+
+static void wl_sample(allocator_api_t *api, Allocator *A, wl_result *r, double *frag_sum, size_t *nfrag){
+    allocator_stats_t st;
+    api->stats(A, &st);
+    size_t used = st.arena_bytes - st.free_bytes;
+    if (used > r->peak_used) r->peak_used = used;
+    r->arena = st.arena_bytes;
+    if (st.free_bytes) { *frag_sum += 1.0 - (double)st.largest_free / (double)st.free_bytes; (*nfrag)++; }
+}
+
+// Every op is timed on its own. The heap is sampled every WL_STATS_EVERY ops
+// and right before the first free after a new peak of live bytes, so
+// peak_used is taken at the peak itself.
+static int run_workload(allocator_api_t *api, Allocator *A, const wl_trace *t, wl_result *r){
+    void **slot = (void**)calloc(t->nids, sizeof(void*));
+    uint32_t *size = (uint32_t*)calloc(t->nids, sizeof(uint32_t));
+    uint32_t *lat_a = (uint32_t*)malloc(t->n * sizeof(uint32_t));
+    uint32_t *lat_f = (uint32_t*)malloc(t->n * sizeof(uint32_t));
+    if (!slot || !size || !lat_a || !lat_f) { free(slot); free(size); free(lat_a); free(lat_f); return -1; }
+    memset(r, 0, sizeof *r);
+    size_t live = 0, nfrag = 0;
+    double frag_sum = 0;
+    int at_peak = 0;
+    for (size_t i=0;i<t->n;i++){
+        wl_op op = t->ops[i];
+        if (api->stats && (i % WL_STATS_EVERY == 0 || (at_peak && !op.size))) {
+            wl_sample(api, A, r, &frag_sum, &nfrag);
+            at_peak = 0;
+        }
+        if (op.size) {
+            if (slot[op.id]) { api->free(A, slot[op.id]); live -= size[op.id]; slot[op.id] = NULL; } // id reused while live
+            uint64_t t0 = now_ns();
+            void *p = api->alloc(A, op.size);
+            uint64_t t1 = now_ns();
+            lat_a[r->allocs++] = (uint32_t)(t1 - t0 > UINT32_MAX ? UINT32_MAX : t1 - t0);
+            if (!p) { r->failed++; continue; }
+            slot[op.id] = p; size[op.id] = op.size;
+            live += op.size;
+            if (live > r->peak_live) { r->peak_live = live; at_peak = 1; }
+        } else {
+            void *p = slot[op.id];
+            if (!p) continue;
+            uint64_t t0 = now_ns();
+            api->free(A, p);
+            uint64_t t1 = now_ns();
+            lat_f[r->frees++] = (uint32_t)(t1 - t0 > UINT32_MAX ? UINT32_MAX : t1 - t0);
+            slot[op.id] = NULL;
+            live -= size[op.id];
+        }
+    }
+    if (api->stats && at_peak) wl_sample(api, A, r, &frag_sum, &nfrag);
+    for (uint32_t id=0; id<t->nids; id++) if (slot[id]) api->free(A, slot[id]); // never freed by the trace
+    r->ext_frag = nfrag ? frag_sum / (double)nfrag : 0;
+    qsort(lat_a, r->allocs, sizeof(uint32_t), cmp_u32);
+    qsort(lat_f, r->frees, sizeof(uint32_t), cmp_u32);
+    r->alloc_p50 = percentile(lat_a, r->allocs, 0.50); r->alloc_p99 = percentile(lat_a, r->allocs, 0.99);
+    r->free_p50 = percentile(lat_f, r->frees, 0.50);   r->free_p99 = percentile(lat_f, r->frees, 0.99);
+    free(slot); free(size); free(lat_a); free(lat_f);
+    return 0;
+}
+
+// One CSV row per workload. Rows are appended to csv_path, so runs of several
+// libraries end up in one file; the header is written into an empty file only.
+static void write_csv_row(FILE *out, const char *lib, const char *workload, const allocator_api_t *api, const wl_result *r){
+    fprintf(out, "%s,%s,%zu,%zu,%u,%u,%u,%u,%zu,", lib, workload, r->allocs, r->failed,
+            r->alloc_p50, r->alloc_p99, r->free_p50, r->free_p99, r->peak_live);
+    if (api->stats && r->peak_used)
+        fprintf(out, "%zu,%zu,%.4f,%.4f\n", r->peak_used, r->arena, (double)r->peak_live / (double)r->peak_used, r->ext_frag);
+    else fprintf(out, ",,,\n"); // no allocator_stats in the library
+}
+
+static void run_workloads(allocator_api_t *api, Allocator **A, void *memory, size_t size, size_t n,
+                          const char *lib, char *list, const char *csv_path, const char *save_prefix){
+    FILE *out = csv_path ? fopen(csv_path, "a") : stdout;
+    if (!out) { perror(csv_path); return; }
+    fseek(out, 0, SEEK_END);
+    if (ftell(out) <= 0)
+        fprintf(out, "lib,workload,allocs,failed,alloc_p50_ns,alloc_p99_ns,free_p50_ns,free_p99_ns,"
+                     "peak_live,peak_used,arena_bytes,utilization,ext_frag\n");
+    char all[] = "lifo,fifo,random,prodcons,powerlaw";
+    if (!strcmp(list, "all")) list = all;
+    for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        wl_trace t = {0};
+        wl_result r;
+        if (make_workload(&t, name, n)) { free(t.ops); continue; }
+        if (save_prefix && strncmp(name, "trace:", 6)) {
+            char path[4096];
+            snprintf(path, sizeof path, "%s-%s.trace", save_prefix, name);
+            save_trace(&t, path);
+        }
+        if (!(*A = recreate(api, *A, memory, size))) { free(t.ops); break; }
+        if (!run_workload(api, *A, &t, &r)) write_csv_row(out, lib, name, api, &r);
+        else fprintf(stderr, "oom in workload %s\n", name);
+        free(t.ops);
+    }
+    if (out != stdout) fclose(out);
+    else fflush(out);
+}
 
 int main(int argc, char **argv){
-    const char *libpath = argc>1 ? argv[1] : NULL;
-    size_t arena = (argc>2) ? strtoull(argv[2], NULL, 10) : (1ull<<20); // 1 MiB default
+    // positional: [lib_path] [arena_size] [num_allocs]; options may go anywhere
+    const char *pos[3] = {0};
+    int npos = 0, mt_threads = 0, vector = 0;
+    size_t batch = 0;
+    arena_opts aopts = { 0, 0, 0, -1 };
+    char *workloads = NULL;
+    const char *csv_path = NULL, *save_prefix = NULL;
+    for (int i=1;i<argc;i++){
+        if (!strcmp(argv[i], "--threads") && i+1<argc) mt_threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--vector")) vector = 1;
+        else if (!strcmp(argv[i], "--batch") && i+1<argc) batch = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--hugetlb")) aopts.hugetlb = 1;
+        else if (!strcmp(argv[i], "--thp")) aopts.thp = 1;
+        else if (!strcmp(argv[i], "--populate")) aopts.populate = 1;
+        else if (!strcmp(argv[i], "--numa") && i+1<argc) aopts.numa_node = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--no-map-cache")) fb_cache_enabled = 0;
+        else if (!strcmp(argv[i], "--workload") && i+1<argc) workloads = argv[++i];
+        else if (!strcmp(argv[i], "--csv") && i+1<argc) csv_path = argv[++i];
+        else if (!strcmp(argv[i], "--save-trace") && i+1<argc) save_prefix = argv[++i];
+        else if (npos < 3) pos[npos++] = argv[i];
+        else { fprintf(stderr, "Unknown arg: %s\n", argv[i]); return 1; }
+    }
+    const char *libpath = pos[0];
+    size_t arena = pos[1] ? strtoull(pos[1], NULL, 10) : (1ull<<20); // 1 MiB default
 
     allocator_api_t api = {0};
     void *handle = NULL;
+    int thread_safe = 0;
+    void (*thread_flush)(Allocator*) = NULL;
     if (libpath) {
         handle = dlopen(libpath, RTLD_NOW);
         if (handle) {
@@ -43,25 +595,42 @@ int main(int argc, char **argv){
             api.destroy = (allocator_destroy_fn)dlsym(handle, "allocator_destroy");
             api.alloc   = (allocator_alloc_fn)dlsym(handle, "allocator_alloc");
             api.free    = (allocator_free_fn)dlsym(handle, "allocator_free");
+            api.usable_size = (allocator_usable_size_fn)dlsym(handle, "allocator_usable_size");
+            api.realloc = (allocator_realloc_fn)dlsym(handle, "allocator_realloc");
+            api.stats   = (allocator_stats_fn)dlsym(handle, "allocator_stats");
+            api.alloc_batch = (allocator_alloc_batch_fn)dlsym(handle, "allocator_alloc_batch");
+            api.free_batch  = (allocator_free_batch_fn)dlsym(handle, "allocator_free_batch");
+            const int *ts = (const int*)dlsym(handle, "allocator_thread_safe");
+            thread_safe = ts && *ts;
+            thread_flush = (void (*)(Allocator*))dlsym(handle, "allocator_thread_flush");
         }
     }
     if (!api.create || !api.destroy || !api.alloc || !api.free) {
         fprintf(stderr, "Using fallback mmap-based allocator (dlopen failed or missing symbols)\n");
         api.create = fb_create; api.destroy = fb_destroy; api.alloc = fb_alloc; api.free = fb_free;
+        api.usable_size = fb_usable_size; api.realloc = fb_realloc; api.stats = NULL;
+        api.alloc_batch = NULL; api.free_batch = NULL;
+        thread_safe = 1; // mmap/munmap are
+        thread_flush = NULL;
     }
+    emul_api = &api;
+    if (!api.realloc && api.usable_size) api.realloc = emul_realloc;
+    int native_batch = api.alloc_batch && api.free_batch;
+    if (!native_batch) { api.alloc_batch = emul_alloc_batch; api.free_batch = emul_free_batch; }
 
     // Allocate arena via mmap and init allocator (fallback ignores it)
-    void *memory = NULL; size_t psz = page_size(); size_t asz = align_up_size(arena, psz);
+    void *memory = NULL; size_t psz = page_size(); size_t asz = align_up_size(arena, psz), mapped = 0;
     if (api.create != fb_create) {
-        memory = mmap(NULL, asz, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-        if (memory == MAP_FAILED) { perror("mmap arena"); return 1; }
+        if (aopts.numa_node >= 64) { fprintf(stderr, "--numa: node must be below 64\n"); return 1; }
+        memory = map_arena(asz, &mapped, &aopts);
+        if (!memory) { perror("mmap arena"); return 1; }
     }
 
     Allocator *A = api.create(memory, asz);
-    if (!A) { fprintf(stderr, "allocator_create failed\n"); if(memory) munmap(memory, asz); return 1; }
+    if (!A) { fprintf(stderr, "allocator_create failed\n"); if(memory) munmap(memory, mapped); return 1; }
 
     // Simple benchmark: many alloc/free with random sizes
-    const size_t N = (argc>3) ? strtoull(argv[3], NULL, 10) : 100000;
+    const size_t N = pos[2] ? strtoull(pos[2], NULL, 10) : 100000;
     const size_t min_sz = 8, max_sz = 4096;
     void **ptrs = (void**)malloc(N * sizeof(void*));
     size_t *sizes = (size_t*)malloc(N * sizeof(size_t));
@@ -70,19 +639,38 @@ int main(int argc, char **argv){
     unsigned seed = 12345;
     for (size_t i=0;i<N;i++){ sizes[i]= (size_t)(min_sz + (rand_r(&seed) % (max_sz-min_sz+1))); }
 
+    long flt0 = minor_faults();
     uint64_t t0 = now_ns();
     for (size_t i=0;i<N;i++){ ptrs[i]= api.alloc(A, sizes[i]); if(!ptrs[i]){ fprintf(stderr, "alloc failed at %zu\n", i); break; } }
     uint64_t t1 = now_ns();
     for (size_t i=0;i<N;i++){ api.free(A, ptrs[i]); }
     uint64_t t2 = now_ns();
+    long flt1 = minor_faults();
 
     double alloc_ms = (t1-t0)/1e6, free_ms = (t2-t1)/1e6;
-    printf("allocs=%zu alloc_ms=%.3f free_ms=%.3f per_alloc_ns=%.1f per_free_ns=%.1f\n",
-           N, alloc_ms, free_ms, (t1-t0)/(double)N, (t2-t1)/(double)N);
+    printf("allocs=%zu alloc_ms=%.3f free_ms=%.3f per_alloc_ns=%.1f per_free_ns=%.1f minflt=%ld\n",
+           N, alloc_ms, free_ms, (t1-t0)/(double)N, (t2-t1)/(double)N, flt1 - flt0);
 
     free(ptrs); free(sizes);
+
+    // Every further benchmark starts on a freshly created allocator
+    if (mt_threads > 0 && (A = recreate(&api, A, memory, asz)))
+        run_mt_bench(&api, A, thread_safe, thread_flush, mt_threads, N);
+    if (vector && api.realloc && (A = recreate(&api, A, memory, asz)))
+        run_vector_bench(&api, A, N, 1);
+    else if (vector && !api.realloc)
+        fprintf(stderr, "no allocator_realloc or allocator_usable_size, realloc benchmark skipped\n");
+    if (vector && (A = recreate(&api, A, memory, asz)))
+        run_vector_bench(&api, A, N, 0);
+    if (A && batch) run_batch_bench(&api, &A, memory, asz, N, batch, native_batch);
+    if (A && workloads) {
+        const char *lib = api.create == fb_create ? "fallback" : (strrchr(libpath, '/') ? strrchr(libpath, '/') + 1 : libpath);
+        run_workloads(&api, &A, memory, asz, N, lib, workloads, csv_path, save_prefix);
+    }
+    if (!A) { fprintf(stderr, "allocator_create failed\n"); if(memory) munmap(memory, mapped); return 1; }
+
     api.destroy(A);
-    if (api.create != fb_create) munmap(memory, asz);
+    if (api.create != fb_create) munmap(memory, mapped);
     if (handle) dlclose(handle);
     return 0;
 }